@@ -0,0 +1,125 @@
+/*
+    压测用的服务端：同一套路由分别跑在epoll和io_uring传输上，配合load_generator比较两种传输，
+    也可以比较全功能的HttpServer和编译期去掉TLS、中间件、会话的PlainHttpServer
+
+    用法: bench_server [--key=value ...]
+        --port=8080           监听端口
+        --threads=4           I/O线程数(io_uring下为工作线程数)
+        --transport=epoll     epoll | uring
+        --sqpoll=0            1表示io_uring开启SQPOLL
+        --metrics=0           1表示开启/metrics
+        --policy=default      default | plain，plain使用PlainHttpServer
+
+    路由:
+        GET /ping   4字节文本
+        GET /json   约2KB的JSON，与micro_bench中的serialize_json_2k相同
+
+    例如:
+        bench_server --transport=epoll --port=8080 &
+        bench_server --transport=uring --port=8081 &
+        load_generator --port=8080 --path=/json --connections=256 --pipeline=4
+        load_generator --port=8081 --path=/json --connections=256 --pipeline=4
+        bench_server --policy=plain --port=8082 &
+*/
+#include <signal.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+
+#include "http/HttpServer.h"
+
+namespace
+{
+
+std::map<std::string, std::string> parseArgs(int argc, char* argv[])
+{
+    std::map<std::string, std::string> args;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if(arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+        {
+            std::fprintf(stderr, "invalid argument: %s\n", argv[i]);
+            std::exit(1);
+        }
+        args[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+    }
+    return args;
+}
+
+std::string argOr(const std::map<std::string, std::string>& args, const std::string& key, const std::string& value)
+{
+    auto it = args.find(key);
+    return it == args.end() ? value : it->second;
+}
+
+template<typename Server>
+int run(const std::map<std::string, std::string>& args)
+{
+    int port = std::atoi(argOr(args, "port", "8080").c_str());
+    int threads = std::atoi(argOr(args, "threads", "4").c_str());
+    std::string transport = argOr(args, "transport", "epoll");
+
+    Server server(port, "bench-server", false, TcpServer::kNoReusePort,
+                  transport == "uring" ? Server::kIoUring : Server::kEpoll);
+    server.setThreadNum(threads);
+    http::net::UringConfig uringConfig;
+    uringConfig.sqPoll = argOr(args, "sqpoll", "0") == "1";
+    server.setUringConfig(uringConfig);
+    server.setSocketTuning(http::net::SocketTuning::highThroughput());
+    if(argOr(args, "metrics", "0") == "1")
+    {
+        server.enableMetrics();
+    }
+
+    server.Get("/ping", [](const http::HttpRequest& req, http::HttpResponse* resp) {
+        resp->setStatusLine(req.getVersion(), http::HttpResponse::k200Ok, "OK");
+        resp->setContentType("text/plain");
+        resp->setContentLength(4);
+        resp->setBody("pong");
+    });
+
+    std::string jsonBody = "{\"success\":true,\"board\":[";
+    for(int i = 0; i < 225; ++i)
+    {
+        jsonBody += i == 0 ? "\"empty\"" : ",\"empty\"";
+    }
+    jsonBody += "]}";
+    server.Get("/json", [jsonBody](const http::HttpRequest& req, http::HttpResponse* resp) {
+        resp->setStatusLine(req.getVersion(), http::HttpResponse::k200Ok, "OK");
+        resp->setContentType("application/json");
+        resp->setContentLength(jsonBody.size());
+        resp->setBody(jsonBody);
+    });
+
+    server.start();
+    return 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    ::signal(SIGPIPE, SIG_IGN);
+    std::map<std::string, std::string> args = parseArgs(argc, argv);
+    std::string transport = argOr(args, "transport", "epoll");
+    if(transport != "epoll" && transport != "uring")
+    {
+        std::fprintf(stderr, "unknown transport: %s\n", transport.c_str());
+        return 1;
+    }
+    std::string policy = argOr(args, "policy", "default");
+    if(policy == "plain")
+    {
+        return run<http::PlainHttpServer>(args);
+    }
+    if(policy != "default")
+    {
+        std::fprintf(stderr, "unknown policy: %s\n", policy.c_str());
+        return 1;
+    }
+    return run<http::HttpServer>(args);
+}
@@ -0,0 +1,140 @@
+/*
+    连接建立速率基准测试：比较单acceptor与SO_REUSEPORT多acceptor模式下每秒能完成多少个短连接
+
+    用法: conn_rate_bench [port] [maxAcceptors] [clientThreads] [seconds]
+
+    对每个acceptor数量(1, 2, 4, ... maxAcceptors)，fork一个子进程运行HttpServer,
+    父进程起clientThreads个线程不停地 connect -> 发送GET /ping(Connection: close) -> 读到对端关闭 -> close,
+    统计seconds秒内完成的连接数，最后以JSON输出
+*/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http/HttpServer.h"
+
+namespace
+{
+
+const char kRequest[] = "GET /ping HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+
+void runServer(int port, int acceptors)
+{
+    http::HttpServer server(port, "conn-rate-bench", false, TcpServer::kReusePort);
+    server.Get("/ping", [](const http::HttpRequest& req, http::HttpResponse* resp){
+        resp->setStatusLine(req.getVersion(), http::HttpResponse::k200Ok, "OK");
+        resp->setContentType("text/plain");
+        resp->setBody("pong");
+        resp->setContentLength(4);
+    });
+
+    if(acceptors > 1)
+    {
+        http::net::ReusePortConfig config;
+        config.numAcceptors = acceptors;
+        for(int i = 0; i < acceptors; ++i)
+        {
+            config.cpus.push_back(i % static_cast<int>(std::thread::hardware_concurrency()));
+        }
+        config.cpuSteering = true;
+        server.setReusePortConfig(config);
+    }
+    server.start();
+}
+
+// 完成一次短连接，成功返回true
+bool oneConnection(const sockaddr_in& addr)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        return false;
+    }
+    bool ok = false;
+    if(::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) == 0 &&
+        ::write(fd, kRequest, sizeof(kRequest) - 1) == static_cast<ssize_t>(sizeof(kRequest) - 1))
+    {
+        char buf[512];
+        ssize_t n;
+        while((n = ::read(fd, buf, sizeof buf)) > 0) {}
+        ok = (n == 0);
+    }
+    ::close(fd);
+    return ok;
+}
+
+double measure(int port, int clientThreads, int seconds)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    std::atomic<bool> running{true};
+    std::atomic<long> completed{0};
+    std::vector<std::thread> clients;
+    for(int i = 0; i < clientThreads; ++i)
+    {
+        clients.emplace_back([&]{
+            long local = 0;
+            while(running.load(std::memory_order_relaxed))
+            {
+                if(oneConnection(addr)) { ++local; }
+            }
+            completed += local;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    running = false;
+    for(auto& t: clients)
+    {
+        t.join();
+    }
+    return static_cast<double>(completed.load()) / seconds;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int port = argc > 1 ? std::atoi(argv[1]) : 18080;
+    int maxAcceptors = argc > 2 ? std::atoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+    int clientThreads = argc > 3 ? std::atoi(argv[3]) : 2 * maxAcceptors;
+    int seconds = argc > 4 ? std::atoi(argv[4]) : 5;
+
+    std::printf("{\n  \"benchmark\": \"conn_rate\",\n  \"clientThreads\": %d,\n  \"seconds\": %d,\n  \"results\": [", clientThreads, seconds);
+    bool first = true;
+    for(int acceptors = 1; acceptors <= maxAcceptors; acceptors *= 2)
+    {
+        int serverPort = port + acceptors;
+        pid_t pid = ::fork();
+        if(pid == 0)
+        {
+            runServer(serverPort, acceptors);
+            ::_exit(0);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));  // 等待子进程开始监听
+
+        double rate = measure(serverPort, clientThreads, seconds);
+        ::kill(pid, SIGTERM);
+        ::waitpid(pid, nullptr, 0);
+
+        std::printf("%s\n    {\"acceptors\": %d, \"connectionsPerSec\": %.1f}", first ? "" : ",", acceptors, rate);
+        std::fflush(stdout);
+        first = false;
+    }
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
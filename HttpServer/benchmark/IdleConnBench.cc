@@ -0,0 +1,308 @@
+/*
+    空闲连接内存基准测试：测量每个空闲的keep-alive连接、每个会话让服务端的RSS增长多少，用于估算一台机器能承载的连接数
+
+    用法: idle_conn_bench [--key=value ...]
+        --port=18090          服务端端口
+        --threads=4           服务端I/O线程数
+        --connections=10000   空闲连接数
+        --step=2000           建立连接时每隔多少个测量一次，检查增长是否线性
+        --policy=default      default | plain，plain使用PlainHttpServer(没有会话，跳过会话阶段)
+
+    fork一个子进程运行HttpServer，父进程依次:
+        1. 建立connections个连接，不发送任何数据(每个连接只有HttpContext、Buffer和socket)
+        2. 每个连接发送一个GET /ping后保持空闲(keep-alive连接的常态，输入输出缓冲区已经用过)
+        3. 每个连接发送一个不带cookie的GET /session，服务端为每个请求新建一个会话
+    每个阶段结束后读取子进程的RSS，除以个数得到单位增长，最后附上服务端/admin/memory的记账结果对照。
+    socket在内核中的缓冲区不计入RSS。AiGame属于GomokuServer，它的大小由/admin/memory中的ai_game给出
+*/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "http/HttpServer.h"
+
+namespace
+{
+
+std::map<std::string, std::string> parseArgs(int argc, char* argv[])
+{
+    std::map<std::string, std::string> args;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if(arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+        {
+            std::fprintf(stderr, "invalid argument: %s\n", argv[i]);
+            std::exit(1);
+        }
+        args[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+    }
+    return args;
+}
+
+std::string argOr(const std::map<std::string, std::string>& args, const std::string& key, const std::string& value)
+{
+    auto it = args.find(key);
+    return it == args.end() ? value : it->second;
+}
+
+template<typename Policies>
+void runServer(int port, int threads)
+{
+    http::BasicHttpServer<Policies> server(port, "idle-conn-bench");
+    server.setThreadNum(threads);
+    // 测量期间不能因为空闲超时断开连接
+    http::TimeoutConfig timeouts;
+    timeouts.headerTimeout = 3600;
+    timeouts.keepAliveTimeout = 3600;
+    server.setTimeoutConfig(timeouts);
+    server.enableMemoryStats();
+
+    server.Get("/ping", [](const http::HttpRequest& req, http::HttpResponse* resp) {
+        resp->setStatusLine(req.getVersion(), http::HttpResponse::k200Ok, "OK");
+        resp->setContentType("text/plain");
+        resp->setContentLength(4);
+        resp->setBody("pong");
+    });
+
+    if constexpr (Policies::kSessions)
+    {
+        server.setSeesionManager(std::make_unique<http::session::SessionManager>(
+            std::make_unique<http::session::MemorySessionStorage>()));
+        server.Get("/session", [&server](const http::HttpRequest& req, http::HttpResponse* resp) {
+            // 与登录后的会话相当：一个用户编号和一个用户名
+            auto session = server.getSessionManager()->getSession(req, resp);
+            session->setValue("userId", "10001");
+            session->setValue("username", "bench-user");
+            resp->setStatusLine(req.getVersion(), http::HttpResponse::k200Ok, "OK");
+            resp->setContentType("text/plain");
+            resp->setContentLength(2);
+            resp->setBody("ok");
+        });
+    }
+    server.start();
+}
+
+size_t residentBytesOf(pid_t pid)
+{
+    FILE* statm = ::fopen(("/proc/" + std::to_string(pid) + "/statm").c_str(), "r");
+    if(!statm)
+    {
+        return 0;
+    }
+    unsigned long size = 0, resident = 0;
+    int n = ::fscanf(statm, "%lu %lu", &size, &resident);
+    ::fclose(statm);
+    return n == 2 ? resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE)) : 0;
+}
+
+int connectTo(const sockaddr_in& addr)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 发送一个请求并读完响应，返回响应体，失败时返回空
+std::string roundTrip(int fd, const std::string& path)
+{
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+    if(::write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+    {
+        return std::string();
+    }
+    std::string response;
+    char buf[4096];
+    while(true)
+    {
+        size_t headerEnd = response.find("\r\n\r\n");
+        if(headerEnd != std::string::npos)
+        {
+            size_t length = 0;
+            size_t field = response.find("Content-Length:");
+            if(field != std::string::npos && field < headerEnd)
+            {
+                length = std::strtoul(response.c_str() + field + 15, nullptr, 10);
+            }
+            if(response.size() >= headerEnd + 4 + length)
+            {
+                return response.substr(headerEnd + 4, length);
+            }
+        }
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if(n <= 0)
+        {
+            return std::string();
+        }
+        response.append(buf, n);
+    }
+}
+
+// 服务端处理完新连接和请求后内存才稳定
+void settle()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+double perUnit(size_t after, size_t before, size_t units)
+{
+    return units ? (static_cast<double>(after) - static_cast<double>(before)) / units : 0.0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    ::signal(SIGPIPE, SIG_IGN);
+    std::map<std::string, std::string> args = parseArgs(argc, argv);
+    int port = std::atoi(argOr(args, "port", "18090").c_str());
+    int threads = std::atoi(argOr(args, "threads", "4").c_str());
+    size_t connections = std::strtoul(argOr(args, "connections", "10000").c_str(), nullptr, 10);
+    size_t step = std::max(1UL, std::strtoul(argOr(args, "step", "2000").c_str(), nullptr, 10));
+    std::string policy = argOr(args, "policy", "default");
+    if(policy != "default" && policy != "plain")
+    {
+        std::fprintf(stderr, "unknown policy: %s\n", policy.c_str());
+        return 1;
+    }
+
+    // 两个进程都要打开connections个以上的fd，子进程继承放宽后的限制
+    struct rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+    if(connections + 64 > limit.rlim_cur)
+    {
+        connections = limit.rlim_cur > 64 ? limit.rlim_cur - 64 : 0;
+        std::fprintf(stderr, "fd limit %lu, using %zu connections\n", static_cast<unsigned long>(limit.rlim_cur), connections);
+    }
+
+    pid_t pid = ::fork();
+    if(pid == 0)
+    {
+        if(policy == "plain")
+        {
+            runServer<http::PlainPolicies>(port, threads);
+        }
+        else
+        {
+            runServer<http::DefaultPolicies>(port, threads);
+        }
+        ::_exit(0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));  // 等待子进程开始监听
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    // 先让每个I/O线程都处理过请求，线程局部的池和缓存不算到连接头上
+    for(int i = 0; i < 4 * threads; ++i)
+    {
+        int fd = connectTo(addr);
+        if(fd >= 0)
+        {
+            roundTrip(fd, "/ping");
+            ::close(fd);
+        }
+    }
+    settle();
+    size_t baseline = residentBytesOf(pid);
+
+    std::printf("{\n  \"benchmark\": \"idle_conn\",\n  \"policy\": \"%s\",\n  \"threads\": %d,\n", policy.c_str(), threads);
+    std::printf("  \"baselineRssBytes\": %zu,\n  \"connectSteps\": [", baseline);
+    std::vector<int> fds;
+    fds.reserve(connections);
+    bool first = true;
+    while(fds.size() < connections)
+    {
+        size_t target = std::min(connections, fds.size() + step);
+        while(fds.size() < target)
+        {
+            int fd = connectTo(addr);
+            if(fd < 0)
+            {
+                std::fprintf(stderr, "connect failed after %zu connections: %s\n", fds.size(), strerror(errno));
+                break;
+            }
+            fds.push_back(fd);
+        }
+        settle();
+        size_t rss = residentBytesOf(pid);
+        std::printf("%s\n    {\"connections\": %zu, \"rssBytes\": %zu, \"bytesPerConnection\": %.1f}",
+                    first ? "" : ",", fds.size(), rss, perUnit(rss, baseline, fds.size()));
+        std::fflush(stdout);
+        first = false;
+        if(fds.size() < target)
+        {
+            break;
+        }
+    }
+    std::printf("\n  ],\n");
+    size_t idle = residentBytesOf(pid);
+
+    size_t failed = 0;
+    for(int fd: fds)
+    {
+        failed += roundTrip(fd, "/ping") != "pong";
+    }
+    settle();
+    size_t used = residentBytesOf(pid);
+    std::printf("  \"connections\": %zu,\n  \"idleBytesPerConnection\": %.1f,\n", fds.size(), perUnit(idle, baseline, fds.size()));
+    std::printf("  \"afterRequestBytesPerConnection\": %.1f,\n", perUnit(used, baseline, fds.size()));
+
+    if(policy == "default")
+    {
+        for(int fd: fds)
+        {
+            failed += roundTrip(fd, "/session") != "ok";
+        }
+        settle();
+        size_t sessions = residentBytesOf(pid);
+        std::printf("  \"bytesPerSession\": %.1f,\n", perUnit(sessions, used, fds.size()));
+    }
+    std::printf("  \"failedRequests\": %zu,\n", failed);
+
+    // 服务端自己的记账，与RSS的增长对照
+    std::string memory;
+    int fd = connectTo(addr);
+    if(fd >= 0)
+    {
+        memory = roundTrip(fd, "/admin/memory");
+        ::close(fd);
+    }
+    while(!memory.empty() && memory.back() == '\n')
+    {
+        memory.pop_back();
+    }
+    std::printf("  \"serverMemory\": %s\n}\n", memory.empty() ? "null" : memory.c_str());
+
+    for(int conn: fds)
+    {
+        ::close(conn);
+    }
+    ::kill(pid, SIGTERM);
+    ::waitpid(pid, nullptr, 0);
+    return 0;
+}
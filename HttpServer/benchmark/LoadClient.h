@@ -0,0 +1,426 @@
+#ifndef LOADCLIENT_H
+#define LOADCLIENT_H
+
+/*
+    压测用的HTTP客户端连接，基于mymuduo的TcpClient，负载生成器和流量回放工具共用
+
+    - 支持流水线：可以连续发送多个请求，按发送顺序匹配响应，计算每个请求的延迟
+    - 支持TLS：OpenSSL通过内存BIO工作，密文仍由TcpConnection收发，与服务端的SslConnection对称
+    - 只解析压测需要的部分：状态码、Content-Length、Set-Cookie和Connection
+    - 支持Unix域socket：TcpClient只能连接InetAddress，这时自己connect后直接用fd创建TcpConnection
+*/
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "mymuduo/Buffer.h"
+#include "mymuduo/EventLoop.h"
+#include "mymuduo/InetAddress.h"
+#include "mymuduo/TcpClient.h"
+#include "mymuduo/TcpConnection.h"
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+namespace bench
+{
+
+inline uint64_t monotonicNanos()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// 一个待发送的请求
+struct RequestSpec
+{
+    std::string method;
+    std::string path;   // 可以带查询参数
+    std::string body;
+    std::string contentType;
+};
+
+// 解析出来的响应摘要
+struct ResponseInfo
+{
+    int status = 0;
+    std::string setCookie;  // Set-Cookie的值(只保留第一个)
+    bool close = false;     // 服务器要求关闭连接
+    size_t bytes = 0;       // 整个响应报文的字节数
+};
+
+class LoadConnection: noncopyable
+{
+public:
+    // 连接(以及TLS握手)建立完成，可以发送请求
+    using ReadyCallback = std::function<void(LoadConnection*)>;
+    // 收到一个完整响应，latency为该请求从发送到收完的时间
+    using ResponseCallback = std::function<void(LoadConnection*, const ResponseInfo&, uint64_t latencyNanos)>;
+    // 连接断开，inflight为断开时还未收到响应的请求数
+    using CloseCallback = std::function<void(LoadConnection*, size_t inflight)>;
+
+    // unixPath不为空时连接该Unix域socket，忽略addr
+    LoadConnection(EventLoop* loop, const InetAddress& addr, const std::string& name, SSL_CTX* sslCtx = nullptr,
+                   const std::string& unixPath = std::string()):
+        client_(loop, addr, name),
+        name_(name),
+        unixPath_(unixPath),
+        alive_(std::make_shared<bool>(true)),
+        sslCtx_(sslCtx),
+        ssl_(nullptr),
+        readBio_(nullptr),
+        writeBio_(nullptr),
+        ready_(false)
+    {
+        client_.setConnectionCallback(std::bind(&LoadConnection::onConnection, this, std::placeholders::_1));
+        client_.setMessageCallback(std::bind(&LoadConnection::onMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+
+    ~LoadConnection()
+    {
+        if(!unixPath_.empty() && conn_)
+        {
+            // 与TcpClient析构时一样，连接可能比本对象活得久，先摘掉指向本对象的回调
+            TcpConnectionPtr conn = conn_;
+            conn->setConnectionCallback([](const TcpConnectionPtr&) {});
+            conn->setMessageCallback([](const TcpConnectionPtr&, Buffer* buf, TimeStamp) { buf->retrieveAll(); });
+            conn->forceClose();
+        }
+        freeSsl();
+    }
+
+    void setReadyCallback(const ReadyCallback& cb) { readyCallback_ = cb; }
+    void setResponseCallback(const ResponseCallback& cb) { responseCallback_ = cb; }
+    void setCloseCallback(const CloseCallback& cb) { closeCallback_ = cb; }
+
+    // 连接断开后可以再次调用，重新建立连接
+    void connect()
+    {
+        if(unixPath_.empty())
+        {
+            client_.connect();
+        }
+        else
+        {
+            connectUnix();
+        }
+    }
+
+    void disconnect()
+    {
+        if(unixPath_.empty())
+        {
+            client_.disconnect();
+        }
+        else if(conn_)
+        {
+            conn_->shutdown();
+        }
+    }
+
+    bool ready() const { return ready_; }
+    size_t inflight() const { return sendTimes_.size(); }
+    EventLoop* getLoop() const { return client_.getLoop(); }
+
+    // 序列化一个请求
+    static std::string serialize(const RequestSpec& spec, const std::string& host, bool keepAlive, const std::string& cookie)
+    {
+        std::string request = spec.method + " " + spec.path + " HTTP/1.1\r\nHost: " + host + "\r\n";
+        request += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+        if(!cookie.empty())
+        {
+            request += "Cookie: " + cookie + "\r\n";
+        }
+        if(!spec.body.empty() || spec.method == "POST" || spec.method == "PUT")
+        {
+            if(!spec.contentType.empty())
+            {
+                request += "Content-Type: " + spec.contentType + "\r\n";
+            }
+            request += "Content-Length: " + std::to_string(spec.body.size()) + "\r\n";
+        }
+        request += "\r\n";
+        request += spec.body;
+        return request;
+    }
+
+    // 发送一个已经序列化好的请求，必须在所属loop线程、ready()之后调用
+    void sendRaw(const std::string& request)
+    {
+        sendTimes_.push_back(monotonicNanos());
+        if(ssl_)
+        {
+            SSL_write(ssl_, request.data(), static_cast<int>(request.size()));
+            flushTls();
+        }
+        else
+        {
+            conn_->send(request);
+        }
+    }
+
+    void send(const RequestSpec& spec, const std::string& host, bool keepAlive, const std::string& cookie = std::string())
+    {
+        sendRaw(serialize(spec, host, keepAlive, cookie));
+    }
+
+private:
+    // 必须在所属loop线程调用
+    void connectUnix()
+    {
+        EventLoop* loop = client_.getLoop();
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof addr);
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, unixPath_.c_str(), sizeof addr.sun_path - 1);
+        // Unix域socket的connect要么立即完成，要么因为服务端积压队列满而失败
+        if(fd < 0 || ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+        {
+            if(fd >= 0)
+            {
+                ::close(fd);
+            }
+            // 与TcpClient的Connector一样稍后重试，重试前对象可能已经销毁
+            std::weak_ptr<bool> alive = alive_;
+            loop->runAfter(0.5, [this, alive] {
+                if(!alive.expired())
+                {
+                    connectUnix();
+                }
+            });
+            return;
+        }
+
+        TcpConnectionPtr conn = std::make_shared<TcpConnection>(loop, name_ + "-unix", fd, InetAddress(), InetAddress());
+        conn->setConnectionCallback(std::bind(&LoadConnection::onConnection, this, std::placeholders::_1));
+        conn->setMessageCallback(std::bind(&LoadConnection::onMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        conn->setCloseCallback([loop](const TcpConnectionPtr& c) {
+            loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, c));
+        });
+        conn->connectEstablished();
+    }
+
+    void onConnection(const TcpConnectionPtr& conn)
+    {
+        if(conn->connected())
+        {
+            conn_ = conn;
+            if(unixPath_.empty())
+            {
+                conn->setTcpNoDelay(true);
+            }
+            in_.clear();
+            sendTimes_.clear();
+            if(sslCtx_)
+            {
+                // 每次连接都重新握手，不复用会话，测量的是完整的TLS开销
+                ssl_ = SSL_new(sslCtx_);
+                readBio_ = BIO_new(BIO_s_mem());
+                writeBio_ = BIO_new(BIO_s_mem());
+                SSL_set_bio(ssl_, readBio_, writeBio_);
+                SSL_set_connect_state(ssl_);
+                handshake();
+            }
+            else
+            {
+                ready_ = true;
+                if(readyCallback_)
+                {
+                    readyCallback_(this);
+                }
+            }
+        }
+        else
+        {
+            size_t inflight = sendTimes_.size();
+            ready_ = false;
+            conn_.reset();
+            sendTimes_.clear();
+            freeSsl();
+            if(closeCallback_)
+            {
+                closeCallback_(this, inflight);
+            }
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr& conn, Buffer* buf, TimeStamp)
+    {
+        if(!ssl_)
+        {
+            in_.append(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+            parseResponses();
+            return;
+        }
+
+        BIO_write(readBio_, buf->peek(), static_cast<int>(buf->readableBytes()));
+        buf->retrieveAll();
+        if(!ready_)
+        {
+            handshake();
+            if(!ready_)
+            {
+                return;
+            }
+        }
+
+        char plain[16384];
+        int n;
+        while((n = SSL_read(ssl_, plain, sizeof plain)) > 0)
+        {
+            in_.append(plain, n);
+        }
+        flushTls();  // SSL_read可能产生需要回复的记录(如会话票据确认)
+        parseResponses();
+    }
+
+    void handshake()
+    {
+        int ret = SSL_do_handshake(ssl_);
+        flushTls();
+        if(ret == 1)
+        {
+            ready_ = true;
+            if(readyCallback_)
+            {
+                readyCallback_(this);
+            }
+        }
+        else
+        {
+            int err = SSL_get_error(ssl_, ret);
+            if(err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+            {
+                conn_->forceClose();  // 握手失败，计为连接错误
+            }
+        }
+    }
+
+    // 把SSL产生的密文发出去
+    void flushTls()
+    {
+        char cipher[16384];
+        int n;
+        while((n = BIO_read(writeBio_, cipher, sizeof cipher)) > 0)
+        {
+            conn_->send(std::string(cipher, n));
+        }
+    }
+
+    void freeSsl()
+    {
+        if(ssl_)
+        {
+            SSL_free(ssl_);  // 同时释放两个BIO
+            ssl_ = nullptr;
+            readBio_ = nullptr;
+            writeBio_ = nullptr;
+        }
+    }
+
+    // 从in_中解析出所有完整的响应
+    void parseResponses()
+    {
+        while(true)
+        {
+            size_t headerEnd = in_.find("\r\n\r\n");
+            if(headerEnd == std::string::npos)
+            {
+                return;
+            }
+
+            ResponseInfo info;
+            size_t contentLength = 0;
+            size_t space = in_.find(' ');
+            if(space != std::string::npos && space < headerEnd)
+            {
+                info.status = std::atoi(in_.c_str() + space + 1);
+            }
+
+            size_t lineStart = in_.find("\r\n") + 2;
+            while(lineStart < headerEnd)
+            {
+                size_t lineEnd = in_.find("\r\n", lineStart);
+                size_t colon = in_.find(':', lineStart);
+                if(colon != std::string::npos && colon < lineEnd)
+                {
+                    std::string field = in_.substr(lineStart, colon - lineStart);
+                    size_t valueStart = in_.find_first_not_of(' ', colon + 1);
+                    std::string value = in_.substr(valueStart, lineEnd - valueStart);
+                    if(strcasecmp(field.c_str(), "Content-Length") == 0)
+                    {
+                        contentLength = std::strtoul(value.c_str(), nullptr, 10);
+                    }
+                    else if(strcasecmp(field.c_str(), "Set-Cookie") == 0 && info.setCookie.empty())
+                    {
+                        info.setCookie = value;
+                    }
+                    else if(strcasecmp(field.c_str(), "Connection") == 0)
+                    {
+                        info.close = strcasecmp(value.c_str(), "close") == 0;
+                    }
+                }
+                lineStart = lineEnd + 2;
+            }
+
+            size_t total = headerEnd + 4 + contentLength;
+            if(in_.size() < total)
+            {
+                return;  // 响应体还没收完
+            }
+            info.bytes = total;
+            in_.erase(0, total);
+
+            uint64_t latency = 0;
+            if(!sendTimes_.empty())
+            {
+                latency = monotonicNanos() - sendTimes_.front();
+                sendTimes_.pop_front();
+            }
+            if(responseCallback_)
+            {
+                responseCallback_(this, info, latency);
+            }
+        }
+    }
+
+    TcpClient client_;
+    std::string name_;
+    std::string unixPath_;  // 为空表示TCP
+    std::shared_ptr<bool> alive_;  // 随本对象销毁，延迟重连时据此判断对象是否还在
+    TcpConnectionPtr conn_;
+    SSL_CTX* sslCtx_;  // 为空表示明文
+    SSL* ssl_;
+    BIO* readBio_;   // 网络数据 -> SSL
+    BIO* writeBio_;  // SSL -> 网络数据
+    bool ready_;
+    std::string in_;  // 明文的响应数据
+    std::deque<uint64_t> sendTimes_;  // 已发送未响应的请求的发送时间
+    ReadyCallback readyCallback_;
+    ResponseCallback responseCallback_;
+    CloseCallback closeCallback_;
+};
+
+}
+
+}
+
+#endif
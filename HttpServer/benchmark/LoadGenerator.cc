@@ -0,0 +1,377 @@
+/*
+    HTTP负载生成器：基于mymuduo，对本地服务器施加可复现的负载，以JSON输出吞吐量和延迟分位数
+
+    用法: load_generator [--key=value ...]
+        --host=127.0.0.1      服务器地址
+        --port=8080           服务器端口
+        --unix=               服务器的Unix域socket路径，设置后不再使用host和port
+        --threads=2           客户端EventLoop线程数
+        --connections=64      并发连接数(平均分到各线程)
+        --seconds=10          压测时长
+        --warmup=1            预热时长，期间的响应不计入结果
+        --pipeline=1          每个连接上同时在途的请求数
+        --keepalive=1         0表示每个请求一个短连接
+        --tls=0               1表示使用TLS
+        --mix=get             请求组合: get | gomoku
+        --path=/              get组合请求的路径
+        --user=bench --password=bench --moves=10   gomoku组合的登录账号和每局落子数
+
+    gomoku组合模拟一个真实玩家：POST /login -> GET /aiBot/start -> moves次GET /aiBot/move -> 再开一局，
+    后续请求依赖登录返回的会话cookie，因此该组合下流水线深度固定为1
+*/
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mymuduo/EventLoopThread.h"
+
+#include "LoadClient.h"
+#include "metrics/Histogram.h"
+
+namespace
+{
+
+using http::bench::LoadConnection;
+using http::bench::RequestSpec;
+using http::bench::ResponseInfo;
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string unixPath;
+    int threads = 2;
+    int connections = 64;
+    int seconds = 10;
+    int warmup = 1;
+    int pipeline = 1;
+    bool keepAlive = true;
+    bool tls = false;
+    std::string mix = "get";
+    std::string path = "/";
+    std::string user = "bench";
+    std::string password = "bench";
+    int moves = 10;
+};
+
+Options parseOptions(int argc, char* argv[])
+{
+    std::map<std::string, std::string> args;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if(arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+        {
+            std::fprintf(stderr, "invalid argument: %s\n", argv[i]);
+            std::exit(1);
+        }
+        args[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+    }
+
+    Options opt;
+    auto get = [&args](const char* key, auto& value) {
+        auto it = args.find(key);
+        if(it == args.end())
+        {
+            return;
+        }
+        if constexpr (std::is_same_v<std::decay_t<decltype(value)>, std::string>)
+        {
+            value = it->second;
+        }
+        else
+        {
+            value = std::atoi(it->second.c_str());
+        }
+    };
+    get("host", opt.host);
+    get("port", opt.port);
+    get("unix", opt.unixPath);
+    get("threads", opt.threads);
+    get("connections", opt.connections);
+    get("seconds", opt.seconds);
+    get("warmup", opt.warmup);
+    get("pipeline", opt.pipeline);
+    get("keepalive", opt.keepAlive);
+    get("tls", opt.tls);
+    get("mix", opt.mix);
+    get("path", opt.path);
+    get("user", opt.user);
+    get("password", opt.password);
+    get("moves", opt.moves);
+
+    if(opt.mix != "get" && opt.mix != "gomoku")
+    {
+        std::fprintf(stderr, "unknown mix: %s\n", opt.mix.c_str());
+        std::exit(1);
+    }
+    if(opt.mix == "gomoku" || !opt.keepAlive)
+    {
+        opt.pipeline = 1;  // 依赖上一个响应(cookie)或者每个请求一个连接时无法流水线
+    }
+    opt.threads = std::max(1, opt.threads);
+    opt.connections = std::max(opt.threads, opt.connections);
+    opt.pipeline = std::max(1, opt.pipeline);
+    return opt;
+}
+
+enum Phase
+{
+    kWarmup,
+    kMeasure,
+    kStopped
+};
+
+std::atomic<int> g_phase{kWarmup};
+
+// 每个线程一份统计，只在本线程写
+struct WorkerStats
+{
+    http::metrics::Histogram latency;
+    uint64_t requests = 0;
+    uint64_t non2xx = 0;
+    uint64_t errors = 0;   // 连接断开时未收到响应的请求、连接失败
+    uint64_t bytes = 0;
+    std::map<int, uint64_t> statusCounts;
+};
+
+// 一个虚拟用户，持有一个连接
+class VirtualUser
+{
+public:
+    VirtualUser(EventLoop* loop, const InetAddress& addr, const Options& opt, SSL_CTX* sslCtx,
+                WorkerStats* stats, int index):
+        conn_(loop, addr, "load-" + std::to_string(index), sslCtx, opt.unixPath),
+        opt_(opt),
+        stats_(stats),
+        host_(opt.host + ":" + std::to_string(opt.port)),
+        step_(0),
+        rng_(index)
+    {
+        conn_.setReadyCallback([this](LoadConnection*) { fill(); });
+        conn_.setResponseCallback(std::bind(&VirtualUser::onResponse, this,
+            std::placeholders::_2, std::placeholders::_3));
+        conn_.setCloseCallback(std::bind(&VirtualUser::onClose, this, std::placeholders::_2));
+    }
+
+    void start() { conn_.connect(); }
+    void stop() { conn_.disconnect(); }
+
+private:
+    // 按流水线深度补满在途请求
+    void fill()
+    {
+        while(g_phase != kStopped && conn_.ready() && conn_.inflight() < static_cast<size_t>(opt_.pipeline))
+        {
+            conn_.send(nextRequest(), host_, opt_.keepAlive, cookie_);
+            if(!opt_.keepAlive)
+            {
+                break;
+            }
+        }
+    }
+
+    RequestSpec nextRequest()
+    {
+        if(opt_.mix == "get")
+        {
+            return RequestSpec{"GET", opt_.path, "", ""};
+        }
+
+        // gomoku: 0登录，1开局，之后落子
+        if(step_ == 0 || cookie_.empty())
+        {
+            step_ = 0;
+            std::string body = "{\"username\":\"" + opt_.user + "\",\"password\":\"" + opt_.password + "\"}";
+            return RequestSpec{"POST", "/login", body, "application/json"};
+        }
+        if(step_ == 1)
+        {
+            return RequestSpec{"GET", "/aiBot/start", "", ""};
+        }
+        std::uniform_int_distribution<int> cell(0, 14);
+        return RequestSpec{"GET", "/aiBot/move?x=" + std::to_string(cell(rng_)) + "&y=" + std::to_string(cell(rng_)), "", ""};
+    }
+
+    void onResponse(const ResponseInfo& info, uint64_t latencyNanos)
+    {
+        if(g_phase == kMeasure)
+        {
+            stats_->latency.record(latencyNanos);
+            ++stats_->requests;
+            stats_->bytes += info.bytes;
+            ++stats_->statusCounts[info.status];
+            if(info.status < 200 || info.status >= 300)
+            {
+                ++stats_->non2xx;
+            }
+        }
+
+        if(opt_.mix == "gomoku")
+        {
+            if(step_ == 0)
+            {
+                // sessionId=xxx; Path=/ ... 只保留名值对
+                cookie_ = info.setCookie.substr(0, info.setCookie.find(';'));
+            }
+            step_ = (step_ >= 1 + opt_.moves) ? 1 : step_ + 1;
+        }
+
+        if(!info.close)
+        {
+            fill();
+        }
+    }
+
+    void onClose(size_t inflight)
+    {
+        if(g_phase == kMeasure)
+        {
+            stats_->errors += inflight;
+        }
+        if(g_phase != kStopped)
+        {
+            conn_.connect();  // 短连接模式或者被服务器关闭，重新连接
+        }
+    }
+
+    LoadConnection conn_;
+    const Options& opt_;
+    WorkerStats* stats_;
+    std::string host_;
+    int step_;
+    std::string cookie_;
+    std::mt19937 rng_;
+};
+
+struct Worker
+{
+    EventLoopThread thread;
+    EventLoop* loop = nullptr;
+    WorkerStats stats;
+    std::vector<std::unique_ptr<VirtualUser>> users;
+};
+
+double toMicros(uint64_t nanos)
+{
+    return nanos / 1000.0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    ::signal(SIGPIPE, SIG_IGN);
+    Options opt = parseOptions(argc, argv);
+
+    SSL_CTX* sslCtx = nullptr;
+    if(opt.tls)
+    {
+        OPENSSL_init_ssl(0, nullptr);
+        sslCtx = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_verify(sslCtx, SSL_VERIFY_NONE, nullptr);  // 本地自签名证书
+    }
+
+    InetAddress addr(static_cast<uint16_t>(opt.port), opt.host);
+    std::vector<std::unique_ptr<Worker>> workers;
+    for(int i = 0; i < opt.threads; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->loop = workers.back()->thread.startLoop();
+    }
+
+    // 虚拟用户在所属loop线程里创建和启动
+    for(int i = 0; i < opt.connections; ++i)
+    {
+        Worker* worker = workers[i % opt.threads].get();
+        worker->loop->runInLoop([worker, addr, &opt, sslCtx, i] {
+            worker->users.push_back(std::make_unique<VirtualUser>(worker->loop, addr, opt, sslCtx, &worker->stats, i));
+            worker->users.back()->start();
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(opt.warmup));
+    g_phase = kMeasure;
+    auto begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    g_phase = kStopped;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    // 先断开所有连接，等连接回调都执行完再在各自的loop线程里销毁，最后汇总统计
+    for(auto& worker: workers)
+    {
+        Worker* w = worker.get();
+        w->loop->runInLoop([w] {
+            for(auto& user: w->users)
+            {
+                user->stop();
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    for(auto& worker: workers)
+    {
+        std::promise<void> done;
+        Worker* w = worker.get();
+        w->loop->runInLoop([w, &done] {
+            w->users.clear();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+
+    http::metrics::HistogramSnapshot latency;
+    uint64_t requests = 0, non2xx = 0, errors = 0, bytes = 0;
+    std::map<int, uint64_t> statusCounts;
+    for(auto& worker: workers)
+    {
+        latency.merge(worker->stats.latency);
+        requests += worker->stats.requests;
+        non2xx += worker->stats.non2xx;
+        errors += worker->stats.errors;
+        bytes += worker->stats.bytes;
+        for(const auto& item: worker->stats.statusCounts)
+        {
+            statusCounts[item.first] += item.second;
+        }
+    }
+
+    std::printf("{\n  \"benchmark\": \"load\",\n");
+    std::string target = opt.unixPath.empty() ? opt.host + ":" + std::to_string(opt.port) : "unix:" + opt.unixPath;
+    std::printf("  \"target\": \"%s\",\n  \"mix\": \"%s\",\n", target.c_str(), opt.mix.c_str());
+    std::printf("  \"threads\": %d,\n  \"connections\": %d,\n  \"pipeline\": %d,\n  \"keepAlive\": %s,\n  \"tls\": %s,\n",
+                opt.threads, opt.connections, opt.pipeline, opt.keepAlive ? "true" : "false", opt.tls ? "true" : "false");
+    std::printf("  \"seconds\": %.3f,\n  \"requests\": %lu,\n  \"errors\": %lu,\n  \"non2xx\": %lu,\n",
+                elapsed, static_cast<unsigned long>(requests), static_cast<unsigned long>(errors), static_cast<unsigned long>(non2xx));
+    std::printf("  \"throughputRps\": %.1f,\n  \"throughputMBps\": %.3f,\n", requests / elapsed, bytes / elapsed / (1024 * 1024));
+    std::printf("  \"status\": {");
+    bool first = true;
+    for(const auto& item: statusCounts)
+    {
+        std::printf("%s\"%d\": %lu", first ? "" : ", ", item.first, static_cast<unsigned long>(item.second));
+        first = false;
+    }
+    std::printf("},\n");
+    std::printf("  \"latencyUs\": {\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}\n}\n",
+                latency.count() ? toMicros(latency.sum() / latency.count()) : 0.0,
+                toMicros(latency.quantile(0.5)), toMicros(latency.quantile(0.9)), toMicros(latency.quantile(0.99)),
+                toMicros(latency.quantile(0.999)), toMicros(latency.quantile(1.0)));
+
+    workers.clear();  // 退出各个loop线程
+    if(sslCtx)
+    {
+        SSL_CTX_free(sslCtx);
+    }
+    return 0;
+}
@@ -0,0 +1,339 @@
+/*
+    HttpServer库热路径的微基准测试，单线程运行，以JSON输出每个用例的 ns/op、allocs/op 和 bytes/op
+
+    用法: micro_bench [filter] [minMillis]
+        filter     只运行名字中包含该子串的用例
+        minMillis  每个用例至少运行的毫秒数，默认500
+
+    分配次数通过替换全局operator new/delete统计，只统计运行用例的线程(日志线程等的分配不计入)
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "http/BufferPool.h"
+#include "http/ConnectionState.h"
+#include "http/HttpContext.h"
+#include "http/HttpRequest.h"
+#include "http/HttpResponse.h"
+#include "router/Router.h"
+#include "session/SessionManager.h"
+#include "session/SessionStorage.h"
+#include "middleware/MiddlewareChain.h"
+#include "middleware/cors/CorsMiddleware.h"
+
+namespace
+{
+
+thread_local bool t_counting = false;
+thread_local uint64_t t_allocs = 0;
+thread_local uint64_t t_bytes = 0;
+
+void* countedAlloc(size_t size)
+{
+    if(t_counting)
+    {
+        ++t_allocs;
+        t_bytes += size;
+    }
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if(!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+}
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace
+{
+
+using namespace http;
+
+// 防止编译器把结果优化掉
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+};
+
+// 先按小批量估算单次耗时，再跑满minMillis
+Result run(const std::string& name, int minMillis, const std::function<void()>& op)
+{
+    for(int i = 0; i < 100; ++i)  // 预热
+    {
+        op();
+    }
+
+    uint64_t batch = 1;
+    while(true)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for(uint64_t i = 0; i < batch; ++i)
+        {
+            op();
+        }
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        if(elapsedMs > minMillis / 10.0)
+        {
+            batch = static_cast<uint64_t>(batch * (minMillis / elapsedMs)) + 1;
+            break;
+        }
+        batch *= 2;
+    }
+
+    t_allocs = 0;
+    t_bytes = 0;
+    t_counting = true;
+    auto begin = std::chrono::steady_clock::now();
+    for(uint64_t i = 0; i < batch; ++i)
+    {
+        op();
+    }
+    double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    t_counting = false;
+
+    return Result{name, batch, elapsedNs / batch,
+                  static_cast<double>(t_allocs) / batch, static_cast<double>(t_bytes) / batch};
+}
+
+// 浏览器发出的典型请求
+const char kBrowserRequest[] =
+    "GET /aiBot/move?x=7&y=8 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: application/json, text/plain, */*\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Referer: http://localhost:8080/aiBot/start\r\n"
+    "Origin: http://localhost:8080\r\n"
+    "Cookie: sessionId=0123456789abcdef0123456789abcdef; theme=dark\r\n"
+    "\r\n";
+
+// Content-Length由请求体算出，手写的长度与请求体不一致时解析永远不会完成
+const std::string kLoginBody = "{\"username\":\"player1\",\"password\":\"secret\"}";
+const std::string kLoginRequest =
+    "POST /login HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: " + std::to_string(kLoginBody.size()) + "\r\n"
+    "\r\n" + kLoginBody;
+
+// 解析一个完整的请求，作为其他用例的输入
+HttpRequest parseFixture(const char* raw)
+{
+    HttpContext context;
+    Buffer buf;
+    buf.append(raw, std::strlen(raw));
+    context.parseRequest(&buf, TimeStamp::now());
+    return context.request();
+}
+
+// 计时之前先解析一次，请求不完整或有剩余字节时测的就不是完整的解析
+void checkParses(const char* name, const char* raw, size_t len)
+{
+    HttpContext context;
+    Buffer buf;
+    buf.append(raw, len);
+    if(!context.parseRequest(&buf, TimeStamp()) || !context.gotAll() || buf.readableBytes() != 0)
+    {
+        std::fprintf(stderr, "%s: fixture does not parse into exactly one complete request\n", name);
+        std::exit(1);
+    }
+}
+
+void noopHandler(const HttpRequest&, HttpResponse* resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+}
+
+// 与GomokuServer规模相当的路由表：若干静态路由加几个动态路由
+void buildRouter(router::Router& router)
+{
+    const char* staticPaths[] = {
+        "/", "/entry", "/login", "/register", "/user/logout", "/menu", "/aiBot/start", "/aiBot/move",
+        "/aiBot/restart", "/backend", "/backend_data", "/api/users", "/api/products", "/api/orders",
+        "/static/app.js", "/static/app.css", "/favicon.ico", "/health", "/metrics", "/ping"
+    };
+    for(const char* path: staticPaths)
+    {
+        router.registerCallback(HttpRequest::kGet, path, noopHandler);
+    }
+    router.registerCallback(HttpRequest::kPost, "/login", noopHandler);
+    router.addRegexCallback(HttpRequest::kGet, "/api/users/:id", noopHandler);
+    router.addRegexCallback(HttpRequest::kGet, "/api/users/:id/orders/:orderId", noopHandler);
+    router.addRegexCallback(HttpRequest::kGet, "/api/products/:id", noopHandler);
+    router.addRegexCallback(HttpRequest::kDelete, "/api/users/:id", noopHandler);
+    router.addRegexCallback(HttpRequest::kGet, "/game/:room/state", noopHandler);
+}
+
+void printJson(const std::vector<Result>& results)
+{
+    std::printf("{\n  \"benchmark\": \"micro\",\n  \"results\": [");
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        std::printf("%s\n    {\"name\": \"%s\", \"iterations\": %lu, \"nsPerOp\": %.1f, \"allocsPerOp\": %.2f, \"bytesPerOp\": %.1f}",
+                    i == 0 ? "" : ",", r.name.c_str(), static_cast<unsigned long>(r.iterations),
+                    r.nsPerOp, r.allocsPerOp, r.bytesPerOp);
+    }
+    std::printf("\n  ]\n}\n");
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::string filter = argc > 1 ? argv[1] : "";
+    int minMillis = argc > 2 ? std::atoi(argv[2]) : 500;
+
+    std::vector<std::pair<std::string, std::function<void()>>> cases;
+
+    // HttpContext::parseRequest
+    HttpContext parseContext;
+    Buffer parseBuf;
+    size_t browserLen = std::strlen(kBrowserRequest);
+    size_t loginLen = kLoginRequest.size();
+    checkParses("parse_get_browser", kBrowserRequest, browserLen);
+    checkParses("parse_post_json", kLoginRequest.data(), loginLen);
+    cases.emplace_back("parse_get_browser", [&] {
+        parseBuf.append(kBrowserRequest, browserLen);
+        parseContext.parseRequest(&parseBuf, TimeStamp());
+        doNotOptimize(parseContext.gotAll());
+        parseContext.reset();
+    });
+    cases.emplace_back("parse_post_json", [&] {
+        parseBuf.append(kLoginRequest.data(), loginLen);
+        parseContext.parseRequest(&parseBuf, TimeStamp());
+        doNotOptimize(parseContext.gotAll());
+        parseContext.reset();
+    });
+
+    // HttpResponse::appendToBuffer
+    std::string jsonBody = "{\"success\":true,\"board\":[";
+    for(int i = 0; i < 225; ++i)
+    {
+        jsonBody += i == 0 ? "\"empty\"" : ",\"empty\"";
+    }
+    jsonBody += "]}";
+    HttpResponse jsonResponse(false);
+    jsonResponse.setStatusLine("HTTP/1.1", HttpResponse::k200Ok, "OK");
+    jsonResponse.setContentType("application/json");
+    jsonResponse.setContentLength(jsonBody.size());
+    jsonResponse.addHeader("Access-Control-Allow-Origin", "*");
+    jsonResponse.addHeader("Set-Cookie", "sessionId=0123456789abcdef0123456789abcdef; Path=/; HttpOnly");
+    jsonResponse.setBody(jsonBody);
+    cases.emplace_back("serialize_json_2k", [&] {
+        Buffer out;
+        jsonResponse.appendToBuffer(&out);
+        doNotOptimize(out.readableBytes());
+    });
+    BufferPool bufferPool;
+    cases.emplace_back("serialize_json_2k_pooled", [&] {
+        PooledBuffer out(bufferPool);
+        jsonResponse.appendToBuffer(out.get());
+        doNotOptimize(out->readableBytes());
+    });
+    HttpResponse emptyResponse(false);
+    emptyResponse.setStatusLine("HTTP/1.1", HttpResponse::k204NoContent, "No Content");
+    cases.emplace_back("serialize_empty", [&] {
+        Buffer out;
+        emptyResponse.appendToBuffer(&out);
+        doNotOptimize(out.readableBytes());
+    });
+
+    // 短连接的连接状态：每次新建 vs 从池中复用
+    cases.emplace_back("conn_state_new", [&] {
+        std::unique_ptr<ConnectionState> state(new ConnectionState());
+        state->context.setPeerIp("192.168.100.200");
+        doNotOptimize(state.get());
+    });
+    ConnectionStatePool statePool;
+    cases.emplace_back("conn_state_pooled", [&] {
+        ConnectionState* state = statePool.acquire();
+        state->context.setPeerIp("192.168.100.200");
+        doNotOptimize(state);
+        statePool.release(state);
+    });
+
+    // Router::route
+    router::Router router;
+    buildRouter(router);
+    HttpRequest staticReq = parseFixture("GET /aiBot/move HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    HttpRequest regexReq = parseFixture("GET /api/users/42/orders/7 HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    HttpRequest missReq = parseFixture("GET /no/such/path HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    cases.emplace_back("route_static_hit", [&] {
+        HttpResponse resp;
+        doNotOptimize(router.route(staticReq, &resp));
+    });
+    cases.emplace_back("route_regex_hit", [&] {
+        HttpResponse resp;
+        doNotOptimize(router.route(regexReq, &resp));
+    });
+    cases.emplace_back("route_miss", [&] {
+        HttpResponse resp;
+        doNotOptimize(router.route(missReq, &resp));
+    });
+
+    // SessionManager::getSession，存储中预先放入一批会话
+    session::SessionManager sessionManager(std::make_unique<session::MemorySessionStorage>());
+    std::string knownSessionId;
+    HttpRequest noCookieReq = parseFixture("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    for(int i = 0; i < 1000; ++i)
+    {
+        HttpResponse resp;
+        knownSessionId = sessionManager.getSession(noCookieReq, &resp)->getId();
+    }
+    std::string cookieRequest = "GET / HTTP/1.1\r\nHost: localhost\r\nCookie: theme=dark; sessionId=" + knownSessionId + "\r\n\r\n";
+    HttpRequest cookieReq = parseFixture(cookieRequest.c_str());
+    cases.emplace_back("session_get_existing", [&] {
+        HttpResponse resp;
+        doNotOptimize(sessionManager.getSession(cookieReq, &resp).get());
+    });
+
+    // MiddlewareChain，配置一个CORS中间件
+    middleware::MiddlewareChain chain;
+    chain.addMiddleware(std::make_shared<middleware::CorsMiddleware>());
+    HttpRequest corsReq = parseFixture(kBrowserRequest);
+    cases.emplace_back("middleware_cors", [&] {
+        HttpResponse resp;
+        chain.processBefore(corsReq);
+        chain.processAfter(resp);
+        doNotOptimize(resp.getStatusCode());
+    });
+
+    std::vector<Result> results;
+    for(const auto& item: cases)
+    {
+        if(filter.empty() || item.first.find(filter) != std::string::npos)
+        {
+            results.push_back(run(item.first, minMillis, item.second));
+        }
+    }
+    printJson(results);
+    return 0;
+}
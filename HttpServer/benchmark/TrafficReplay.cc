@@ -0,0 +1,631 @@
+/*
+    流量回放工具：把HttpServer::enableCapture抓到的请求字节按连接重新发给本地服务器，逐个请求比较抓包时和回放时的延迟
+
+    用法: traffic_replay --file=capture.bin [--key=value ...]
+        --file=               抓包文件
+        --host=127.0.0.1      服务器地址
+        --port=8080           服务器端口
+        --unix=               服务器的Unix域socket路径，设置后不再使用host和port
+        --tls=0               1表示使用TLS(抓包文件里是明文，回放时重新加密)
+        --threads=2           客户端EventLoop线程数，抓到的连接平均分到各线程
+        --mode=paced          paced: 按抓包时的节奏发送每个请求; fast: 每个连接收到响应后立即发送下一个请求
+        --speed=1             paced模式的时间倍率，2表示两倍速
+        --timeout=60          最后一个请求发出后最多再等待的秒数
+        --details=1           0表示只输出汇总，不逐个列出请求
+
+    抓包时的延迟是服务端从收齐请求的最后一个字节到写出响应的时间，回放时的延迟是客户端从发出请求到收完响应的时间，
+    本地回放时两者的差主要来自服务端的变化。请求按HTTP/1.1报文边界(Content-Length或chunked)从字节流中切分，
+    第n个响应对应第n个请求
+*/
+#include <signal.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mymuduo/EventLoopThread.h"
+
+#include "LoadClient.h"
+#include "diagnostics/TrafficCapture.h"
+#include "metrics/Histogram.h"
+
+namespace
+{
+
+using http::bench::LoadConnection;
+using http::bench::ResponseInfo;
+using http::diagnostics::CaptureRecord;
+using http::diagnostics::TrafficCapture;
+
+struct Options
+{
+    std::string file;
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string unixPath;
+    bool tls = false;
+    int threads = 2;
+    std::string mode = "paced";
+    double speed = 1.0;
+    int timeout = 60;
+    bool details = true;
+};
+
+Options parseOptions(int argc, char* argv[])
+{
+    std::map<std::string, std::string> args;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if(arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+        {
+            std::fprintf(stderr, "invalid argument: %s\n", argv[i]);
+            std::exit(1);
+        }
+        args[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+    }
+
+    Options opt;
+    auto get = [&args](const char* key, auto& value) {
+        auto it = args.find(key);
+        if(it == args.end())
+        {
+            return;
+        }
+        if constexpr (std::is_same_v<std::decay_t<decltype(value)>, std::string>)
+        {
+            value = it->second;
+        }
+        else if constexpr (std::is_same_v<std::decay_t<decltype(value)>, double>)
+        {
+            value = std::atof(it->second.c_str());
+        }
+        else
+        {
+            value = std::atoi(it->second.c_str());
+        }
+    };
+    get("file", opt.file);
+    get("host", opt.host);
+    get("port", opt.port);
+    get("unix", opt.unixPath);
+    get("tls", opt.tls);
+    get("threads", opt.threads);
+    get("mode", opt.mode);
+    get("speed", opt.speed);
+    get("timeout", opt.timeout);
+    get("details", opt.details);
+
+    if(opt.file.empty())
+    {
+        std::fprintf(stderr, "--file is required\n");
+        std::exit(1);
+    }
+    if(opt.mode != "paced" && opt.mode != "fast")
+    {
+        std::fprintf(stderr, "unknown mode: %s\n", opt.mode.c_str());
+        std::exit(1);
+    }
+    if(opt.speed <= 0)
+    {
+        std::fprintf(stderr, "speed must be positive\n");
+        std::exit(1);
+    }
+    opt.threads = std::max(1, opt.threads);
+    return opt;
+}
+
+// 抓包中的一个请求
+struct CapturedRequest
+{
+    std::string bytes;
+    std::string label;             // "METHOD 路径"，不含查询参数，用于按路由汇总
+    uint64_t arrivalNanos = 0;     // 最后一个字节到达的时间(相对抓包开始)
+    int64_t originalNanos = -1;    // 抓包时的延迟，没有抓到响应时为-1
+    int originalStatus = 0;
+    int64_t replayNanos = -1;      // 回放时的延迟，没有收到响应时为-1
+    int replayStatus = 0;
+};
+
+// 抓包中的一个连接
+struct CapturedConnection
+{
+    uint64_t id = 0;
+    uint64_t openNanos = 0;
+    std::string stream;                                        // 收到的全部字节
+    std::vector<std::pair<size_t, uint64_t>> chunks;           // (到该块为止的字节数, 到达时间)
+    std::vector<std::pair<uint64_t, int>> responses;           // (写出时间, 状态码)
+    std::vector<CapturedRequest> requests;
+};
+
+// 报文头中某个字段的值，没有时返回空
+std::string headerValue(const std::string& header, const char* field)
+{
+    size_t fieldLen = std::strlen(field);
+    size_t lineStart = header.find("\r\n");
+    while(lineStart != std::string::npos && lineStart + 2 < header.size())
+    {
+        lineStart += 2;
+        size_t lineEnd = header.find("\r\n", lineStart);
+        if(lineEnd == std::string::npos)
+        {
+            lineEnd = header.size();
+        }
+        if(lineEnd - lineStart > fieldLen && header[lineStart + fieldLen] == ':' &&
+           strncasecmp(header.c_str() + lineStart, field, fieldLen) == 0)
+        {
+            size_t valueStart = header.find_first_not_of(' ', lineStart + fieldLen + 1);
+            return valueStart < lineEnd ? header.substr(valueStart, lineEnd - valueStart) : std::string();
+        }
+        lineStart = lineEnd;
+    }
+    return std::string();
+}
+
+// 从stream的offset处切出一个完整的请求，返回它的长度，不完整时返回0
+size_t frameRequest(const std::string& stream, size_t offset)
+{
+    size_t headerEnd = stream.find("\r\n\r\n", offset);
+    if(headerEnd == std::string::npos)
+    {
+        return 0;
+    }
+    std::string header = stream.substr(offset, headerEnd - offset);
+    size_t bodyStart = headerEnd + 4;
+    if(strcasecmp(headerValue(header, "Transfer-Encoding").c_str(), "chunked") == 0)
+    {
+        size_t last = stream.find("\r\n0\r\n\r\n", headerEnd);
+        if(stream.compare(bodyStart, 5, "0\r\n\r\n") == 0)
+        {
+            return bodyStart + 5 - offset;
+        }
+        return last == std::string::npos ? 0 : last + 7 - offset;
+    }
+    size_t contentLength = std::strtoul(headerValue(header, "Content-Length").c_str(), nullptr, 10);
+    return bodyStart + contentLength <= stream.size() ? bodyStart + contentLength - offset : 0;
+}
+
+std::string requestLabel(const std::string& request)
+{
+    size_t lineEnd = request.find("\r\n");
+    std::string line = request.substr(0, lineEnd);
+    size_t space = line.find(' ');
+    size_t target = line.find(' ', space + 1);
+    if(space == std::string::npos || target == std::string::npos)
+    {
+        return "INVALID";
+    }
+    std::string path = line.substr(space + 1, target - space - 1);
+    return line.substr(0, space) + " " + path.substr(0, path.find('?'));
+}
+
+// 把记录整理成连接和请求，按连接建立的先后排列
+std::vector<CapturedConnection> buildConnections(const std::vector<CaptureRecord>& records)
+{
+    std::unordered_map<uint64_t, size_t> index;
+    std::vector<CapturedConnection> connections;
+    for(const CaptureRecord& record: records)
+    {
+        auto it = index.find(record.connectionId);
+        if(it == index.end())
+        {
+            // 抓包开始前建立的连接没有kCaptureOpen，以第一条记录的时间为准
+            it = index.emplace(record.connectionId, connections.size()).first;
+            connections.emplace_back();
+            connections.back().id = record.connectionId;
+            connections.back().openNanos = record.timestampNanos;
+        }
+        CapturedConnection& conn = connections[it->second];
+        if(record.type == http::diagnostics::kCaptureData)
+        {
+            conn.stream += record.data;
+            conn.chunks.emplace_back(conn.stream.size(), record.timestampNanos);
+        }
+        else if(record.type == http::diagnostics::kCaptureResponse && record.data.size() == sizeof(int32_t))
+        {
+            int32_t status;
+            std::memcpy(&status, record.data.data(), sizeof status);
+            conn.responses.emplace_back(record.timestampNanos, status);
+        }
+    }
+
+    for(CapturedConnection& conn: connections)
+    {
+        size_t offset = 0;
+        size_t chunk = 0;
+        while(size_t len = frameRequest(conn.stream, offset))
+        {
+            CapturedRequest request;
+            request.bytes = conn.stream.substr(offset, len);
+            request.label = requestLabel(request.bytes);
+            offset += len;
+            while(conn.chunks[chunk].first < offset)
+            {
+                ++chunk;
+            }
+            request.arrivalNanos = conn.chunks[chunk].second;
+            size_t n = conn.requests.size();
+            if(n < conn.responses.size())
+            {
+                request.originalStatus = conn.responses[n].second;
+                request.originalNanos = static_cast<int64_t>(conn.responses[n].first - request.arrivalNanos);
+            }
+            conn.requests.push_back(std::move(request));
+        }
+        if(offset < conn.stream.size())
+        {
+            std::fprintf(stderr, "connection %lu: %zu trailing bytes are not a complete request, skipped\n",
+                         static_cast<unsigned long>(conn.id), conn.stream.size() - offset);
+        }
+    }
+
+    connections.erase(std::remove_if(connections.begin(), connections.end(), [](const CapturedConnection& conn) {
+        return conn.requests.empty();
+    }), connections.end());
+    return connections;
+}
+
+std::atomic<size_t> g_finished{0};
+
+// 回放一个抓到的连接
+class ReplaySession
+{
+public:
+    ReplaySession(EventLoop* loop, const InetAddress& addr, const Options& opt, SSL_CTX* sslCtx,
+                  CapturedConnection* captured, uint64_t captureBase, uint64_t replayStart):
+        conn_(loop, addr, "replay-" + std::to_string(captured->id), sslCtx, opt.unixPath),
+        loop_(loop),
+        opt_(opt),
+        captured_(captured),
+        captureBase_(captureBase),
+        replayStart_(replayStart),
+        sent_(0),
+        received_(0),
+        finished_(false),
+        alive_(std::make_shared<bool>(true))
+    {
+        conn_.setReadyCallback([this](LoadConnection*) { onReady(); });
+        conn_.setResponseCallback(std::bind(&ReplaySession::onResponse, this,
+            std::placeholders::_2, std::placeholders::_3));
+        conn_.setCloseCallback([this](LoadConnection*, size_t) { finish(); });
+    }
+
+    void start()
+    {
+        if(opt_.mode == "paced")
+        {
+            loop_->runAfter(secondsUntil(captured_->openNanos), guarded([this] { conn_.connect(); }));
+        }
+        else
+        {
+            conn_.connect();
+        }
+    }
+
+    void stop() { conn_.disconnect(); }
+
+private:
+    // 抓包时刻对应的回放时刻距离现在的秒数
+    double secondsUntil(uint64_t captureNanos) const
+    {
+        double target = (captureNanos - captureBase_) / opt_.speed;
+        double elapsed = static_cast<double>(http::bench::monotonicNanos() - replayStart_);
+        return std::max(0.0, (target - elapsed) / 1e9);
+    }
+
+    // 超时后会话可能在定时器到期前销毁
+    template<typename F>
+    std::function<void()> guarded(F f) const
+    {
+        std::weak_ptr<bool> alive = alive_;
+        return [alive, f] {
+            if(!alive.expired())
+            {
+                f();
+            }
+        };
+    }
+
+    void onReady()
+    {
+        if(opt_.mode == "fast")
+        {
+            sendNext();
+            return;
+        }
+        // 按抓包时的节奏发出所有请求，上一个响应没回来时就是流水线，和原来的客户端行为一致
+        for(size_t i = 0; i < captured_->requests.size(); ++i)
+        {
+            loop_->runAfter(secondsUntil(captured_->requests[i].arrivalNanos), guarded([this] { sendNext(); }));
+        }
+    }
+
+    void sendNext()
+    {
+        if(!finished_ && conn_.ready() && sent_ < captured_->requests.size())
+        {
+            conn_.sendRaw(captured_->requests[sent_++].bytes);
+        }
+    }
+
+    void onResponse(const ResponseInfo& info, uint64_t latencyNanos)
+    {
+        if(received_ < captured_->requests.size())
+        {
+            CapturedRequest& request = captured_->requests[received_];
+            request.replayNanos = static_cast<int64_t>(latencyNanos);
+            request.replayStatus = info.status;
+        }
+        ++received_;
+        if(received_ >= captured_->requests.size())
+        {
+            conn_.disconnect();
+        }
+        else if(opt_.mode == "fast")
+        {
+            sendNext();
+        }
+    }
+
+    void finish()
+    {
+        if(!finished_)
+        {
+            finished_ = true;
+            ++g_finished;
+        }
+    }
+
+    LoadConnection conn_;
+    EventLoop* loop_;
+    const Options& opt_;
+    CapturedConnection* captured_;
+    uint64_t captureBase_;   // 第一个连接建立的抓包时刻
+    uint64_t replayStart_;   // 回放开始的单调时钟时刻
+    size_t sent_;
+    size_t received_;
+    bool finished_;          // 连接已经断开，不再发送
+    std::shared_ptr<bool> alive_;  // 随本对象销毁
+};
+
+struct Worker
+{
+    EventLoopThread thread;
+    EventLoop* loop = nullptr;
+    std::vector<std::unique_ptr<ReplaySession>> sessions;
+};
+
+// 请求行来自抓包，可能含有JSON的特殊字符
+std::string jsonEscape(const std::string& s)
+{
+    std::string escaped;
+    for(char c: s)
+    {
+        if(c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += static_cast<unsigned char>(c) < 0x20 ? '?' : c;
+    }
+    return escaped;
+}
+
+double toMicros(int64_t nanos)
+{
+    return nanos / 1000.0;
+}
+
+// 同一路由的汇总
+struct RouteSummary
+{
+    http::metrics::Histogram original;
+    http::metrics::Histogram replay;
+    uint64_t requests = 0;
+    uint64_t compared = 0;       // 两边都有响应的请求数
+    int64_t diffSum = 0;         // 回放减抓包的延迟之和
+    uint64_t statusChanged = 0;  // 状态码不同的请求数
+};
+
+void printHistograms(const http::metrics::Histogram& original, const http::metrics::Histogram& replay)
+{
+    http::metrics::HistogramSnapshot a, b;
+    a.merge(original);
+    b.merge(replay);
+    std::printf("\"originalUs\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}, "
+                "\"replayUs\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}",
+                toMicros(a.quantile(0.5)), toMicros(a.quantile(0.99)), toMicros(a.quantile(1.0)),
+                toMicros(b.quantile(0.5)), toMicros(b.quantile(0.99)), toMicros(b.quantile(1.0)));
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    ::signal(SIGPIPE, SIG_IGN);
+    Options opt = parseOptions(argc, argv);
+
+    std::vector<CaptureRecord> records;
+    std::string error;
+    if(!TrafficCapture::readFile(opt.file, &records, &error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    std::vector<CapturedConnection> connections = buildConnections(records);
+    records.clear();
+    if(connections.empty())
+    {
+        std::fprintf(stderr, "no complete request in %s\n", opt.file.c_str());
+        return 1;
+    }
+
+    // 最后一个请求在回放中的发送时刻，用于确定等待上限
+    uint64_t captureBase = connections.front().openNanos;
+    uint64_t lastArrival = 0;
+    for(const CapturedConnection& conn: connections)
+    {
+        lastArrival = std::max(lastArrival, conn.requests.back().arrivalNanos);
+    }
+    double expectedSeconds = opt.mode == "paced" ? (lastArrival - captureBase) / 1e9 / opt.speed : 0.0;
+
+    SSL_CTX* sslCtx = nullptr;
+    if(opt.tls)
+    {
+        OPENSSL_init_ssl(0, nullptr);
+        sslCtx = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_verify(sslCtx, SSL_VERIFY_NONE, nullptr);  // 本地自签名证书
+    }
+
+    InetAddress addr(static_cast<uint16_t>(opt.port), opt.host);
+    std::vector<std::unique_ptr<Worker>> workers;
+    for(int i = 0; i < opt.threads; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->loop = workers.back()->thread.startLoop();
+    }
+
+    // 回放会话在所属loop线程里创建和启动
+    uint64_t replayStart = http::bench::monotonicNanos();
+    for(size_t i = 0; i < connections.size(); ++i)
+    {
+        Worker* worker = workers[i % opt.threads].get();
+        CapturedConnection* captured = &connections[i];
+        worker->loop->runInLoop([worker, addr, &opt, sslCtx, captured, captureBase, replayStart] {
+            worker->sessions.push_back(std::make_unique<ReplaySession>(worker->loop, addr, opt, sslCtx,
+                                                                      captured, captureBase, replayStart));
+            worker->sessions.back()->start();
+        });
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration<double>(expectedSeconds + opt.timeout);
+    while(g_finished < connections.size() && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    double elapsed = (http::bench::monotonicNanos() - replayStart) / 1e9;
+
+    // 超时的会话断开连接，等连接回调都执行完再在各自的loop线程里销毁，之后才能读取结果
+    for(auto& worker: workers)
+    {
+        Worker* w = worker.get();
+        w->loop->runInLoop([w] {
+            for(auto& session: w->sessions)
+            {
+                session->stop();
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    for(auto& worker: workers)
+    {
+        std::promise<void> done;
+        Worker* w = worker.get();
+        w->loop->runInLoop([w, &done] {
+            w->sessions.clear();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+
+    std::map<std::string, RouteSummary> routes;
+    RouteSummary total;
+    for(const CapturedConnection& conn: connections)
+    {
+        for(const CapturedRequest& request: conn.requests)
+        {
+            RouteSummary& route = routes[request.label];
+            for(RouteSummary* summary: {&route, &total})
+            {
+                ++summary->requests;
+                if(request.originalNanos >= 0)
+                {
+                    summary->original.record(static_cast<uint64_t>(request.originalNanos));
+                }
+                if(request.replayNanos >= 0)
+                {
+                    summary->replay.record(static_cast<uint64_t>(request.replayNanos));
+                }
+                if(request.originalNanos >= 0 && request.replayNanos >= 0)
+                {
+                    ++summary->compared;
+                    summary->diffSum += request.replayNanos - request.originalNanos;
+                }
+                if(request.replayStatus != 0 && request.originalStatus != 0 && request.replayStatus != request.originalStatus)
+                {
+                    ++summary->statusChanged;
+                }
+            }
+        }
+    }
+
+    std::printf("{\n  \"benchmark\": \"replay\",\n");
+    std::string target = opt.unixPath.empty() ? opt.host + ":" + std::to_string(opt.port) : "unix:" + opt.unixPath;
+    std::printf("  \"target\": \"%s\",\n  \"file\": \"%s\",\n  \"mode\": \"%s\",\n  \"speed\": %.3f,\n",
+                target.c_str(), opt.file.c_str(), opt.mode.c_str(), opt.speed);
+    std::printf("  \"seconds\": %.3f,\n  \"connections\": %zu,\n  \"requests\": %lu,\n  \"compared\": %lu,\n"
+                "  \"statusChanged\": %lu,\n  \"completedConnections\": %zu,\n",
+                elapsed, connections.size(), static_cast<unsigned long>(total.requests),
+                static_cast<unsigned long>(total.compared), static_cast<unsigned long>(total.statusChanged),
+                g_finished.load());
+    std::printf("  \"latency\": {");
+    printHistograms(total.original, total.replay);
+    std::printf(", \"meanDiffUs\": %.1f},\n", total.compared ? toMicros(total.diffSum / static_cast<int64_t>(total.compared)) : 0.0);
+
+    std::printf("  \"routes\": {");
+    bool first = true;
+    for(const auto& item: routes)
+    {
+        const RouteSummary& route = item.second;
+        std::printf("%s\n    \"%s\": {\"requests\": %lu, \"statusChanged\": %lu, ", first ? "" : ",", jsonEscape(item.first).c_str(),
+                    static_cast<unsigned long>(route.requests), static_cast<unsigned long>(route.statusChanged));
+        printHistograms(route.original, route.replay);
+        std::printf(", \"meanDiffUs\": %.1f}", route.compared ? toMicros(route.diffSum / static_cast<int64_t>(route.compared)) : 0.0);
+        first = false;
+    }
+    std::printf("\n  }");
+
+    if(opt.details)
+    {
+        // 没有响应的一侧延迟为null
+        std::printf(",\n  \"perRequest\": [");
+        first = true;
+        for(const CapturedConnection& conn: connections)
+        {
+            for(size_t i = 0; i < conn.requests.size(); ++i)
+            {
+                const CapturedRequest& request = conn.requests[i];
+                std::string original = request.originalNanos >= 0 ? std::to_string(toMicros(request.originalNanos)) : "null";
+                std::string replay = request.replayNanos >= 0 ? std::to_string(toMicros(request.replayNanos)) : "null";
+                std::string diff = request.originalNanos >= 0 && request.replayNanos >= 0 ?
+                                   std::to_string(toMicros(request.replayNanos - request.originalNanos)) : "null";
+                std::printf("%s\n    {\"connection\": %lu, \"index\": %zu, \"request\": \"%s\", \"status\": [%d, %d], "
+                            "\"originalUs\": %s, \"replayUs\": %s, \"diffUs\": %s}",
+                            first ? "" : ",", static_cast<unsigned long>(conn.id), i, jsonEscape(request.label).c_str(),
+                            request.originalStatus, request.replayStatus, original.c_str(), replay.c_str(), diff.c_str());
+                first = false;
+            }
+        }
+        std::printf("\n  ]");
+    }
+    std::printf("\n}\n");
+
+    workers.clear();  // 退出各个loop线程
+    if(sslCtx)
+    {
+        SSL_CTX_free(sslCtx);
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef CPUPROFILER_H
+#define CPUPROFILER_H
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+namespace diagnostics
+{
+
+struct ProfileOptions
+{
+    int seconds = 10;  // 采样时长
+    int hz = 99;       // 每秒采样次数(按CPU时间)，避开100避免和定时任务同步
+    pid_t tid = 0;     // 只采样这个线程，0表示整个进程
+};
+
+/*
+    进程内的采样CPU剖析器
+
+    采样期间按CPU时间定时发送SIGPROF：整个进程用setitimer(ITIMER_PROF)，指定线程时用该线程CPU时钟上的
+    POSIX定时器，信号只发给它。信号处理函数把调用栈写入预先分配好的样本数组，不分配内存；
+    时间到后在后台线程上停止定时器、符号化并合并成flamegraph.pl使用的折叠格式("线程;外层;...;内层 次数")。
+    空闲时没有定时器也就没有信号，对被剖析的程序没有任何开销。同一时刻只能有一次剖析
+*/
+class CpuProfiler: noncopyable
+{
+public:
+    static const int kMaxSeconds = 60;
+    static const int kMaxHz = 1000;
+    static const int kMaxFrames = 64;
+    static const size_t kMaxSamples = 64 * 1024;  // 超出的样本丢弃并计数
+
+    enum State
+    {
+        kIdle,     // 还没有剖析过
+        kRunning,
+        kDone,
+    };
+
+    static CpuProfiler& instance();
+
+    // 开始一次剖析，立即返回。已经有剖析在进行或者参数不合法时返回false并给出原因
+    bool start(const ProfileOptions& options, std::string* error);
+    // 当前状态，kDone时folded为上一次剖析的结果
+    State result(std::string* folded) const;
+    bool running() const;
+
+    // 进程内所有线程的(tid, 线程名)，用于选择要剖析的线程
+    static std::vector<std::pair<pid_t, std::string>> threads();
+
+private:
+    struct Sample;
+    struct Session;
+
+    CpuProfiler();
+
+    static void onProfSignal(int);
+    // 信号处理函数写入的会话，以及正在执行的信号处理函数个数，停止时等它们归零后才能读取样本
+    static std::atomic<Session*> s_active;
+    static std::atomic<int> s_inHandler;
+
+    void run(std::unique_ptr<Session> session);
+    std::string fold(const Session& session) const;
+
+    mutable std::mutex mutex_;
+    State state_;
+    std::string folded_;
+    std::thread worker_;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef LOOPWATCHDOG_H
+#define LOOPWATCHDOG_H
+
+#include <signal.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "mymuduo/EventLoop.h"
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+namespace diagnostics
+{
+
+struct WatchdogConfig
+{
+    double heartbeatSeconds = 0.05;  // 每个事件循环的心跳定时器间隔
+    double stallThresholdMs = 500;   // 心跳停止超过该值视为卡顿
+    int stackSignal = SIGURG;        // 让卡住的线程抓取自己调用栈的信号，SIGURG默认被忽略，误发也不会终止进程
+};
+
+/*
+    事件循环卡顿检测
+
+    每个被监视的事件循环在自己的线程上按固定间隔更新心跳，实际间隔比预期多出的部分即事件循环延迟，
+    记录到名为http_loop_lag_seconds的指标直方图中。
+    检测线程发现某个循环的心跳超过阈值没有更新时，向该线程发送stackSignal，信号处理函数在卡住的线程上
+    记录调用栈和正在处理的请求(RequestScope)，检测线程再把它们连同卡顿时长写进日志。
+    同一次卡顿只报告一次，循环恢复后再记录一条恢复日志
+*/
+class LoopWatchdog: noncopyable
+{
+public:
+    explicit LoopWatchdog(const WatchdogConfig& config);
+    ~LoopWatchdog();
+
+    // 在loop所在的线程上调用，开始监视该循环，同一个线程重复调用时忽略
+    void watch(EventLoop* loop);
+
+    // 发现的卡顿次数
+    uint64_t stalls() const { return stalls_.load(std::memory_order_relaxed); }
+
+    /*
+        标记当前线程正在处理的请求，卡顿报告中输出这些信息。
+        只保存指针，不拷贝，所以参数在作用域内必须有效；routeId在路由命中后才会被填上。
+        当前线程没有被监视时什么也不做
+    */
+    class RequestScope: noncopyable
+    {
+    public:
+        RequestScope(const char* method, std::string_view path, const std::string& connection, const int* routeId);
+        ~RequestScope();
+    };
+
+private:
+    struct Slot;
+
+    // 当前线程被监视的循环，信号处理函数通过它找到要填写的位置
+    static thread_local Slot* t_slot;
+
+    static void onStackSignal(int);
+
+    void run();
+    void check(Slot* slot, uint64_t now);
+    void report(Slot* slot, uint64_t stalledNanos);
+
+    WatchdogConfig config_;
+    int lagTimerId_;
+    std::atomic<uint64_t> stalls_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool running_;
+    std::vector<Slot*> slots_;  // 不释放，线程退出后仍可能有定时器引用
+    std::thread thread_;
+};
+
+}
+
+}
+
+#endif
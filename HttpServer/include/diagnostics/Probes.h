@@ -0,0 +1,45 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+    USDT静态探针，provider为httpserver。编译时开启HTTP_ENABLE_USDT(需要systemtap-sdt-dev提供的sys/sdt.h)后，
+    每个探针是一条nop加ELF note，没有附加跟踪工具时不产生任何开销，附加后由内核改写为断点；
+    未开启时展开为空，参数不会求值。参数只用整数和已有的C字符串指针，探针处不做任何拼接
+
+    探针                       参数
+    request__start             method, path                     开始处理一个完整的请求
+    request__end               status                           响应已经写入连接
+    parse__done                method, path, parse_ns           请求解析完成(未开启指标和跟踪时parse_ns为0)
+    route__matched             route_id, pattern                路由命中，pattern为注册时的路径或模式
+    handler__start             route_id
+    handler__end               route_id
+    db__borrow                 conn                             从连接池取到数据库连接，conn为DbConnection的地址
+    db__return                 conn                             数据库连接归还连接池，与db__borrow配对可得到占用时间
+    ssl__handshake__start      conn                             conn为SslConnection的地址
+    ssl__handshake__end        conn, ok                         ok为1表示握手成功，0表示失败
+    ai__move__start            user_id
+    ai__move__end              user_id, x, y
+
+    例：bpftrace -e 'usdt:./simple_server:httpserver:handler__start { @s[tid] = nsecs; }
+                     usdt:./simple_server:httpserver:handler__end /@s[tid]/ { @us[arg0] = hist((nsecs - @s[tid]) / 1000); delete(@s[tid]); }'
+*/
+
+#ifdef HTTP_ENABLE_USDT
+
+#include <sys/sdt.h>
+
+#define HTTP_PROBE(name) DTRACE_PROBE(httpserver, name)
+#define HTTP_PROBE1(name, a) DTRACE_PROBE1(httpserver, name, a)
+#define HTTP_PROBE2(name, a, b) DTRACE_PROBE2(httpserver, name, a, b)
+#define HTTP_PROBE3(name, a, b, c) DTRACE_PROBE3(httpserver, name, a, b, c)
+
+#else
+
+#define HTTP_PROBE(name) do {} while(0)
+#define HTTP_PROBE1(name, a) do {} while(0)
+#define HTTP_PROBE2(name, a, b) do {} while(0)
+#define HTTP_PROBE3(name, a, b, c) do {} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef REQUESTTRACE_H
+#define REQUESTTRACE_H
+
+#include <cstdint>
+#include <string>
+
+#include "../metrics/Metrics.h"
+
+namespace http
+{
+
+namespace diagnostics
+{
+
+struct TraceConfig
+{
+    bool enabled = false;
+    // 非空时只跟踪带有该请求头的请求(如"X-Trace")，为空时跟踪所有请求
+    std::string triggerHeader;
+    // 是否输出跟踪日志，关闭时只返回Server-Timing响应头
+    bool logRecord = true;
+};
+
+/*
+    单个请求的阶段耗时，由HttpRequest携带一个指针贯穿onMessage -> handleRequest -> Router::route -> 处理器，
+    未开启跟踪时指针为空，各个埋点只多一次判空
+*/
+class RequestTrace
+{
+public:
+    enum Phase
+    {
+        kParse,       // 解析请求报文
+        kQueue,       // 从poll返回到开始处理
+        kMiddleware,  // 前置和后置中间件
+        kRoute,       // 路由查找
+        kHandler,     // 路由处理器
+        kSerialize,   // 序列化响应
+        kWrite,       // 写入连接
+        kNumPhases
+    };
+
+    RequestTrace() { reset(); }
+
+    void reset();
+
+    // 直接记录某阶段的耗时(解析和排队在跟踪开始之前就已经发生)
+    void add(Phase phase, uint64_t nanos) { durations_[phase] += nanos; }
+    // 以当前时间为起点开始计时
+    void begin() { last_ = metrics::nowNanos(); }
+    // 把上一个时间点到现在的耗时计入phase，并以现在为新的起点
+    void mark(Phase phase)
+    {
+        uint64_t now = metrics::nowNanos();
+        durations_[phase] += now - last_;
+        last_ = now;
+    }
+
+    uint64_t duration(Phase phase) const { return durations_[phase]; }
+
+    // Server-Timing响应头的值，只包含生成响应头之前已经完成的阶段
+    std::string serverTiming() const;
+    // 一条完整的跟踪记录，写日志用
+    std::string record(const std::string& method, const std::string& path, int statusCode) const;
+
+private:
+    uint64_t durations_[kNumPhases];
+    uint64_t last_;
+};
+
+}
+
+}
+
+#endif
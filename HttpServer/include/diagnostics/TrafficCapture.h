@@ -0,0 +1,122 @@
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+namespace diagnostics
+{
+
+struct CaptureConfig
+{
+    std::string path;                    // 抓包文件
+    size_t ringBytes = 4 * 1024 * 1024;  // 每个I/O线程的环形缓冲区大小，向上取2的幂，写满时丢弃新的记录
+};
+
+/*
+    抓包文件格式(小端)：
+        文件头 CaptureFileHeader
+        若干条记录，每条为 CaptureRecordHeader + length字节的数据
+    各个线程的记录按块交错写入，同一连接的记录保持先后顺序，读取时按时间戳排序
+*/
+struct CaptureFileHeader
+{
+    char magic[8];            // "HTCAP1\0\0"
+    uint64_t startEpochNanos; // 开始抓包时的系统时间，仅供参考
+};
+
+enum CaptureRecordType : uint8_t
+{
+    kCaptureOpen = 1,      // 连接建立，数据为对端地址
+    kCaptureData = 2,      // 收到的请求字节(TLS连接为解密后的明文)
+    kCaptureResponse = 3,  // 写出一个响应，数据为4字节状态码
+    kCaptureClose = 4,     // 连接断开
+};
+
+struct CaptureRecordHeader
+{
+    uint64_t timestampNanos;  // 相对开始抓包的单调时钟纳秒数
+    uint64_t connectionId;    // 抓包期间唯一
+    uint32_t length;          // 之后的数据字节数
+    uint8_t type;             // CaptureRecordType
+    uint8_t reserved[3];
+};
+
+// 读取抓包文件时的一条记录
+struct CaptureRecord
+{
+    uint64_t timestampNanos;
+    uint64_t connectionId;
+    CaptureRecordType type;
+    std::string data;
+};
+
+/*
+    流量抓包：I/O线程把收到的原始请求字节连同时间戳和连接编号写入自己的单生产者单消费者环形缓冲区，
+    不加锁、不做系统调用，缓冲区满时丢弃并计数，不会阻塞I/O线程；后台线程把各个缓冲区里的记录写入文件。
+    配合benchmark/TrafficReplay.cc回放
+*/
+class TrafficCapture: noncopyable
+{
+public:
+    // 单条记录的最大数据长度，更长的数据拆成多条
+    static constexpr size_t kMaxChunk = 64 * 1024;
+
+    explicit TrafficCapture(const CaptureConfig& config);
+    // 写完缓冲区中剩余的记录后关闭文件
+    ~TrafficCapture();
+
+    // 以下在I/O线程上调用
+    // 新连接，返回连接编号
+    uint64_t openConnection(const std::string& peer);
+    void data(uint64_t connectionId, const char* data, size_t len);
+    void response(uint64_t connectionId, int statusCode);
+    void closeConnection(uint64_t connectionId);
+
+    uint64_t droppedRecords() const;
+    uint64_t writtenBytes() const { return writtenBytes_.load(std::memory_order_relaxed); }
+
+    // 读取整个抓包文件，按时间戳排序(同一时间戳保持文件中的顺序)，格式错误时返回false
+    static bool readFile(const std::string& path, std::vector<CaptureRecord>* records, std::string* error);
+
+private:
+    struct Ring;
+
+    // 当前线程的环形缓冲区以及它所属的抓包实例
+    static thread_local Ring* t_ring;
+    static thread_local uint64_t t_ringOwner;
+
+    Ring* localRing();
+    void append(uint64_t connectionId, CaptureRecordType type, const char* data, size_t len);
+    void run();
+    // 把所有环形缓冲区里的记录写入文件，返回写入的字节数
+    size_t drain();
+
+    const uint64_t instanceId_;  // 区分线程局部缓存属于哪个抓包实例
+    size_t ringBytes_;
+    uint64_t start_;
+    FILE* file_;
+    std::atomic<uint64_t> nextConnectionId_;
+    std::atomic<uint64_t> writtenBytes_;
+    mutable std::mutex ringsMutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef ADMISSIONCONTROLLER_H
+#define ADMISSIONCONTROLLER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "mymuduo/EventLoop.h"
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+// 过载保护配置, 各项为0表示不启用
+struct OverloadConfig
+{
+    int maxConnections = 0;        // 全局最大连接数
+    int maxConnectionsPerIp = 0;   // 单个IP的最大连接数
+    double maxLoopLagMs = 0;       // 事件循环延迟超过该值开始丢弃请求
+    double maxQueueDelayMs = 0;    // 请求从poll返回到开始处理的延迟超过该值开始丢弃请求
+    int retryAfterSeconds = 1;     // 503响应中的Retry-After
+};
+
+/*
+    准入控制 + 自适应降载
+
+    1. 连接准入：全局和单IP的连接数上限，超出的连接直接回503并关闭
+    2. 请求降载：每个I/O线程测量自己的事件循环延迟和请求排队延迟(指数滑动平均)，
+       超过阈值后按比例丢弃新请求，延迟达到阈值的两倍时全部丢弃。
+       被丢弃的请求在解析和路由之前就回一个预先序列化好的503
+*/
+class AdmissionController: noncopyable
+{
+public:
+    explicit AdmissionController(const OverloadConfig& config);
+
+    // 新连接是否允许接入，允许时计数加一。ip为空(来自反向代理的连接)时只检查全局上限
+    bool admitConnection(const std::string& ip);
+    // 被允许接入的连接断开时调用
+    void releaseConnection(const std::string& ip);
+
+    // 在I/O线程中调用，定时测量本线程事件循环的延迟，每个线程只启动一次
+    void startLoopLagProbe(EventLoop* loop);
+    // 记录一次请求的排队延迟(毫秒)，只更新本线程的统计
+    void recordQueueDelay(double ms);
+    // 本线程当前是否应该丢弃新请求
+    bool shouldShed();
+
+    const std::string& overloadResponse() const { return overloadResponse_; }
+
+    int activeConnections() const { return activeConnections_.load(std::memory_order_relaxed); }
+    uint64_t rejectedConnections() const { return rejectedConnections_.load(std::memory_order_relaxed); }
+    uint64_t shedRequests() const { return shedRequests_.load(std::memory_order_relaxed); }
+    // 本线程的事件循环延迟(毫秒)
+    static double loopLagMs();
+
+private:
+    static const int kShards = 16;
+
+    struct IpShard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, int> counts;
+    };
+
+    IpShard& shardFor(const std::string& ip);
+
+    OverloadConfig config_;
+    std::string overloadResponse_;  // 预先序列化好的503响应
+    std::atomic<int> activeConnections_;
+    std::atomic<uint64_t> rejectedConnections_;
+    std::atomic<uint64_t> shedRequests_;
+    IpShard ipShards_[kShards];
+};
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <vector>
+
+#include "mymuduo/Buffer.h"
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+/*
+    Buffer的空闲链表，按容量分为几个大小等级，只在一个I/O线程内使用，不加锁
+
+    归还时按实际容量放入不超过它的最大等级；超过最大等级的Buffer先收缩到最大等级，
+    避免偶尔一个很大的响应让池子长期占着大块内存
+*/
+class BufferPool: noncopyable
+{
+public:
+    static const size_t kNumClasses = 4;
+    static const size_t kClassSizes[kNumClasses];  // 2KB, 8KB, 32KB, 128KB
+
+    explicit BufferPool(size_t maxPerClass = 64);
+    ~BufferPool();
+
+    // 取一个可写容量至少为sizeHint的空Buffer(sizeHint为0时取最小等级)
+    Buffer* acquire(size_t sizeHint = 0);
+    // 归还，buf中剩余的数据会被丢弃
+    void release(Buffer* buf);
+
+    size_t freeCount() const;
+
+private:
+    // 能容纳size字节的最小等级，超过最大等级时返回kNumClasses
+    static size_t classFor(size_t size);
+
+    size_t maxPerClass_;
+    std::vector<Buffer*> free_[kNumClasses];
+};
+
+// 从池中借用一个Buffer，离开作用域时归还
+class PooledBuffer: noncopyable
+{
+public:
+    PooledBuffer(BufferPool& pool, size_t sizeHint = 0):
+        pool_(pool),
+        buf_(pool.acquire(sizeHint))
+    {}
+    ~PooledBuffer() { pool_.release(buf_); }
+
+    Buffer* get() const { return buf_; }
+    Buffer* operator->() const { return buf_; }
+
+private:
+    BufferPool& pool_;
+    Buffer* buf_;
+};
+
+}
+
+#endif
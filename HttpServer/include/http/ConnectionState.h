@@ -0,0 +1,71 @@
+#ifndef CONNECTIONSTATE_H
+#define CONNECTIONSTATE_H
+
+#include <memory>
+#include <vector>
+
+#include <boost/any.hpp>
+
+#include "mymuduo/TcpConnection.h"
+#include "mymuduo/noncopyable.h"
+
+#include "HttpContext.h"
+#include "../ssl/SslConnection.h"
+
+namespace http
+{
+
+// 一个连接上HttpServer需要的全部状态
+struct ConnectionState
+{
+    HttpContext context;
+    std::unique_ptr<ssl::SslConnection> ssl;  // 未开启SSL时为空
+    uint64_t captureId = 0;     // 抓包中的连接编号
+    size_t capturedBytes = 0;   // 输入缓冲区开头已经抓过的字节数(上次处理后留下的流水线请求)
+};
+
+/*
+    ConnectionState的空闲链表，每个I/O线程一个，不加锁
+    连接断开时归还，下一个连接直接复用，短连接频繁建立断开时不必每次都分配
+*/
+class ConnectionStatePool: noncopyable
+{
+public:
+    explicit ConnectionStatePool(size_t maxFree = 1024);
+    ~ConnectionStatePool();
+
+    ConnectionState* acquire();
+    // 清空连接相关的状态后放回空闲链表，超过maxFree时直接释放
+    void release(ConnectionState* state);
+
+    size_t freeCount() const { return free_.size(); }
+
+private:
+    size_t maxFree_;
+    std::vector<ConnectionState*> free_;
+};
+
+/*
+    TcpConnection的context中只保存ConnectionState指针，设置时做一次类型检查，
+    之后每次取用都不再经过any_cast的类型比较
+*/
+inline void attachState(const TcpConnectionPtr& conn, ConnectionState* state)
+{
+    conn->setContext(state);
+}
+
+inline void detachState(const TcpConnectionPtr& conn)
+{
+    conn->setContext(boost::any());
+}
+
+// 没有挂载状态的连接(如被准入控制拒绝的)返回nullptr
+inline ConnectionState* stateOf(const TcpConnectionPtr& conn)
+{
+    boost::any* context = conn->getMutableContext();
+    return context->empty() ? nullptr : *boost::unsafe_any_cast<ConnectionState*>(context);
+}
+
+}
+
+#endif
@@ -2,9 +2,13 @@
 #define HTTPCONTEXT_H
 
 #include <iostream>
+#include <optional>
 #include "mymuduo/TcpServer.h"
 
 #include "HttpRequest.h"
+#include "TimingWheel.h"
+#include "../memory/RequestArena.h"
+#include "../memory/MemoryAccounting.h"
 
 /* HTTP请求报文格式如下：
     ----------------------------------------------------------------------------
@@ -27,7 +31,7 @@
 namespace http
 {
 
-class HttpContext
+class HttpContext: noncopyable
 {
 public:
     enum HttpRequestParseState
@@ -38,22 +42,72 @@ public:
         kGotAll,   // 解析完成
     };
 
+    // 连接所处的超时阶段，对应TimeoutConfig中的三种超时
+    enum TimeoutPhase
+    {
+        kKeepAliveIdle,  // 两个请求之间的空闲
+        kHeaderRead,     // 读取请求行和请求头
+        kBodyRead,       // 读取请求体
+    };
+
     HttpContext();
 
     bool parseRequest(Buffer* buf, TimeStamp receiveTime);
     bool gotAll() const { return state_ == kGotAll; }
+    HttpRequestParseState state() const { return state_; }
 
+    // 请求处理完后调用，销毁请求并一次性归还它的内存池
     void reset();
+    // 连接断开后放回池中之前调用，清除整个连接生命周期内的状态，字符串保留已分配的容量
+    void recycle();
 
-    const HttpRequest& request() const { return request_; }
-    HttpRequest& request() { return request_; }
+    const HttpRequest& request() const { return *request_; }
+    HttpRequest& request() { return *request_; }
+
+    // 超时阶段在整个连接生命周期内有效，reset()不会清除
+    TimeoutPhase timeoutPhase() const { return timeoutPhase_; }
+    uint64_t timeoutGeneration() const { return timeoutGeneration_; }
+    // 进入新的超时阶段，返回新的代数，时间轮中旧的条目随之失效
+    uint64_t enterTimeoutPhase(TimeoutPhase phase) { timeoutPhase_ = phase; return ++timeoutGeneration_; }
+    // 连接在本线程时间轮中的唯一条目，连接断开时从时间轮中删除
+    TimingWheel::Slot* timerSlot() { return &timerSlot_; }
+
+    // 对端地址和准入状态，同样在整个连接生命周期内有效
+    void setPeerIp(const std::string& ip)
+    {
+        peerIp_ = ip;
+        memoryTracker_.setBytes(sizeof(HttpContext) + memory::heapBytes(peerIp_));
+    }
+    const std::string& peerIp() const { return peerIp_; }
+    void setAdmitted(bool admitted) { admitted_ = admitted; }
+    bool admitted() const { return admitted_; }
+
+    // 当前请求累计的解析耗时(一个请求可能分多次到达)，reset()时清零
+    void addParseNanos(uint64_t nanos) { parseNanos_ += nanos; }
+    uint64_t parseNanos() const { return parseNanos_; }
+
+    // 输出积压时暂停读取，在整个连接生命周期内有效
+    void setReadPaused(bool paused) { readPaused_ = paused; }
+    bool readPaused() const { return readPaused_; }
+    // 请求被合并到其他线程上正在执行的相同请求，等待共享的响应
+    void setWaitingFlight(bool waiting) { waitingFlight_ = waiting; }
+    bool waitingFlight() const { return waitingFlight_; }
 
 private:
     bool processRequestLine(const char* begin, const char* end);
 
     HttpRequestParseState state_;
-    HttpRequest request_;
-
+    memory::RequestArena arena_;  // 在request_之后析构
+    std::optional<HttpRequest> request_;  // 每个请求在arena_上重新构造
+    TimeoutPhase timeoutPhase_;
+    uint64_t timeoutGeneration_;
+    TimingWheel::Slot timerSlot_;
+    std::string peerIp_;
+    bool admitted_;
+    uint64_t parseNanos_;
+    bool readPaused_;
+    bool waitingFlight_;
+    memory::MemoryTracker memoryTracker_;  // 计入http_context，连接池中空闲的也算
 };
 
 }
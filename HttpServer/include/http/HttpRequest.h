@@ -2,14 +2,20 @@
 #define HTTPREQUEST_H
 
 #include <map>
+#include <memory_resource>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
 #include "mymuduo/TimeStamp.h"
 
 namespace http
 {
 
+namespace diagnostics
+{
+class RequestTrace;
+}
+
 class HttpRequest
 {
 public:
@@ -19,50 +25,84 @@ public:
     };
 
     HttpRequest();
+    // 头部、参数和请求体都从resource分配，通常是所在连接的请求内存池；拷贝出来的请求使用全局分配器
+    explicit HttpRequest(std::pmr::memory_resource* resource);
+
+    std::pmr::memory_resource* resource() const { return headers_.get_allocator().resource(); }
 
     void setReceiveTime(TimeStamp t);
     TimeStamp receiveTime() const { return receiveTime_; }
 
     bool setMethod(const char* start, const char* end);
     Method method() const { return method_; }
+    static const char* methodString(Method method);
 
     void setPath(const char* start, const char* end);
-    std::string path() const { return path_; }
+    const std::string& path() const { return path_; }
 
-    void setPathParameters(const std::string &key, const std::string &value);
-    std::string getPathParameters(const std::string &key) const;
+    /*
+        以下访问函数都返回引用，不存在时返回空串的引用，引用在请求被reset()之前有效。
+        请求只在HttpContext中解析一次，之后一路以引用传递到处理器
+    */
+    void setPathParameters(std::string_view key, std::string_view value);
+    const std::pmr::string& getPathParameters(std::string_view key) const;
 
     void setQueryParameters(const char* start, const char* end);
-    std::string getQueryParameters(const std::string &key) const;
+    const std::pmr::string& getQueryParameters(std::string_view key) const;
+    // 原始查询串(不含‘?’)
+    const std::pmr::string& query() const { return query_; }
 
-    void setVersion(std::string v){ version_ = v; }
-    std::string getVersion() const { return version_; }
+    void setVersion(std::string v){ version_ = std::move(v); }
+    const std::string& getVersion() const { return version_; }
 
     void addHeader(const char* start, const char* colon, const char* end);
-    std::string getHeader(const std::string& field) const;
+    // 透明比较，用字符串字面量查找时不会构造临时的字符串
+    const std::pmr::string& getHeader(std::string_view field) const;
 
-    const std::map<std::string, std::string>& headers() const { return headers_; }
+    using HeaderMap = std::pmr::map<std::pmr::string, std::pmr::string, std::less<>>;
+    // 参数一般只有几个，有序表足够快，并且可以用string_view查找
+    using ParameterMap = std::pmr::map<std::pmr::string, std::pmr::string, std::less<>>;
+    const HeaderMap& headers() const { return headers_; }
 
-    void setBody(const std::string& body) { content_ = body; }
+    void setBody(std::string_view body) { content_.assign(body.data(), body.size()); }
     void setBody(const char* start, const char* end);
 
-    std::string getBody() const { return content_; }
+    const std::pmr::string& getBody() const { return content_; }
 
     void setContentLength(uint64_t length) { contentLength_ = length; }
     uint64_t contentLength() const { return contentLength_; }
 
-    void swap(HttpRequest& that);
+    /*
+        对端IP和客户端IP由请求自己保存：请求的拷贝(后台刷新缓存、等待合并的请求)可能比连接活得久。
+        IP一般在短字符串的内部缓冲区里，不分配内存
+    */
+    void setPeerIp(std::string_view ip) { peerIp_.assign(ip.data(), ip.size()); }
+    const std::pmr::string& peerIp() const { return peerIp_; }
+    /*
+        客户端IP，限流等按客户端区分的功能使用。TCP连接上与peerIp相同；
+        Unix域socket上的连接来自反向代理，开启setTrustProxyHeaders时取代理转发的地址，否则为空
+    */
+    void setClientIp(std::string_view ip) { clientIp_.assign(ip.data(), ip.size()); }
+    const std::pmr::string& clientIp() const { return clientIp_; }
+
+    // 阶段跟踪，未开启跟踪时为空
+    void setTrace(diagnostics::RequestTrace* trace) { trace_ = trace; }
+    diagnostics::RequestTrace* trace() const { return trace_; }
 
 private:
     Method method_;   // 请求方法
     std::string version_;  // http版本
-    std::string path_;   // 请求路径
-    std::unordered_map<std::string, std::string> pathParameters_;  // 路径参数
-    std::unordered_map<std::string, std::string> queryParameters_;  // 查询参数
+    std::string path_;   // 请求路径，路由、缓存等各种表都以std::string为键，不放在内存池中
+    ParameterMap pathParameters_;  // 路径参数
+    ParameterMap queryParameters_;  // 查询参数
+    std::pmr::string query_;  // 原始查询串
     TimeStamp receiveTime_;  // 接收时间
-    std::map<std::string, std::string> headers_;  // 请求头
-    std::string content_;  // 请求体
+    HeaderMap headers_;  // 请求头
+    std::pmr::string content_;  // 请求体
     uint64_t contentLength_{0};  // 请求体长度
+    std::pmr::string peerIp_;
+    std::pmr::string clientIp_;
+    diagnostics::RequestTrace* trace_{nullptr};  // 不拥有，指向所在线程的跟踪对象
 };
 
 }  // namespace http
@@ -4,6 +4,10 @@
 #include "mymuduo/TcpServer.h"
 
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
 
 namespace http
 {
@@ -15,6 +19,7 @@ public:
     {
         kUnknown,
         k200Ok = 200,   // 成功
+        k202Accepted = 202,  // 已接受，稍后完成
         k204NoContent = 204,  // 成功但无内容
         k301MovedPermanently = 301,  // 永久重定向
         k400BadRequest = 400,   // 客户端错误
@@ -22,10 +27,12 @@ public:
         k403Forbidden = 403,   // 禁止访问
         k404NotFound = 404,    // 资源未找到
         k409Conflict = 409,     // 冲突
+        k429TooManyRequests = 429,  // 请求过于频繁
         k500InternalServerError = 500,   // 服务器内部错误
     };
 
-    HttpResponse(bool close = true);
+    // 头部和响应体从resource分配，服务器处理请求时传入请求所在的内存池
+    HttpResponse(bool close = true, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
     void setVersion(std::string version) { httpVersion_ = version; }
 
@@ -33,16 +40,18 @@ public:
     HttpStatusCode getStatusCode() const { return statusCode_; }
 
     void setStatusMessage(const std::string message) { statusMessage_ = message; }
+    const std::string& getStatusMessage() const { return statusMessage_; }
 
     void setCloseConnection(bool on) { closeConnection_ = on; }
     bool closeConnection() const { return closeConnection_; }
 
-    void addHeader(const std::string& key, const std::string& value) { headers_[key] = value; }
+    void addHeader(std::string_view key, std::string_view value);
+    bool hasHeader(std::string_view key) const { return headers_.count(key) > 0; }
 
-    void setContentType(const std::string& contentType) { addHeader("Content-Type", contentType); } 
+    void setContentType(std::string_view contentType) { addHeader("Content-Type", contentType); } 
     void setContentLength(uint64_t length) { addHeader("Content-Length", std::to_string(length)); }
 
-    void setBody(const std::string& body) { body_ = body; }
+    void setBody(std::string_view body) { body_.assign(body.data(), body.size()); }
 
     void setStatusLine(const std::string& version, 
                         HttpStatusCode statusCode, 
@@ -52,14 +61,24 @@ public:
 
     void appendToBuffer(Buffer* outputBuf) const;
 
+    /*
+        序列化好的响应尾部：头部字段 + 空行 + 响应体(不含状态行和Connection)，
+        设置后appendToBuffer在状态行、Connection和headers_之后直接追加它，用于缓存命中等复用整段响应的场景
+    */
+    void setSerializedTail(std::shared_ptr<const std::string> tail) { serializedTail_ = std::move(tail); }
+    const std::shared_ptr<const std::string>& serializedTail() const { return serializedTail_; }
+    // 按当前的头部和响应体生成尾部
+    std::string serializeTail() const;
+
 private:
     std::string httpVersion_;
     HttpStatusCode statusCode_;
     std::string statusMessage_;
     bool closeConnection_;
-    std::map<std::string, std::string> headers_;
-    std::string body_;
+    std::pmr::map<std::pmr::string, std::pmr::string, std::less<>> headers_;
+    std::pmr::string body_;
     bool isFile_;
+    std::shared_ptr<const std::string> serializedTail_;
 };
 
 }
@@ -5,26 +5,49 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #include "mymuduo/TcpConnection.h"
 #include "mymuduo/EventLoop.h"
 #include "mymuduo/Alogger.h"
 #include "mymuduo/noncopyable.h"
 
+#include "ServerPolicies.h"
 #include "HttpContext.h"
+#include "ConnectionState.h"
+#include "BufferPool.h"
 #include "HttpRequest.h"
 #include "HttpResponse.h"
+#include "TimingWheel.h"
+#include "AdmissionController.h"
+#include "SingleFlight.h"
 #include "../router/Router.h"
 #include "../session/SessionManager.h"
 #include "../middleware/MiddlewareChain.h"
 #include "../middleware/cors/CorsMiddleware.h"
+#include "../middleware/cache/ResponseCacheMiddleware.h"
+#include "../middleware/ratelimit/RateLimitMiddleware.h"
 #include "../ssl/SslConnection.h"
 #include "../ssl/SslContext.h"
+#include "../net/ReusePortServer.h"
+#include "../net/ListenerHandoff.h"
+#include "../net/SocketTuning.h"
+#include "../net/UringServer.h"
+#include "../metrics/Metrics.h"
+#include "../diagnostics/RequestTrace.h"
+#include "../diagnostics/LoopWatchdog.h"
+#include "../diagnostics/CpuProfiler.h"
+#include "../diagnostics/TrafficCapture.h"
+#include "../memory/RequestArena.h"
+#include "../memory/MemoryAccounting.h"
 
 class HttpRequest;
 class HttpResponse;
@@ -32,20 +55,38 @@ class HttpResponse;
 namespace http
 {
 
-class HttpServer: noncopyable
+/*
+    HTTP服务器，Policies(见ServerPolicies.h)在编译期决定是否包含TLS、中间件链、会话管理器以及保留哪些日志，
+    关闭的功能连同它们的成员和热路径上的判断一起去掉，对应的配置接口也不存在。
+    HttpServer即全部功能的BasicHttpServer<DefaultPolicies>，库中预先实例化了DefaultPolicies和PlainPolicies，
+    其他组合需要包含HttpServerImpl.h
+*/
+template<typename Policies>
+class BasicHttpServer: noncopyable
 {
 public:
+    static constexpr size_t kDefaultHighWaterMark = 64 * 1024;
+
+    // 网络传输方式
+    enum Transport
+    {
+        kEpoll,    // mymuduo的epoll反应堆
+        kIoUring,  // net::UringServer，需要编译时开启HTTP_ENABLE_IO_URING
+    };
+
     using HttpCallback = std::function<void(const http::HttpRequest&, http::HttpResponse*)>;
 
     // 构造函数
-    HttpServer(int port, const std::string& name, bool useSSL = false, TcpServer::Option option = TcpServer::kNoReusePort);
+    BasicHttpServer(int port, const std::string& name, bool useSSL = false, TcpServer::Option option = TcpServer::kNoReusePort,
+               Transport transport = kEpoll);
 
-    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    void setThreadNum(int numThreads) { numThreads_ = numThreads; server_.setThreadNum(numThreads); }
 
     void start();
 
     EventLoop* getLoop() const { return server_.getLoop(); }
 
+    // 设置后由cb处理所有请求，不再经过中间件和路由
     void setHttpCallback(const HttpCallback& cb) { httpCallback_ = cb; }
 
     // 注册静态路由处理器
@@ -59,43 +100,255 @@ public:
     void addRoute(HttpRequest::Method method, const std::string& path, router::Router::HandlerPtr& handler) { router_.addRegexHandler(method, path, handler); }
     // 注册动态路由处理函数
     void addRoute(HttpRequest::Method method, const std::string& path, const router::Router::HandlerCallback& callback) { router_.addRegexCallback(method, path, callback); }
+    // 删除路由，静态路由按路径、动态路由按注册时的模式。注册和删除都可以在start()之后调用，正在处理的请求不受影响
+    bool removeRoute(HttpRequest::Method method, const std::string& path) { return router_.removeRoute(method, path); }
 
     // 设置会话管理器
+    template<typename P = Policies, typename = std::enable_if_t<P::kSessions>>
     void setSeesionManager(std::unique_ptr<session::SessionManager> manager) { sessionManager_ = std::move(manager); }
     // 获取会话管理器
+    template<typename P = Policies, typename = std::enable_if_t<P::kSessions>>
     session::SessionManager* getSessionManager() const { return sessionManager_.get(); }
 
     // 添加中间件的方法
+    template<typename P = Policies, typename = std::enable_if_t<P::kMiddleware>>
     void addMiddleware(std::shared_ptr<middleware::Middleware> middleware) { middlewareChain_.addMiddleware(middleware); }
+
+    // 开启GET响应缓存，缓存中间件放在链首，过期条目在所在I/O线程上后台刷新
+    template<typename P = Policies, typename = std::enable_if_t<P::kMiddleware>>
+    void enableResponseCache(const middleware::CacheConfig& config)
+    {
+        auto cache = std::make_shared<middleware::ResponseCacheMiddleware>(config);
+        cache->setRevalidator(std::bind(&BasicHttpServer::revalidate, this, std::placeholders::_1));
+        middlewareChain_.addMiddlewareFront(cache);
+    }
+
+    // 开启请求合并：config.paths上同时到达的相同GET请求各自经过中间件的before()后只执行一次处理器，在start()之前调用
+    void enableSingleFlight(const SingleFlightConfig& config);
     
+    template<typename P = Policies, typename = std::enable_if_t<P::kTls>>
     void enableSSL(bool enable) { useSSL_ = enable; }
 
-    void setSslConfig(const ssl::SslConfig& config);
+    template<typename P = Policies, typename = std::enable_if_t<P::kTls>>
+    void setSslConfig(const ssl::SslConfig& config)
+    {
+        if(useSSL_)
+        {
+            sslCtx_ = std::make_unique<ssl::SslContext>(config);
+            if(!sslCtx_->initialize())
+            {
+                logger_->ERROR("Failed to initialize SSL context");
+                abort();
+            }
+        }
+    }
+
+    /*
+        在Unix域socket path上额外监听，供同一台机器上的反向代理(如nginx)转发请求，省去回环TCP的协议栈开销。
+        这些连接与TCP连接走同样的解析、路由和keep-alive处理，但不做SSL(由代理终结TLS)。
+        注意：它会另外启动一组I/O线程，数量与setThreadNum相同，进程的I/O线程总数因此翻倍。
+        所有连接都来自代理，没有各自的客户端地址：准入控制只对它们检查全局连接数上限，
+        按IP的限流规则默认不作用于它们，见setTrustProxyHeaders。在start()之前调用
+    */
+    void addUnixListener(const std::string& path);
+
+    /*
+        信任Unix域socket上的代理转发的客户端地址：依次取X-Real-IP和X-Forwarded-For的最后一项
+        (代理追加的、它实际看到的对端地址)，不是合法IP时忽略。取到的地址作为HttpRequest::clientIp，
+        供按IP的限流使用。只有代理会覆盖或追加这些请求头时才能开启，TCP连接上的这些请求头始终忽略
+    */
+    void setTrustProxyHeaders(bool trust) { trustProxyHeaders_ = trust; }
 
+    /*
+        io_uring传输的参数，在start()之前调用。io_uring传输与epoll共用解析、中间件、路由、指标、跟踪
+        和超时配置，但不支持SSL、reuse-port、热升级、Unix域socket、准入控制和请求合并
+    */
+    void setUringConfig(const net::UringConfig& config) { uringConfig_ = config; }
+
+    // 监听socket调优(net::SocketTuning::lowLatency()/highThroughput()或自定义)，accept的连接继承这些选项，在start()之前调用
+    void setSocketTuning(const net::SocketTuning& tuning) { socketTuning_ = tuning; }
+
+    // SO_REUSEPORT多acceptor模式，需要在构造时传入TcpServer::kReusePort，在start()之前调用
+    void setReusePortConfig(const net::ReusePortConfig& config);
+
+    // 设置请求头/请求体读取超时和keep-alive空闲超时，在start()之前调用
+    void setTimeoutConfig(const TimeoutConfig& config) { timeoutConfig_ = config; }
+
+    // 开启准入控制和过载降载，在start()之前调用
+    void setOverloadConfig(const OverloadConfig& config) { admission_ = std::make_unique<AdmissionController>(config); }
+    AdmissionController* getAdmissionController() const { return admission_.get(); }
+
+    /*
+        热升级：controlPath是新旧进程交接监听socket用的Unix域socket路径
+        takeover为true(新进程)时先从正在运行的旧进程接管监听socket，没有旧进程就正常启动；
+        旧进程收到新进程的确认后立即停止accept(已排队的连接留给新进程)，排空现有连接，最多等待drainTimeoutSeconds秒后start()返回。
+        新进程的TcpServer在构造时就bind了同一个端口，新旧进程都必须以TcpServer::kReusePort构造(不能再调用setReusePortConfig)，
+        否则这里直接abort。在start()之前调用
+    */
+    void enableHotUpgrade(const std::string& controlPath, bool takeover, int drainTimeoutSeconds = 30);
+    bool draining() const { return draining_; }
+    int connectionCount() const { return connectionCount_; }
+
+    // 开启请求指标统计，并在path上注册Prometheus采集接口
+    void enableMetrics(const std::string& path = "/metrics");
+
+    /*
+        管理接口(剖析、内存)只接受来自回环地址的TCP连接。Unix域socket上的连接是反向代理转发的外部流量，一律拒绝。
+        代理也通过回环TCP转发时必须设置token，之后管理请求要带上请求头X-Admin-Token: token，在start()之前调用
+    */
+    void setAdminToken(const std::string& token) { adminToken_ = token; }
+
+    /*
+        在path下注册CPU剖析接口，只接受管理请求(见setAdminToken)：
+        POST path/start?seconds=10&hz=99&tid=0 开始一次剖析，tid非0时只采样该线程
+        GET  path 剖析进行中返回202，完成后返回折叠格式的调用栈，可直接交给flamegraph.pl
+        GET  path/threads 列出进程内的线程(tid和线程名)
+    */
+    void enableProfiler(const std::string& path = "/admin/profile");
+
+    /*
+        在path上注册内存占用接口，只接受管理请求，以JSON返回进程RSS、malloc使用的堆内存，
+        以及各类对象(HttpContext、SslConnection、Session、AiGame和各种缓存)的存活个数、字节数和平均每个的字节数
+    */
+    void enableMemoryStats(const std::string& path = "/admin/memory");
+
+    // 开启请求阶段跟踪，耗时通过Server-Timing响应头和跟踪日志输出，在start()之前调用
+    void setTraceConfig(const diagnostics::TraceConfig& config) { traceConfig_ = config; }
+
+    /*
+        开启事件循环卡顿检测：心跳超过阈值没有更新时记录卡住线程的调用栈和正在处理的请求，
+        卡顿次数和循环延迟直方图通过/metrics导出。io_uring传输不支持，在start()之前调用
+    */
+    void setWatchdogConfig(const diagnostics::WatchdogConfig& config) { watchdog_ = std::make_unique<diagnostics::LoopWatchdog>(config); }
+
+    /*
+        抓包：把每个连接收到的请求字节(TLS为解密后的明文)连同时间戳写入config.path，
+        用benchmark/TrafficReplay.cc对本地服务器回放。写入不阻塞I/O线程，来不及写的记录丢弃并计数，在start()之前调用
+    */
+    void enableCapture(const diagnostics::CaptureConfig& config) { capture_ = std::make_unique<diagnostics::TrafficCapture>(config); }
+
+    /*
+        连接输出缓冲区超过bytes字节时停止读取和解析该连接的请求，写完后恢复，
+        使慢速读取的客户端占用的内存有上限。0表示不限制，在start()之前调用
+    */
+    void setOutputHighWaterMark(size_t bytes) { highWaterMark_ = bytes; }
 
 private:
-    void initialize();
+    // 策略关闭的功能所对应的成员
+    struct Disabled {};
 
+    // 不开启TLS的策略下恒为false，相关分支在编译期去掉
+    bool tls() const
+    {
+        if constexpr(Policies::kTls)
+        {
+            return useSSL_;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // 日志消息由message()生成，级别低于策略时不会调用，也就没有字符串拼接
+    template<LogLevel Level, typename Message>
+    static void logAt(const Message& message);
+
+    void initialize();
+    // 每个I/O线程启动时调用，创建该线程的时间轮
+    void onThreadInit(EventLoop* loop);
     void onConnection(const TcpConnectionPtr& conn);
     void onMessage(const TcpConnectionPtr& conn, Buffer* buf, TimeStamp receiveTime);
-    void onRequest(const TcpConnectionPtr&, const HttpRequest&);
-    void handleRequest(const HttpRequest& req, HttpResponse* resp);
+    // 返回响应后是否关闭连接
+    bool onRequest(const TcpConnectionPtr&, HttpRequest&, bool coalesce = true);
+    // io_uring传输的回调
+    void startUring();
+    void onUringConnection(net::UringConnection* conn, bool connected);
+    bool onUringMessage(net::UringConnection* conn, Buffer* in, Buffer* out);
+    void armUringTimeout(net::UringConnection* conn, HttpContext* context, HttpContext::TimeoutPhase phase);
+    void onUringTimeout(net::UringConnection* conn, Buffer* out);
+    // 把缓冲区中还没抓过的字节写入抓包
+    void captureInput(ConnectionState* state, Buffer* buf);
+    // 不是管理请求时填好403响应并返回false
+    bool authorizeAdmin(const HttpRequest& req, HttpResponse* resp) const;
+    // 请求是否要求响应后关闭连接
+    bool wantsClose(const HttpRequest& req) const;
+    // 解析出一个完整请求后，记录解析和排队耗时、按配置开启跟踪
+    void beginRequest(HttpContext* context, uint64_t queueNanos);
+    // 执行一个请求(中间件、路由、指标和跟踪)，序列化后的响应交给write，返回是否关闭连接，与传输方式无关。
+    // flight不为空时在中间件之后参与合并，成为等待者时什么也不写；captureId为抓包中的连接编号，未开启抓包时忽略
+    bool processRequest(HttpRequest& req, bool close, SingleFlight::Flight* flight, uint64_t captureId,
+                        const std::function<void(Buffer*)>& write);
+    // 合并的请求完成，在等待者所在的线程上执行
+    void onFlightComplete(const std::weak_ptr<TcpConnection>& weakConn, const std::shared_ptr<HttpRequest>& req,
+                          bool close, const SingleFlight::Result& result);
+    // 中间件 + 路由，成为合并请求的等待者时返回false，resp没有填写
+    bool handleRequest(HttpRequest& req, HttpResponse* resp, SingleFlight::Flight* flight = nullptr);
+    // 超时阶段的时限(秒)，0表示不限时
+    int timeoutOf(HttpContext::TimeoutPhase phase) const;
+    // 让连接进入新的超时阶段
+    void armTimeout(const TcpConnectionPtr& conn, HttpContext* context, HttpContext::TimeoutPhase phase);
+    void onTimeout(const TcpConnectionPtr& conn, uint64_t generation);
+    // 输出背压
+    void pauseReading(const TcpConnectionPtr& conn, HttpContext* context);
+    void onHighWaterMark(const TcpConnectionPtr& conn, size_t bytes);
+    void onWriteComplete(const TcpConnectionPtr& conn);
+    // 热升级
+    void takeOverListener();
+    void startHandoffServer();
+    void beginDrain();
+    // 在当前I/O线程上重新执行一次请求，刷新响应缓存
+    void revalidate(const HttpRequest& req);
 
     InetAddress listenAddr_;  // 监听地址
     TcpServer server_;  
+    int listenFd_;  // server_在构造时创建并bind的socket，mymuduo不暴露它，构造时找出来，找不到时为-1
     EventLoop mainLoop_;  // 主循环
-    HttpCallback httpCallback_;  // 回调函数
+    HttpCallback httpCallback_;  // 回调函数，为空时使用handleRequest
     router::Router router_;  // 路由
-    std::unique_ptr<session::SessionManager> sessionManager_;  // 会话管理器
-    middleware::MiddlewareChain middlewareChain_;  // 中间件链
-    std::unique_ptr<ssl::SslContext> sslCtx_;  // SSL上下文
+    std::conditional_t<Policies::kSessions, std::unique_ptr<session::SessionManager>, Disabled> sessionManager_;  // 会话管理器
+    std::conditional_t<Policies::kMiddleware, middleware::MiddlewareChain, Disabled> middlewareChain_;  // 中间件链
+    std::conditional_t<Policies::kTls, std::unique_ptr<ssl::SslContext>, Disabled> sslCtx_;  // SSL上下文
     bool useSSL_;  // 是否使用SSL
-    std::map<TcpConnectionPtr, std::unique_ptr<ssl::SslConnection>> sslConns_;
+    TcpServer::Option option_;  // 监听socket是否设置了SO_REUSEPORT
+    std::unique_ptr<net::ReusePortServer> reusePortServer_;  // 多acceptor模式, 为空时使用server_
+    int numThreads_;
+    net::SocketTuning socketTuning_;  // 默认不修改任何选项
+    Transport transport_;
+    net::UringConfig uringConfig_;
+    std::unique_ptr<net::UringServer> uringServer_;
+    std::unique_ptr<TcpServer> unixServer_;  // Unix域socket监听，为空时不启用
+    bool trustProxyHeaders_;  // 是否采用Unix域socket上代理转发的客户端地址
+    TimeoutConfig timeoutConfig_;  // 连接超时配置
+    std::unique_ptr<AdmissionController> admission_;  // 过载保护，为空时不启用
+    std::mutex loopsMutex_;
+    std::vector<EventLoop*> ioLoops_;  // 所有处理连接的EventLoop(包括主循环)
+    std::atomic<int> connectionCount_;  // 当前连接数
+    std::string upgradePath_;  // 热升级控制socket路径，为空表示不启用
+    bool takeover_;  // 启动时是否从旧进程接管监听socket
+    int drainTimeoutSeconds_;
+    int takeoverAckFd_;  // 接管成功后用于通知旧进程的控制连接
+    std::unique_ptr<net::ListenerHandoff> handoff_;
+    std::atomic<bool> draining_;  // 已交出监听socket，正在排空
+    bool metricsEnabled_;  // 是否统计各阶段耗时和状态码
+    diagnostics::TraceConfig traceConfig_;  // 请求阶段跟踪配置
+    size_t highWaterMark_;  // 输出缓冲区高水位，超过后暂停读取
+    std::unique_ptr<SingleFlight> singleFlight_;  // 请求合并，为空时不启用
+    std::unique_ptr<diagnostics::LoopWatchdog> watchdog_;  // 卡顿检测，为空时不启用
+    std::unique_ptr<diagnostics::TrafficCapture> capture_;  // 抓包，为空时不启用
+    std::string adminToken_;  // 管理接口的口令，为空时只检查来源地址
     /*
         SslConnection里面就有TcpConnectionPtr conn_;     
     */
 };
 
+// 预先实例化的策略在HttpServer.cpp中编译，使用者不必包含实现
+extern template class BasicHttpServer<DefaultPolicies>;
+extern template class BasicHttpServer<PlainPolicies>;
+
+using HttpServer = BasicHttpServer<DefaultPolicies>;
+using PlainHttpServer = BasicHttpServer<PlainPolicies>;
+
 
 }
 
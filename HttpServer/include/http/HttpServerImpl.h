@@ -0,0 +1,1479 @@
+#ifndef HTTPSERVERIMPL_H
+#define HTTPSERVERIMPL_H
+
+/*
+    BasicHttpServer的实现，只有HttpServer.cpp和需要自定义策略组合的使用者包含，
+    使用者在一个源文件中 template class http::BasicHttpServer<MyPolicies>; 实例化一次
+*/
+
+#include "HttpServer.h"
+#include "../net/SocketUtil.h"
+#include "../diagnostics/Probes.h"
+
+#include <fcntl.h>
+#include <openssl/crypto.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <any>
+#include <charconv>
+#include <iterator>
+#include <functional>
+#include <memory>
+#include <optional>
+
+namespace http
+{
+
+// 所有实例化共享的每线程状态
+namespace detail
+{
+
+// 每个I/O线程一个时间轮，只在本线程访问
+inline thread_local std::unique_ptr<TimingWheel> t_timingWheel;
+// 当前线程的EventLoop
+inline thread_local EventLoop* t_loop = nullptr;
+// 本线程的连接状态池和响应Buffer池
+inline thread_local ConnectionStatePool t_statePool;
+inline thread_local BufferPool t_bufferPool;
+
+inline HttpContext* contextOf(const TcpConnectionPtr& conn)
+{
+    ConnectionState* state = stateOf(conn);
+    return state ? &state->context : nullptr;
+}
+
+// 本线程上的所有连接，排空时用来关闭空闲连接
+inline thread_local std::unordered_map<TcpConnection*, std::weak_ptr<TcpConnection>> t_connections;
+
+// 关闭本线程上没有请求正在处理的keep-alive连接
+inline void closeIdleConnections()
+{
+    for(const auto& item: t_connections)
+    {
+        TcpConnectionPtr conn = item.second.lock();
+        if(!conn)
+        {
+            continue;
+        }
+        HttpContext* context = contextOf(conn);
+        if(context && context->timeoutPhase() == HttpContext::kKeepAliveIdle)
+        {
+            conn->shutdown();
+        }
+    }
+}
+
+// handleRequest中路由命中的指标编号，由onRequest读取
+inline thread_local int t_routeId = 0;
+// onMessage中暂存的当前请求的解析和排队耗时
+inline thread_local uint64_t t_pendingParseNanos = 0;
+inline thread_local uint64_t t_pendingQueueNanos = 0;
+// 每个线程同一时刻只处理一个请求，跟踪对象可以复用
+inline thread_local diagnostics::RequestTrace t_trace;
+
+// Unix域socket上的连接没有IP地址，对端地址记为"unix"
+inline const std::string kUnixPeer = "unix";
+
+// 连接来自回环地址。Unix域socket上的连接是反向代理转发的外部流量，不算本机
+inline bool fromLocalPeer(const HttpRequest& req)
+{
+    const std::pmr::string& ip = req.peerIp();
+    return ip == "127.0.0.1" || ip == "::1";
+}
+
+// 准入控制按IP计数的键，代理转发的连接共用一个对端地址，不按IP计数
+inline const std::string& admissionKey(const std::string& peerIp)
+{
+    static const std::string empty;
+    return peerIp == kUnixPeer ? empty : peerIp;
+}
+
+// 代理转发的客户端地址：X-Real-IP优先，其次是X-Forwarded-For的最后一项，不是合法IP时返回false。ip指向请求头内部
+inline bool forwardedClientIp(const HttpRequest& req, std::string_view* ip)
+{
+    std::string_view value = req.getHeader("X-Real-IP");
+    if(value.empty())
+    {
+        value = req.getHeader("X-Forwarded-For");
+        size_t comma = value.rfind(',');
+        if(comma != std::string_view::npos)
+        {
+            value.remove_prefix(comma + 1);
+        }
+    }
+    while(!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+    {
+        value.remove_prefix(1);
+    }
+    while(!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+    {
+        value.remove_suffix(1);
+    }
+    if(value.empty() || value.size() >= INET6_ADDRSTRLEN)
+    {
+        return false;
+    }
+    char text[INET6_ADDRSTRLEN];
+    value.copy(text, value.size());
+    text[value.size()] = '\0';
+    unsigned char addr[sizeof(in6_addr)];
+    if(::inet_pton(AF_INET, text, addr) != 1 && ::inet_pton(AF_INET6, text, addr) != 1)
+    {
+        return false;
+    }
+    *ip = value;
+    return true;
+}
+
+inline void setTextResponse(HttpResponse* resp, const std::string& version, HttpResponse::HttpStatusCode code,
+                            const std::string& message, const std::string& body)
+{
+    resp->setStatusLine(version, code, message);
+    resp->setContentType("text/plain");
+    resp->setContentLength(body.size());
+    resp->setBody(body);
+}
+
+// 查询参数转成整数，没有该参数时为defaultValue，不是整数时返回false
+inline bool intParameter(const HttpRequest& req, std::string_view key, int defaultValue, int* value)
+{
+    const std::pmr::string& text = req.getQueryParameters(key);
+    if(text.empty())
+    {
+        *value = defaultValue;
+        return true;
+    }
+    auto result = std::from_chars(text.data(), text.data() + text.size(), *value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+// 消息处理返回时记下缓冲区里剩下的字节数，它们已经抓过，下次进入时跳过
+struct CaptureMark
+{
+    ConnectionState* state;  // 为空表示未开启抓包
+    Buffer* buf;
+
+    ~CaptureMark()
+    {
+        if(state)
+        {
+            state->capturedBytes = buf->readableBytes();
+        }
+    }
+};
+
+inline constexpr char kRequestTimeoutResponse[] = "HTTP/1.1 408 Request Timeout\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+}
+
+template<typename Policies>
+template<LogLevel Level, typename Message>
+void BasicHttpServer<Policies>::logAt(const Message& message)
+{
+    if constexpr(Policies::logs(Level))
+    {
+        if constexpr(Level == LogLevel::kDebug)
+        {
+            logger_->DEBUG(message());
+        }
+        else if constexpr(Level == LogLevel::kInfo)
+        {
+            logger_->INFO(message());
+        }
+        else if constexpr(Level == LogLevel::kWarn)
+        {
+            logger_->WARN(message());
+        }
+        else
+        {
+            logger_->ERROR(message());
+        }
+    }
+}
+
+// 构造函数
+template<typename Policies>
+BasicHttpServer<Policies>::BasicHttpServer(int port, const std::string& name, bool useSSL, TcpServer::Option option, Transport transport):
+    listenAddr_(port),
+    server_(&mainLoop_, listenAddr_, name, option),
+    listenFd_(-1),
+    useSSL_(useSSL),
+    option_(option),
+    numThreads_(0),
+    transport_(transport),
+    trustProxyHeaders_(false),
+    connectionCount_(0),
+    takeover_(false),
+    drainTimeoutSeconds_(0),
+    takeoverAckFd_(-1),
+    draining_(false),
+    metricsEnabled_(false),
+    highWaterMark_(kDefaultHighWaterMark)
+{
+    if constexpr(!Policies::kTls)
+    {
+        if(useSSL)
+        {
+            logger_->ERROR("SSL requested but this server is compiled without TLS (Policies::kTls is false)");
+            abort();
+        }
+    }
+    if(transport_ == kIoUring && !net::UringServer::supported())
+    {
+        logger_->ERROR("io_uring transport is not available (HTTP_ENABLE_IO_URING off or kernel support missing)");
+        abort();
+    }
+    // 此时还没有任何连接，端口上没有listen的socket只有server_自己的；开始accept之后连接也绑定在这个端口上，就分不清了
+    std::vector<int> bound = net::SocketUtil::findSockets(listenAddr_.toPort(), false);
+    if(bound.size() == 1)
+    {
+        listenFd_ = bound[0];
+    }
+    initialize();
+}
+
+// 服务器运行函数
+template<typename Policies>
+void BasicHttpServer<Policies>::start()
+{
+    if(transport_ == kIoUring)
+    {
+        startUring();
+        return;
+    }
+    if(!upgradePath_.empty())
+    {
+        if(reusePortServer_)
+        {
+            // 各acceptor的socket由自己的线程创建，无法把旧进程的socket替换进去
+            logger_->ERROR("Hot upgrade is not supported in reuse-port mode");
+            abort();
+        }
+        if(takeover_)
+        {
+            takeOverListener();
+        }
+    }
+
+    if(reusePortServer_)
+    {
+        // server_只绑定了端口但不listen，连接全部由各个acceptor线程自己accept
+        logger_->WARN("HttpServer[" + server_.name() + "] starts in reuse-port mode on" + server_.isPort());
+        onThreadInit(&mainLoop_);
+        reusePortServer_->setSocketTuning(socketTuning_);  // 每个acceptor在开始accept之前设置自己的socket
+        reusePortServer_->start();
+        if(unixServer_)
+        {
+            unixServer_->setThreadNum(numThreads_);
+            unixServer_->start();
+        }
+        mainLoop_.loop();
+        return;
+    }
+    logger_->WARN("HttpServer[" + server_.name() + "] starts listening on" + server_.isPort());
+    onThreadInit(&mainLoop_);  // 线程数为0时连接都在主循环上
+    if(listenFd_ >= 0)
+    {
+        socketTuning_.applyToListener(listenFd_);  // 在listen之前设置，所有连接都会继承
+    }
+    else
+    {
+        logger_->WARN("HttpServer[" + server_.name() + "] cannot locate its listen socket, socket tuning skipped");
+    }
+    server_.start();
+    if(unixServer_)
+    {
+        unixServer_->setThreadNum(numThreads_);
+        unixServer_->start();
+    }
+    if(!upgradePath_.empty())
+    {
+        if(takeoverAckFd_ >= 0)
+        {
+            // 已经在接管来的socket上监听，旧进程可以开始排空了
+            net::ListenerHandoff::confirmTakeover(takeoverAckFd_);
+            takeoverAckFd_ = -1;
+        }
+        startHandoffServer();
+    }
+    mainLoop_.loop();
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::initialize()
+{
+    /*
+        设置回调函数，用户自己定义的回调函数
+
+        onConnection: 当有用户连接或者断开的时候调用的函数
+
+        onMessage： 当TcpConnection接收到客户端的消息时调用的函数
+
+
+    */
+    server_.setConnectionCallback(std::bind(&BasicHttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&BasicHttpServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    server_.setThreadInitCallback(std::bind(&BasicHttpServer::onThreadInit, this, std::placeholders::_1));
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::onThreadInit(EventLoop* loop)
+{
+    /*
+        主循环会被初始化不止一次：start()中手动调用，线程数为0时线程池对base loop再调用一次，
+        Unix域socket的TcpServer也以mainLoop_为base loop。时间轮、延迟探测和卡顿检测每个loop只能有一份
+    */
+    if(detail::t_loop == loop)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(loopsMutex_);
+        ioLoops_.push_back(loop);
+    }
+    detail::t_loop = loop;
+
+    int maxTimeout = std::max({timeoutConfig_.headerTimeout, timeoutConfig_.bodyTimeout, timeoutConfig_.keepAliveTimeout});
+    if(maxTimeout > 0)  // 至少配置了一种超时
+    {
+        detail::t_timingWheel = std::make_unique<TimingWheel>(loop, maxTimeout, 
+            std::bind(&BasicHttpServer::onTimeout, this, std::placeholders::_1, std::placeholders::_2));
+        detail::t_timingWheel->start();
+    }
+
+    if(admission_)
+    {
+        admission_->startLoopLagProbe(loop);
+    }
+    if(watchdog_)
+    {
+        watchdog_->watch(loop);
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::setReusePortConfig(const net::ReusePortConfig& config)
+{
+    /*
+        server_在构造时已经bind了端口，只有它同样带有SO_REUSEPORT，
+        各个acceptor的socket才能绑定到同一个端口上
+    */
+    if(option_ != TcpServer::kReusePort)
+    {
+        logger_->ERROR("Reuse-port mode requires HttpServer constructed with TcpServer::kReusePort");
+        abort();
+    }
+    reusePortServer_ = std::make_unique<net::ReusePortServer>(listenAddr_, server_.name(), config);
+    reusePortServer_->setConnectionCallback(std::bind(&BasicHttpServer::onConnection, this, std::placeholders::_1));
+    reusePortServer_->setMessageCallback(std::bind(&BasicHttpServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    reusePortServer_->setThreadInitCallback(std::bind(&BasicHttpServer::onThreadInit, this, std::placeholders::_1));
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::addUnixListener(const std::string& path)
+{
+    /*
+        mymuduo的TcpServer只接受InetAddress，这里先让它在127.0.0.1的临时端口上创建并bind自己的socket(还没有listen)，
+        再把Unix域socket dup2到这个fd上，start()时Acceptor就在Unix域socket上listen和accept
+    */
+    int unixFd = net::SocketUtil::createUnixSocket(path);
+    if(unixFd < 0)
+    {
+        logger_->ERROR("Failed to create unix socket " + path);
+        abort();
+    }
+
+    std::vector<int> before = net::SocketUtil::allSockets(false);
+    unixServer_ = std::make_unique<TcpServer>(&mainLoop_, InetAddress(0, "127.0.0.1"), server_.name() + "-unix");
+    std::vector<int> after = net::SocketUtil::allSockets(false);
+    std::vector<int> created;
+    std::set_difference(after.begin(), after.end(), before.begin(), before.end(), std::back_inserter(created));
+    if(created.size() != 1 || ::dup2(unixFd, created[0]) < 0)
+    {
+        logger_->ERROR("Failed to install unix socket " + path);
+        abort();
+    }
+    ::fcntl(created[0], F_SETFD, FD_CLOEXEC);  // dup2不保留close-on-exec
+    ::close(unixFd);
+
+    unixServer_->setConnectionCallback(std::bind(&BasicHttpServer::onConnection, this, std::placeholders::_1));
+    unixServer_->setMessageCallback(std::bind(&BasicHttpServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    unixServer_->setThreadInitCallback(std::bind(&BasicHttpServer::onThreadInit, this, std::placeholders::_1));
+    logger_->WARN("HttpServer[" + server_.name() + "] also listens on unix:" + path);
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::enableHotUpgrade(const std::string& controlPath, bool takeover, int drainTimeoutSeconds)
+{
+    // 新进程在接管之前就要bind端口，这时旧进程还在监听，双方都没有SO_REUSEPORT会bind失败
+    if(option_ != TcpServer::kReusePort)
+    {
+        logger_->ERROR("Hot upgrade requires HttpServer constructed with TcpServer::kReusePort");
+        abort();
+    }
+    upgradePath_ = controlPath;
+    takeover_ = takeover;
+    drainTimeoutSeconds_ = drainTimeoutSeconds;
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::enableMetrics(const std::string& path)
+{
+    metricsEnabled_ = true;
+    Get(path, [this](const HttpRequest&, HttpResponse* resp) {
+        std::string body = metrics::MetricsRegistry::instance().scrape();
+
+        // 服务器级别的计数
+        body += "# TYPE http_connections_active gauge\n";
+        body += "http_connections_active " + std::to_string(connectionCount_) + "\n";
+        if(admission_)
+        {
+            body += "# TYPE http_connections_rejected_total counter\n";
+            body += "http_connections_rejected_total " + std::to_string(admission_->rejectedConnections()) + "\n";
+            body += "# TYPE http_requests_shed_total counter\n";
+            body += "http_requests_shed_total " + std::to_string(admission_->shedRequests()) + "\n";
+        }
+        if(capture_)
+        {
+            body += "# TYPE http_capture_bytes_total counter\n";
+            body += "http_capture_bytes_total " + std::to_string(capture_->writtenBytes()) + "\n";
+            body += "# TYPE http_capture_dropped_records_total counter\n";
+            body += "http_capture_dropped_records_total " + std::to_string(capture_->droppedRecords()) + "\n";
+        }
+        if(watchdog_)
+        {
+            body += "# TYPE http_loop_stalls_total counter\n";
+            body += "http_loop_stalls_total " + std::to_string(watchdog_->stalls()) + "\n";
+        }
+        // 请求内存池：allocations / requests 即每个请求的分配次数，upstream为块不够用时落到全局分配器的次数
+        memory::ArenaStats arena = memory::RequestArena::stats();
+        body += "# TYPE http_request_arena_requests_total counter\n";
+        body += "http_request_arena_requests_total " + std::to_string(arena.requests) + "\n";
+        body += "# TYPE http_request_arena_allocations_total counter\n";
+        body += "http_request_arena_allocations_total " + std::to_string(arena.allocations) + "\n";
+        body += "# TYPE http_request_arena_bytes_total counter\n";
+        body += "http_request_arena_bytes_total " + std::to_string(arena.bytes) + "\n";
+        body += "# TYPE http_request_arena_upstream_allocations_total counter\n";
+        body += "http_request_arena_upstream_allocations_total " + std::to_string(arena.upstreamAllocations) + "\n";
+
+        resp->setStatusLine("HTTP/1.1", HttpResponse::k200Ok, "OK");
+        resp->setContentType("text/plain; version=0.0.4");
+        resp->setContentLength(body.size());
+        resp->setBody(body);
+    });
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::enableProfiler(const std::string& path)
+{
+    Post(path + "/start", [this](const HttpRequest& req, HttpResponse* resp) {
+        if(!authorizeAdmin(req, resp))
+        {
+            return;
+        }
+        diagnostics::ProfileOptions options;
+        int tid = 0;
+        std::string error;
+        if(!detail::intParameter(req, "seconds", options.seconds, &options.seconds) ||
+           !detail::intParameter(req, "hz", options.hz, &options.hz) ||
+           !detail::intParameter(req, "tid", 0, &tid))
+        {
+            detail::setTextResponse(resp, req.getVersion(), HttpResponse::k400BadRequest, "Bad Request", "seconds, hz and tid must be integers\n");
+            return;
+        }
+        options.tid = tid;
+        diagnostics::CpuProfiler& profiler = diagnostics::CpuProfiler::instance();
+        if(profiler.running())
+        {
+            detail::setTextResponse(resp, req.getVersion(), HttpResponse::k409Conflict, "Conflict", "a profile is already running\n");
+            return;
+        }
+        if(!profiler.start(options, &error))
+        {
+            detail::setTextResponse(resp, req.getVersion(), HttpResponse::k400BadRequest, "Bad Request", error + "\n");
+            return;
+        }
+        resp->addHeader("Retry-After", std::to_string(options.seconds));
+        detail::setTextResponse(resp, req.getVersion(), HttpResponse::k202Accepted, "Accepted", "profiling started\n");
+    });
+
+    Get(path, [this](const HttpRequest& req, HttpResponse* resp) {
+        if(!authorizeAdmin(req, resp))
+        {
+            return;
+        }
+        std::string folded;
+        switch(diagnostics::CpuProfiler::instance().result(&folded))
+        {
+            case diagnostics::CpuProfiler::kIdle:
+                detail::setTextResponse(resp, req.getVersion(), HttpResponse::k404NotFound, "Not Found", "no profile yet\n");
+                break;
+            case diagnostics::CpuProfiler::kRunning:
+                resp->addHeader("Retry-After", "1");
+                detail::setTextResponse(resp, req.getVersion(), HttpResponse::k202Accepted, "Accepted", "profiling in progress\n");
+                break;
+            case diagnostics::CpuProfiler::kDone:
+                detail::setTextResponse(resp, req.getVersion(), HttpResponse::k200Ok, "OK", folded);
+                break;
+        }
+    });
+
+    Get(path + "/threads", [this](const HttpRequest& req, HttpResponse* resp) {
+        if(!authorizeAdmin(req, resp))
+        {
+            return;
+        }
+        std::string body;
+        for(const auto& thread: diagnostics::CpuProfiler::threads())
+        {
+            body += std::to_string(thread.first) + " " + thread.second + "\n";
+        }
+        detail::setTextResponse(resp, req.getVersion(), HttpResponse::k200Ok, "OK", body);
+    });
+}
+
+template<typename Policies>
+bool BasicHttpServer<Policies>::authorizeAdmin(const HttpRequest& req, HttpResponse* resp) const
+{
+    if(!detail::fromLocalPeer(req))
+    {
+        detail::setTextResponse(resp, req.getVersion(), HttpResponse::k403Forbidden, "Forbidden", "admin routes are local only\n");
+        return false;
+    }
+    if(!adminToken_.empty())
+    {
+        // 定长比较，响应时间不泄露口令的前缀
+        const std::pmr::string& token = req.getHeader("X-Admin-Token");
+        if(token.size() != adminToken_.size() || CRYPTO_memcmp(token.data(), adminToken_.data(), token.size()) != 0)
+        {
+            detail::setTextResponse(resp, req.getVersion(), HttpResponse::k403Forbidden, "Forbidden", "missing or wrong X-Admin-Token\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::enableMemoryStats(const std::string& path)
+{
+    Get(path, [this](const HttpRequest& req, HttpResponse* resp) {
+        if(!authorizeAdmin(req, resp))
+        {
+            return;
+        }
+        std::string body = "{\n  \"residentBytes\": " + std::to_string(memory::residentBytes()) +
+                           ",\n  \"heapInUseBytes\": " + std::to_string(memory::heapInUseBytes()) +
+                           ",\n  \"connections\": " + std::to_string(connectionCount_) + ",\n";
+        if constexpr (Policies::kTls)
+        {
+            if(sslCtx_)
+            {
+                // OpenSSL内部的会话缓存，只能拿到个数
+                body += "  \"sslSessionCache\": " + std::to_string(SSL_CTX_sess_number(sslCtx_->getNativeHandle())) + ",\n";
+            }
+        }
+        body += "  \"objects\": {";
+        bool first = true;
+        for(const memory::MemoryUsage& usage: memory::MemoryAccount::usage())
+        {
+            body += std::string(first ? "" : ",") + "\n    \"" + usage.name + "\": {\"objects\": " + std::to_string(usage.objects) +
+                    ", \"bytes\": " + std::to_string(usage.bytes) +
+                    ", \"bytesPerObject\": " + std::to_string(usage.objects > 0 ? usage.bytes / usage.objects : 0) + "}";
+            first = false;
+        }
+        body += "\n  }\n}\n";
+        detail::setTextResponse(resp, req.getVersion(), HttpResponse::k200Ok, "OK", body);
+        resp->setContentType("application/json");
+    });
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::revalidate(const HttpRequest& req)
+{
+    if(!detail::t_loop)
+    {
+        return;
+    }
+    // 拷贝请求，排在当前请求之后执行，结果只用于刷新缓存，不发给任何连接
+    auto copy = std::make_shared<HttpRequest>(req);
+    copy->setTrace(nullptr);
+    detail::t_loop->queueInLoop([this, copy] {
+        middleware::ResponseCacheMiddleware::RevalidationScope scope;
+        HttpResponse response(false);
+        handleRequest(*copy, &response);
+    });
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::takeOverListener()
+{
+    std::vector<int> fds;
+    int controlFd = net::ListenerHandoff::requestListenFds(upgradePath_, &fds);
+    if(controlFd < 0)
+    {
+        logger_->WARN("No running server at " + upgradePath_ + ", cold start");
+        return;
+    }
+
+    /*
+        server_在构造时已经创建并bind了自己的socket，只是还没有listen，
+        把旧进程的监听socket dup2到这个fd上，Acceptor就直接在旧的accept队列上工作
+    */
+    if(listenFd_ < 0 || ::dup2(fds[0], listenFd_) < 0)
+    {
+        logger_->ERROR("Failed to take over listen socket, cold start");
+        ::close(controlFd);
+    }
+    else
+    {
+        ::fcntl(listenFd_, F_SETFD, FD_CLOEXEC);  // dup2不保留close-on-exec
+        takeoverAckFd_ = controlFd;
+        logger_->WARN("Took over listen socket from running server");
+    }
+    for(int fd: fds)
+    {
+        ::close(fd);
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::startHandoffServer()
+{
+    handoff_ = std::make_unique<net::ListenerHandoff>(upgradePath_);
+    uint16_t port = listenAddr_.toPort();
+    handoff_->serve(
+        [port]{ return net::SocketUtil::findSockets(port, true); },
+        [this]{ mainLoop_.runInLoop(std::bind(&BasicHttpServer::beginDrain, this)); }
+    );
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::beginDrain()
+{
+    /*
+        新进程已经在同一个监听socket上accept了，本进程马上停止accept，
+        accept队列属于两个进程共享的socket，排队中的连接由新进程接收，不会在本进程退出时被重置。
+        排空开始前已经accept的连接只处理完当前请求就关闭
+    */
+    for(int fd: net::SocketUtil::findSockets(listenAddr_.toPort(), true))
+    {
+        if(!net::SocketUtil::retireListener(fd))
+        {
+            logger_->ERROR("Failed to stop accepting on fd " + std::to_string(fd));
+        }
+    }
+    draining_ = true;
+    std::vector<EventLoop*> loops;
+    {
+        std::lock_guard<std::mutex> lock(loopsMutex_);
+        loops = ioLoops_;
+    }
+    for(EventLoop* loop: loops)
+    {
+        loop->runInLoop(detail::closeIdleConnections);
+    }
+
+    int64_t deadline = TimeStamp::now().microSecondsSinceEpoch() + 
+                       static_cast<int64_t>(drainTimeoutSeconds_) * TimeStamp::kMicroSecondsPerSecond;
+    mainLoop_.runEvery(0.2, [this, deadline]{
+        if(connectionCount_ == 0 || TimeStamp::now().microSecondsSinceEpoch() > deadline)
+        {
+            logger_->WARN("Drain finished with " + std::to_string(connectionCount_) + " connections left, exit");
+            mainLoop_.quit();
+        }
+    });
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::onConnection(const TcpConnectionPtr& conn)
+{
+    if(conn->connected())  // 新用户连接
+    {
+        // Unix域socket上的连接没有IP地址，来自本机的反向代理
+        bool unixConn = conn->localAddress().getSockAddr()->sin_family == AF_UNIX;
+        std::string peerIp = unixConn ? detail::kUnixPeer : conn->peerAddress().toIp();
+        if(admission_ && !admission_->admitConnection(detail::admissionKey(peerIp)))
+        {
+            // 超过连接数上限，在建立SSL和解析上下文之前就拒绝
+            logger_->WARN("Connection limit reached, reject " + conn->name());
+            if(!tls() || unixConn)
+            {
+                conn->send(admission_->overloadResponse());
+            }
+            conn->forceClose();
+            return;
+        }
+
+        // 连接状态从本线程的池中取，断开时归还
+        ConnectionState* state = detail::t_statePool.acquire();
+        attachState(conn, state);
+        if constexpr(Policies::kTls)
+        {
+            if(useSSL_ && !unixConn)
+            {
+                state->ssl = std::make_unique<ssl::SslConnection>(conn, sslCtx_.get());
+                state->ssl->setMessageCallback(std::bind(&BasicHttpServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+                state->ssl->startHandshake();
+            }
+        }
+        HttpContext* context = &state->context;
+        context->setPeerIp(peerIp);
+        context->setAdmitted(admission_ != nullptr);
+        if(capture_)
+        {
+            state->captureId = capture_->openConnection(peerIp);
+        }
+        detail::t_connections[conn.get()] = conn;
+        if(highWaterMark_ > 0)
+        {
+            conn->setHighWaterMarkCallback(std::bind(&BasicHttpServer::onHighWaterMark, this, std::placeholders::_1, std::placeholders::_2), highWaterMark_);
+            conn->setWriteCompleteCallback(std::bind(&BasicHttpServer::onWriteComplete, this, std::placeholders::_1));
+        }
+        ++connectionCount_;
+        // 新连接在header超时内必须发来第一个完整的请求头
+        armTimeout(conn, context, HttpContext::kHeaderRead);
+    }
+    else  // 老用户断开连接
+    {
+        ConnectionState* state = stateOf(conn);
+        if(state)  // 被准入控制拒绝的连接没有上下文
+        {
+            detail::t_connections.erase(conn.get());
+            --connectionCount_;
+            if(detail::t_timingWheel)
+            {
+                detail::t_timingWheel->remove(state->context.timerSlot());
+            }
+            if(state->context.admitted())
+            {
+                admission_->releaseConnection(detail::admissionKey(state->context.peerIp()));
+            }
+            if(capture_)
+            {
+                capture_->closeConnection(state->captureId);
+            }
+            // 之后到达的定时器和写完成回调通过stateOf拿到的是空指针
+            detachState(conn);
+            detail::t_statePool.release(state);
+        }
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::onMessage(const TcpConnectionPtr& conn, Buffer* buf, TimeStamp receiveTime)
+{
+    try
+    {
+        ConnectionState* state = stateOf(conn);
+        if(!state)
+        {
+            buf->retrieveAll();  // 被准入控制拒绝、正在关闭的连接
+            return;
+        }
+        // 这层判断只是代表是否支持ssl，不开启TLS的策略下整段不编译
+        if constexpr(Policies::kTls)
+        {
+            if(useSSL_)
+            {
+                logAt<LogLevel::kInfo>([] { return "onMessage useSSL_ is true"; });
+                // 1. 查找对应的SSL连接
+                ssl::SslConnection* sslConn = state->ssl.get();
+                if(sslConn)
+                {
+                    logAt<LogLevel::kInfo>([] { return "onMessage sslConn is not null"; });
+                    // 2. SSL连接处理数据
+                    sslConn->onRead(conn, buf, receiveTime);
+
+                    // 3. 如果SSL握手还未完成，直接返回
+                    if(!sslConn->isHandshakeCompleted())
+                    {
+                        logAt<LogLevel::kInfo>([] { return "onMessage sslConn is not null"; });
+                        return;
+                    }
+
+                    // 4. 从SSL连接的解密缓冲区获取数据
+                    Buffer* decryptedBuf = sslConn->getDecryptedBuffer();
+                    if(decryptedBuf->readableBytes() == 0)
+                    {
+                        return;  // 没有解密后的数据
+                    }
+
+                    // 5. 使用解密后的数据进行HTTP处理
+                    buf = decryptedBuf;  // 将buf指向解密后的数据
+                    logAt<LogLevel::kInfo>([] { return "onMessage decryptedBuf is not empty"; });
+                }
+            }
+        }
+        detail::CaptureMark captureMark{nullptr, buf};
+        if(capture_)
+        {
+            captureInput(state, buf);
+            captureMark.state = state;
+        }
+        // HttpContext对象用于解析处buf中的请求报文，并把报文的关键信息封装到HttpRequest对象中
+        HttpContext* context = &state->context;
+        if(context->readPaused() || context->waitingFlight())
+        {
+            return;  // 输出积压期间不解析新请求，暂停前已经读到的数据留在缓冲区里
+        }
+
+        if(admission_ && context->state() == HttpContext::kExpectRequestLine)
+        {
+            // 从poll返回到开始处理这条消息之间的时间就是请求的排队延迟
+            admission_->recordQueueDelay((TimeStamp::now().microSecondsSinceEpoch() - receiveTime.microSecondsSinceEpoch()) / 1000.0);
+            if(admission_->shouldShed())
+            {
+                // 过载时在解析和路由之前直接丢弃，请求边界未知，只能关闭连接。
+                // 预先序列化的503是明文，TLS连接上不能直接写到socket，只关闭
+                bool unixConn = conn->localAddress().getSockAddr()->sin_family == AF_UNIX;
+                if(!tls() || unixConn)
+                {
+                    conn->send(admission_->overloadResponse());
+                }
+                buf->retrieveAll();
+                conn->shutdown();
+                return;
+            }
+        }
+
+        // 一次可能收到多个流水线请求，逐个处理，直到数据不够一个完整请求或者输出积压
+        bool requestDone = false;
+        bool timing = metricsEnabled_ || traceConfig_.enabled;
+        while(true)
+        {
+            // 从poll返回到开始处理这个请求之间的排队时间
+            uint64_t queueNanos = 0;
+            uint64_t parseStart = 0;
+            if(timing)
+            {
+                queueNanos = static_cast<uint64_t>(std::max<int64_t>(0, 
+                    TimeStamp::now().microSecondsSinceEpoch() - receiveTime.microSecondsSinceEpoch())) * 1000;
+                parseStart = metrics::nowNanos();
+            }
+            bool parsed = context->parseRequest(buf, receiveTime);  // 解析一个http请求
+            if(timing)
+            {
+                context->addParseNanos(metrics::nowNanos() - parseStart);
+            }
+            if(!parsed)
+            {
+                // 如果解析HTTP报文中出错
+                conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+                conn->shutdown();
+                return;
+            }
+            // 如果buf缓冲区中解析出一个完成的数据包才封装响应报文
+            if(!context->gotAll())
+            {
+                break;
+            }
+
+            beginRequest(context, queueNanos);
+            bool close = onRequest(conn, context->request());
+            context->reset();
+            requestDone = true;
+
+            if(close || context->waitingFlight() || buf->readableBytes() == 0)
+            {
+                break;  // 等待合并的请求返回之前，后面的流水线请求也不能处理，否则响应会乱序
+            }
+            if(highWaterMark_ > 0 && conn->outputBuffer()->readableBytes() >= highWaterMark_)
+            {
+                // 对端读得慢，剩下的请求留在输入缓冲区，等输出缓冲区写完再继续
+                pauseReading(conn, context);
+                break;
+            }
+        }
+
+        // 根据解析进度切换超时阶段
+        HttpContext::TimeoutPhase phase = HttpContext::kKeepAliveIdle;
+        if(context->state() == HttpContext::kExpectBody)
+        {
+            phase = HttpContext::kBodyRead;
+        }
+        else if(context->state() == HttpContext::kExpectHeaders || 
+                (buf->readableBytes() > 0 && !context->readPaused() && !context->waitingFlight()))  // 暂停时缓冲区里的请求在等对端读完响应
+        {
+            phase = HttpContext::kHeaderRead;
+        }
+        // 同一阶段内不刷新，否则客户端每次只发一个字节就能无限延长超时
+        if(requestDone || phase != context->timeoutPhase())
+        {
+            armTimeout(conn, context, phase);
+        }
+    }
+    catch(const std::exception& e)
+    {   
+        // 捕获异常，返回错误信息
+        logger_->ERROR(std::string("Exception in onMessage: ") + e.what());
+        conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+        conn->shutdown();
+    }
+    
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::beginRequest(HttpContext* context, uint64_t queueNanos)
+{
+    HTTP_PROBE3(parse__done, HttpRequest::methodString(context->request().method()), context->request().path().c_str(),
+                context->parseNanos());
+    if(metricsEnabled_)
+    {
+        // 路由要到handleRequest里才确定，先暂存解析和排队耗时
+        detail::t_pendingParseNanos = context->parseNanos();
+        detail::t_pendingQueueNanos = queueNanos;
+    }
+    if(traceConfig_.enabled && 
+       (traceConfig_.triggerHeader.empty() || !context->request().getHeader(traceConfig_.triggerHeader).empty()))
+    {
+        detail::t_trace.reset();
+        detail::t_trace.add(diagnostics::RequestTrace::kParse, context->parseNanos());
+        detail::t_trace.add(diagnostics::RequestTrace::kQueue, queueNanos);
+        context->request().setTrace(&detail::t_trace);
+    }
+    HttpRequest& request = context->request();
+    request.setPeerIp(context->peerIp());
+    if(context->peerIp() != detail::kUnixPeer)
+    {
+        request.setClientIp(context->peerIp());
+    }
+    else if(trustProxyHeaders_)
+    {
+        // 请求自己保存一份，不依赖连接上下文，请求被拷贝后仍然有效
+        std::string_view forwarded;
+        if(detail::forwardedClientIp(request, &forwarded))
+        {
+            request.setClientIp(forwarded);
+        }
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::captureInput(ConnectionState* state, Buffer* buf)
+{
+    // 输出积压或等待合并请求后重新进入时，缓冲区开头是上次留下的、已经抓过的数据
+    size_t seen = std::min(state->capturedBytes, buf->readableBytes());
+    if(buf->readableBytes() > seen)
+    {
+        capture_->data(state->captureId, buf->peek() + seen, buf->readableBytes() - seen);
+    }
+}
+
+template<typename Policies>
+bool BasicHttpServer<Policies>::wantsClose(const HttpRequest& req) const
+{
+    const std::pmr::string& connection = req.getHeader("Connection");
+    bool close = ((connection == "close") || (req.getVersion() == "HTTP/1.0" && connection != "Keep-Alive"));
+    return close || draining_;  // 排空期间每个连接处理完当前请求就关闭
+}
+
+template<typename Policies>
+bool BasicHttpServer<Policies>::onRequest(const TcpConnectionPtr& conn, HttpRequest& req, bool coalesce)
+{
+    bool close = wantsClose(req);
+
+    std::optional<SingleFlight::Flight> flight;
+    if(singleFlight_ && coalesce && !httpCallback_)
+    {
+        std::string flightKey = singleFlight_->keyFor(req);
+        if(!flightKey.empty())
+        {
+            flight.emplace(singleFlight_.get(), std::move(flightKey), [&] {
+                // 只有需要等待时才拷贝请求(已经过before())，响应不能共享时要用它自己执行一次
+                auto copy = std::make_shared<HttpRequest>(req);
+                copy->setTrace(nullptr);
+                std::weak_ptr<TcpConnection> weakConn(conn);
+                EventLoop* loop = conn->getLoop();
+                return SingleFlight::Waiter([this, weakConn, loop, copy, close](const SingleFlight::Result& result) {
+                    loop->runInLoop(std::bind(&BasicHttpServer::onFlightComplete, this, weakConn, copy, close, result));
+                });
+            });
+        }
+    }
+
+    // 卡顿报告中输出的请求和连接，路由编号在路由命中后填上
+    diagnostics::LoopWatchdog::RequestScope watchdogScope(HttpRequest::methodString(req.method()), req.path(),
+                                                          conn->name(), &detail::t_routeId);
+    uint64_t captureId = capture_ ? stateOf(conn)->captureId : 0;
+    close = processRequest(req, close, flight ? &*flight : nullptr, captureId, [&conn](Buffer* buf) { conn->send(buf); });
+    if(flight && flight->waiting())
+    {
+        // 相同的请求正在其他线程上执行，挂起这个连接，不阻塞本线程
+        HttpContext* context = detail::contextOf(conn);
+        context->setWaitingFlight(true);
+        conn->stopRead();
+        return false;
+    }
+    // 如果是短连接的话，返回响应报文后就断开连接
+    if(close)
+    {
+        conn->shutdown();
+    }
+    return close;
+}
+
+template<typename Policies>
+bool BasicHttpServer<Policies>::processRequest(HttpRequest& req, bool close, SingleFlight::Flight* flight, uint64_t captureId,
+                                const std::function<void(Buffer*)>& write)
+{
+    // 响应和处理器里的ArenaJson都分配在请求的内存池上，请求reset()时一起释放
+    HttpResponse response(close, req.resource());
+    memory::ArenaScope arenaScope(req.resource());
+
+    detail::t_routeId = 0;
+    HTTP_PROBE2(request__start, HttpRequest::methodString(req.method()), req.path().c_str());
+    diagnostics::RequestTrace* trace = req.trace();
+    if(trace)
+    {
+        trace->begin();
+    }
+    uint64_t handlerStart = metricsEnabled_ ? metrics::nowNanos() : 0;
+    // 根据请求报文信息来封装响应报文对象
+    if(httpCallback_)
+    {
+        httpCallback_(req, &response);  // 用户接管了整个请求处理
+    }
+    else if(!handleRequest(req, &response, flight))  // 中间件 + 路由
+    {
+        return false;  // 等待合并的请求，响应在onFlightComplete中发送
+    }
+    uint64_t writeStart = metricsEnabled_ ? metrics::nowNanos() : 0;
+    if(flight && flight->leader())
+    {
+        // 带Set-Cookie的响应属于这个客户端，等待者需要各自执行
+        SingleFlight::Result result{response.getStatusCode(), response.getStatusMessage(), nullptr};
+        if(!response.hasHeader("Set-Cookie"))
+        {
+            result.tail = std::make_shared<const std::string>(response.serializeTail());
+        }
+        flight->complete(result);
+    }
+    if(trace)
+    {
+        // 用户自定义的httpCallback_不经过路由，这部分时间记为处理器耗时
+        trace->mark(diagnostics::RequestTrace::kHandler);
+        response.addHeader("Server-Timing", trace->serverTiming());
+    }
+
+    // 可以给response设置一个成员，判断是否请求的是文件，如果是文件设置为true，并且存在文件位置在这里send出去
+    PooledBuffer buf(detail::t_bufferPool);
+    response.appendToBuffer(buf.get());
+    if(trace)
+    {
+        trace->mark(diagnostics::RequestTrace::kSerialize);
+    }
+    // 打印完整的响应内容用于测试
+    logAt<LogLevel::kInfo>([&buf] { return "Sending response:\n" + std::string(buf->peek(), static_cast<int>(buf->readableBytes())); });
+    
+    write(buf.get());
+    HTTP_PROBE1(request__end, static_cast<int>(response.getStatusCode()));
+    if(capture_)
+    {
+        capture_->response(captureId, response.getStatusCode());
+    }
+    if(trace)
+    {
+        trace->mark(diagnostics::RequestTrace::kWrite);
+        if(traceConfig_.logRecord)
+        {
+            logger_->INFO(trace->record(HttpRequest::methodString(req.method()), req.path(), response.getStatusCode()));
+        }
+    }
+
+    if(metricsEnabled_)
+    {
+        metrics::ThreadMetrics& threadMetrics = metrics::MetricsRegistry::local();
+        uint64_t end = metrics::nowNanos();
+        threadMetrics.recordPhase(detail::t_routeId, metrics::kParse, detail::t_pendingParseNanos);
+        threadMetrics.recordPhase(detail::t_routeId, metrics::kQueue, detail::t_pendingQueueNanos);
+        threadMetrics.recordPhase(detail::t_routeId, metrics::kHandler, writeStart - handlerStart);
+        threadMetrics.recordPhase(detail::t_routeId, metrics::kWrite, end - writeStart);
+        threadMetrics.countStatus(response.getStatusCode());
+    }
+    return response.closeConnection();
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::onFlightComplete(const std::weak_ptr<TcpConnection>& weakConn, const std::shared_ptr<HttpRequest>& req,
+                                  bool close, const SingleFlight::Result& result)
+{
+    TcpConnectionPtr conn = weakConn.lock();
+    if(!conn || !conn->connected())
+    {
+        return;
+    }
+    HttpContext* context = detail::contextOf(conn);
+
+    if(result.tail)
+    {
+        HttpResponse response(close);
+        response.setStatusLine(req->getVersion(), result.statusCode, result.statusMessage);
+        response.setSerializedTail(result.tail);
+        PooledBuffer buf(detail::t_bufferPool);
+        response.appendToBuffer(buf.get());
+        conn->send(buf.get());
+        if(capture_)
+        {
+            capture_->response(stateOf(conn)->captureId, result.statusCode);
+        }
+        if(metricsEnabled_)
+        {
+            metrics::MetricsRegistry::local().countStatus(result.statusCode);
+        }
+        if(close)
+        {
+            conn->shutdown();
+        }
+    }
+    else
+    {
+        close = onRequest(conn, *req, false);  // 重新经过完整的处理链，before()的线程局部状态不会跨越挂起
+    }
+
+    context->setWaitingFlight(false);
+    if(!close && !context->readPaused())
+    {
+        conn->startRead();
+        if(conn->inputBuffer()->readableBytes() > 0)
+        {
+            // 继续处理挂起期间留在缓冲区里的请求；缓冲区为空时不进入onMessage，否则会被计入排队延迟和过载判断
+            onMessage(conn, conn->inputBuffer(), TimeStamp::now());
+        }
+        else
+        {
+            armTimeout(conn, context, HttpContext::kKeepAliveIdle);  // 空闲从响应发出时算起
+        }
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::startUring()
+{
+    if(tls() || reusePortServer_ || !upgradePath_.empty() || unixServer_)
+    {
+        logger_->ERROR("io_uring transport does not support SSL, reuse-port, hot upgrade or unix listener");
+        abort();
+    }
+    if(admission_ || singleFlight_)
+    {
+        logger_->WARN("io_uring transport ignores overload control and single-flight");
+    }
+
+    // 使用server_在构造时bind好的socket，server_本身不启动
+    if(listenFd_ < 0)
+    {
+        logger_->ERROR("Failed to locate listen socket for io_uring transport");
+        abort();
+    }
+    socketTuning_.applyToListener(listenFd_);
+    if(::listen(listenFd_, SOMAXCONN) < 0)
+    {
+        logger_->ERROR("Failed to listen for io_uring transport");
+        abort();
+    }
+
+    uringServer_ = std::make_unique<net::UringServer>(listenFd_, numThreads_, uringConfig_);
+    uringServer_->setConnectionCallback(std::bind(&BasicHttpServer::onUringConnection, this, std::placeholders::_1, std::placeholders::_2));
+    uringServer_->setMessageCallback(std::bind(&BasicHttpServer::onUringMessage, this, 
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    uringServer_->setTimeoutCallback(std::bind(&BasicHttpServer::onUringTimeout, this, std::placeholders::_1, std::placeholders::_2));
+    logger_->WARN("HttpServer[" + server_.name() + "] starts listening on" + server_.isPort() + " with io_uring");
+    uringServer_->start();
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::onUringConnection(net::UringConnection* conn, bool connected)
+{
+    if(connected)
+    {
+        // 和epoll传输一样从本线程的池中取连接状态，HttpContext持有内存池，不能拷贝进boost::any
+        ConnectionState* state = detail::t_statePool.acquire();
+        state->context.setPeerIp(conn->peerIp());
+        if(capture_)
+        {
+            state->captureId = capture_->openConnection(conn->peerIp());
+        }
+        conn->setContext(state);
+        ++connectionCount_;
+        armUringTimeout(conn, &state->context, HttpContext::kHeaderRead);
+    }
+    else
+    {
+        ConnectionState* state = boost::any_cast<ConnectionState*>(*conn->getMutableContext());
+        conn->setContext(boost::any());
+        if(capture_)
+        {
+            capture_->closeConnection(state->captureId);
+        }
+        detail::t_statePool.release(state);
+        --connectionCount_;
+    }
+}
+
+template<typename Policies>
+bool BasicHttpServer<Policies>::onUringMessage(net::UringConnection* conn, Buffer* in, Buffer* out)
+{
+    // 与onMessage中的流水线处理相同，响应追加到out中由UringServer发送
+    ConnectionState* state = boost::any_cast<ConnectionState*>(*conn->getMutableContext());
+    HttpContext* context = &state->context;
+    detail::CaptureMark captureMark{nullptr, in};
+    if(capture_)
+    {
+        captureInput(state, in);
+        captureMark.state = state;
+    }
+    try
+    {
+        bool timing = metricsEnabled_ || traceConfig_.enabled;
+        bool requestDone = false;
+        bool backlogged = false;
+        while(in->readableBytes() > 0)
+        {
+            if(highWaterMark_ > 0 && out->readableBytes() >= highWaterMark_)
+            {
+                backlogged = true;
+                break;  // 对端读得慢，剩下的请求等这些响应发出去之后再处理
+            }
+
+            uint64_t parseStart = timing ? metrics::nowNanos() : 0;
+            bool parsed = context->parseRequest(in, TimeStamp::now());
+            if(timing)
+            {
+                context->addParseNanos(metrics::nowNanos() - parseStart);
+            }
+            if(!parsed)
+            {
+                out->append("HTTP/1.1 400 Bad Request\r\n\r\n");
+                return false;
+            }
+            if(!context->gotAll())
+            {
+                break;
+            }
+
+            beginRequest(context, 0);  // 完成事件直接在本线程处理，没有单独的排队阶段
+            HttpRequest& req = context->request();
+            bool close = processRequest(req, wantsClose(req), nullptr, state->captureId, [out](Buffer* buf) {
+                out->append(buf->peek(), buf->readableBytes());
+            });
+            context->reset();
+            requestDone = true;
+            if(close)
+            {
+                return false;
+            }
+        }
+
+        // 与onMessage相同的超时阶段切换，积压时留在缓冲区里的请求在等对端读完响应
+        HttpContext::TimeoutPhase phase = HttpContext::kKeepAliveIdle;
+        if(context->state() == HttpContext::kExpectBody)
+        {
+            phase = HttpContext::kBodyRead;
+        }
+        else if(context->state() == HttpContext::kExpectHeaders || (in->readableBytes() > 0 && !backlogged))
+        {
+            phase = HttpContext::kHeaderRead;
+        }
+        if(requestDone || phase != context->timeoutPhase())
+        {
+            armUringTimeout(conn, context, phase);
+        }
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        logger_->ERROR(std::string("Exception in onUringMessage: ") + e.what());
+        out->append("HTTP/1.1 400 Bad Request\r\n\r\n");
+        return false;
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::armUringTimeout(net::UringConnection* conn, HttpContext* context, HttpContext::TimeoutPhase phase)
+{
+    context->enterTimeoutPhase(phase);
+    uringServer_->setTimeout(conn, timeoutOf(phase));
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::onUringTimeout(net::UringConnection* conn, Buffer* out)
+{
+    // UringServer在回调返回后关闭连接
+    ConnectionState* state = boost::any_cast<ConnectionState*>(*conn->getMutableContext());
+    if(state->context.timeoutPhase() == HttpContext::kKeepAliveIdle)
+    {
+        logAt<LogLevel::kDebug>([conn] { return "Close idle keep-alive connection from " + conn->peerIp(); });
+    }
+    else
+    {
+        logAt<LogLevel::kInfo>([conn] { return "Request read timeout, close connection from " + conn->peerIp(); });
+        out->append(detail::kRequestTimeoutResponse);
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::enableSingleFlight(const SingleFlightConfig& config)
+{
+    singleFlight_ = std::make_unique<SingleFlight>(config);
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::pauseReading(const TcpConnectionPtr& conn, HttpContext* context)
+{
+    if(!context->readPaused())
+    {
+        context->setReadPaused(true);
+        conn->stopRead();
+        logAt<LogLevel::kDebug>([&conn] { return "Output backlog on " + conn->name() + ", stop reading"; });
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::onHighWaterMark(const TcpConnectionPtr& conn, size_t bytes)
+{
+    HttpContext* context = detail::contextOf(conn);
+    if(context)
+    {
+        pauseReading(conn, context);
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::onWriteComplete(const TcpConnectionPtr& conn)
+{
+    HttpContext* context = detail::contextOf(conn);
+    if(!context || !context->readPaused())
+    {
+        return;
+    }
+    // 输出缓冲区已经写空，恢复读取，并继续处理暂停时留在缓冲区里的流水线请求
+    context->setReadPaused(false);
+    if(context->waitingFlight())
+    {
+        return;  // 还在等待合并的请求，由onFlightComplete恢复
+    }
+    conn->startRead();
+    onMessage(conn, conn->inputBuffer(), TimeStamp::now());
+}
+
+template<typename Policies>
+int BasicHttpServer<Policies>::timeoutOf(HttpContext::TimeoutPhase phase) const
+{
+    if(phase == HttpContext::kHeaderRead)
+    {
+        return timeoutConfig_.headerTimeout;
+    }
+    if(phase == HttpContext::kBodyRead)
+    {
+        return timeoutConfig_.bodyTimeout;
+    }
+    return timeoutConfig_.keepAliveTimeout;
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::armTimeout(const TcpConnectionPtr& conn, HttpContext* context, HttpContext::TimeoutPhase phase)
+{
+    uint64_t generation = context->enterTimeoutPhase(phase);
+    int seconds = timeoutOf(phase);
+    if(detail::t_timingWheel)
+    {
+        if(seconds > 0)
+        {
+            detail::t_timingWheel->add(conn, generation, seconds, context->timerSlot());
+        }
+        else
+        {
+            detail::t_timingWheel->remove(context->timerSlot());  // 这个阶段不限时
+        }
+    }
+}
+
+template<typename Policies>
+void BasicHttpServer<Policies>::onTimeout(const TcpConnectionPtr& conn, uint64_t generation)
+{
+    HttpContext* context = detail::contextOf(conn);
+    if(!context || !conn->connected() || context->timeoutGeneration() != generation)
+    {
+        return;  // 连接已经进入了新的超时阶段，这是一个过期的条目
+    }
+
+    if(context->timeoutPhase() == HttpContext::kKeepAliveIdle)
+    {
+        logAt<LogLevel::kDebug>([&conn] { return "Close idle keep-alive connection " + conn->name(); });
+    }
+    else
+    {
+        logAt<LogLevel::kInfo>([&conn] { return "Request read timeout, close connection " + conn->name(); });
+        if(!tls())
+        {
+            conn->send(detail::kRequestTimeoutResponse);  // 输出缓冲区为空时会直接写到socket
+        }
+    }
+    // shutdown只关闭写端，不回应的客户端仍然会占着fd，这里直接关闭
+    conn->forceClose();
+}
+
+// 执行请求对应的路由处理函数
+template<typename Policies>
+bool BasicHttpServer<Policies>::handleRequest(HttpRequest& req, HttpResponse* resp, SingleFlight::Flight* flight)
+{
+    try
+    {
+        // 处理请求的中间件，请求是HttpContext里解析出来的那一份，中间件和路由都直接在上面修改
+        diagnostics::RequestTrace* trace = req.trace();
+        if constexpr(Policies::kMiddleware)
+        {
+            middlewareChain_.processBefore(req);
+            if(trace)
+            {
+                trace->mark(diagnostics::RequestTrace::kMiddleware);
+            }
+        }
+
+        // 中间件放行之后才合并，等待者也经过了鉴权和限流
+        if(flight && !flight->join())
+        {
+            return false;
+        }
+
+        // 路由处理
+        if(!router_.route(req, resp, &detail::t_routeId))
+        {
+            logAt<LogLevel::kInfo>([&req] { return "请求的啥，url: " + std::string(HttpRequest::methodString(req.method())) + " " + req.path(); });
+            logAt<LogLevel::kInfo>([] { return "未找到路径，返回404"; });
+            resp->setStatusCode(HttpResponse::k404NotFound);
+            resp->setStatusMessage("Not Found");
+            resp->setCloseConnection(true);
+        }
+        // 处理响应后的中间件
+        if constexpr(Policies::kMiddleware)
+        {
+            middlewareChain_.processAfter(*resp);
+            if(trace)
+            {
+                trace->mark(diagnostics::RequestTrace::kMiddleware);
+            }
+        }
+    }
+    catch(const HttpResponse& res)
+    {
+        // 处理中间件抛出的响应(如CORS预检请求、缓存命中)
+        // 中间件可以要求关闭连接，但不能让请求要求关闭的连接保持
+        bool close = resp->closeConnection() || res.closeConnection();
+        *resp = res;
+        resp->setCloseConnection(close);
+    }
+    catch(const std::exception& e)
+    {
+        // 错误处理
+        resp->setStatusCode(HttpResponse::k500InternalServerError);
+        resp->setBody(e.what());
+    }
+    return true;
+}
+
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SERVERPOLICIES_H
+#define SERVERPOLICIES_H
+
+namespace http
+{
+
+enum class LogLevel
+{
+    kDebug,
+    kInfo,
+    kWarn,
+    kError,
+};
+
+/*
+    BasicHttpServer的编译期策略：
+    - Tls: 关闭时不包含SSL上下文和握手、解密路径，构造时传入useSSL为true会直接退出
+    - Middleware: 关闭时没有中间件链，请求直接进入路由，addMiddleware/enableResponseCache不可用
+    - Sessions: 关闭时没有会话管理器，setSeesionManager/getSessionManager不可用
+    - MinLogLevel: 低于这个级别的日志连同消息字符串的拼接在编译期去掉
+*/
+template<bool Tls, bool Middleware, bool Sessions, LogLevel MinLogLevel>
+struct ServerPolicies
+{
+    static constexpr bool kTls = Tls;
+    static constexpr bool kMiddleware = Middleware;
+    static constexpr bool kSessions = Sessions;
+    static constexpr LogLevel kLogLevel = MinLogLevel;
+
+    static constexpr bool logs(LogLevel level) { return level >= kLogLevel; }
+};
+
+// 全部功能，即HttpServer
+using DefaultPolicies = ServerPolicies<true, true, true, LogLevel::kDebug>;
+// 只有路由的纯HTTP服务，热路径上只保留WARN及以上的日志
+using PlainPolicies = ServerPolicies<false, false, false, LogLevel::kWarn>;
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef SINGLEFLIGHT_H
+#define SINGLEFLIGHT_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mymuduo/noncopyable.h"
+
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+namespace http
+{
+
+struct SingleFlightConfig
+{
+    std::vector<std::string> paths;        // 参与合并的GET路径(精确匹配)
+    std::vector<std::string> varyHeaders;  // 参与合并键的请求头
+};
+
+/*
+    请求合并：同一时刻多个线程上到达的相同请求只执行一次处理器，其余请求等待并共享序列化好的响应
+
+    第一个到达的请求成为leader，正常执行；之后到达的相同请求登记一个waiter后立即返回，
+    不阻塞所在的I/O线程。leader完成后在自己的线程上调用所有waiter，waiter自己负责切回所属的线程
+
+    合并发生在中间件的before()之后、路由之前：每个请求都各自经过鉴权、限流和缓存查找，
+    只有处理器和after()由leader执行一次
+*/
+class SingleFlight: noncopyable
+{
+public:
+    struct Result
+    {
+        HttpResponse::HttpStatusCode statusCode;
+        std::string statusMessage;
+        std::shared_ptr<const std::string> tail;  // 为空表示响应不能共享(如带Set-Cookie)，waiter需要自己处理
+    };
+    using Waiter = std::function<void(const Result&)>;
+
+    /*
+        一个可以合并的请求，join()成为leader后必须complete()。leader的处理被异常打断
+        (包括不是std::exception的异常)时，析构函数以500唤醒等待者，否则它们会一直挂起
+    */
+    class Flight: noncopyable
+    {
+    public:
+        Flight(SingleFlight* owner, std::string key, std::function<Waiter()> makeWaiter);
+        ~Flight();
+
+        // 返回true表示成为leader
+        bool join();
+        bool leader() const { return state_ == kLeader; }
+        bool waiting() const { return state_ == kWaiting; }
+        void complete(const Result& result);
+
+    private:
+        enum State
+        {
+            kIdle,
+            kLeader,
+            kWaiting,
+            kDone,
+        };
+
+        SingleFlight* owner_;
+        std::string key_;
+        std::function<Waiter()> makeWaiter_;
+        State state_;
+    };
+
+    explicit SingleFlight(const SingleFlightConfig& config);
+
+    // 合并键，请求不参与合并时返回空串
+    std::string keyFor(const HttpRequest& req) const;
+
+    // 返回true表示调用者是leader；否则调用makeWaiter(在锁内，只在需要时才构造)登记等待
+    bool join(const std::string& key, const std::function<Waiter()>& makeWaiter);
+
+    // leader完成，唤醒所有waiter
+    void complete(const std::string& key, const Result& result);
+
+private:
+    SingleFlightConfig config_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<Waiter>> flights_;  // 进行中的请求 -> 等待者
+};
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "mymuduo/EventLoop.h"
+#include "mymuduo/TcpConnection.h"
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+// 连接超时配置(秒), 0表示不限制
+struct TimeoutConfig
+{
+    int headerTimeout = 10;     // 从连接建立/新请求的第一个字节起，到请求头读完的时间
+    int bodyTimeout = 30;       // 读完请求头之后，到请求体读完的时间
+    int keepAliveTimeout = 60;  // 两个请求之间连接空闲的时间
+};
+
+/*
+    每个EventLoop一个的哈希时间轮，精度1秒
+
+      current_
+         |
+         v
+    +----+----+----+----+----+----+
+    | b0 | b1 | b2 | b3 | .. | bn |   每秒current_前进一格，处理该格中的所有条目
+    +----+----+----+----+----+----+
+
+    每个连接在时间轮中最多只有一个条目，它在桶中的位置记录在连接自己的Slot里。
+    add()把这个条目从原来的桶中摘下，挂到 current_ + seconds 那一格(链表splice，O(1)且不分配内存)，
+    因此时间轮的大小等于连接数，与请求速率和超时长短无关，也不需要为每个连接创建定时器。
+    条目同时记录连接进入超时阶段时的代数，到期回调据此判断连接是否已经进入了新的阶段
+*/
+class TimingWheel: noncopyable
+{
+public:
+    using ExpireCallback = std::function<void(const TcpConnectionPtr&, uint64_t generation)>;
+
+    struct Slot;
+    struct Entry
+    {
+        std::weak_ptr<TcpConnection> conn;
+        uint64_t generation;
+        Slot* slot;  // 所属连接的位置记录，条目到期删除时置为未挂入
+    };
+    using Bucket = std::list<Entry>;
+
+    // 连接的条目在哪个桶、哪个位置，由连接的上下文持有，地址在连接存续期间不能变
+    struct Slot
+    {
+        size_t bucket = 0;
+        Bucket::iterator entry;
+        bool linked = false;
+    };
+
+    TimingWheel(EventLoop* loop, int maxTimeout, const ExpireCallback& cb);
+
+    // 在loop上注册每秒一次的tick
+    void start();
+
+    // seconds秒后检查该连接，连接已经在时间轮中时改为新的时间和代数。必须在loop线程调用
+    void add(const TcpConnectionPtr& conn, uint64_t generation, int seconds, Slot* slot);
+    // 连接断开时删除它的条目，之后slot可以给别的连接复用
+    void remove(Slot* slot);
+
+    size_t size() const { return size_; }
+
+private:
+    void onTick();
+
+    EventLoop* loop_;
+    std::shared_ptr<bool> alive_;  // tick定时器持有它的weak_ptr，时间轮析构后定时器不再访问这个对象
+    std::vector<Bucket> buckets_;
+    size_t current_;
+    size_t size_;  // 时间轮中的条目总数
+    ExpireCallback expireCallback_;
+};
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+namespace memory
+{
+
+// 所有线程合并后一类对象的存活个数和字节数
+struct MemoryUsage
+{
+    std::string name;
+    int64_t objects = 0;
+    int64_t bytes = 0;
+};
+
+/*
+    一类对象的内存记账，定义为命名空间作用域的静态对象，构造时登记。
+    每个线程一份计数，只有本线程写，对象在别的线程释放时那个线程的计数为负，合并后仍然正确。
+    字节数是对象本身加上它直接持有的堆内存的估计，不包括分配器的开销和OpenSSL等库内部的内存，
+    整体的内存占用以benchmark/IdleConnBench.cc测得的RSS为准
+*/
+class MemoryAccount: noncopyable
+{
+public:
+    static const int kMaxAccounts = 32;
+
+    explicit MemoryAccount(const char* name);
+
+    void add(int64_t objects, int64_t bytes);
+    const char* name() const { return name_; }
+
+    // 合并所有线程的计数，按登记顺序排列
+    static std::vector<MemoryUsage> usage();
+
+private:
+    const char* name_;
+    int index_;
+};
+
+/*
+    放在被统计的对象里作为成员，构造、拷贝和析构时自动增减，对象持有的堆内存变化后调用setBytes
+    赋值时两边各自的记账不变
+*/
+class MemoryTracker
+{
+public:
+    MemoryTracker(MemoryAccount& account, size_t bytes):
+        account_(&account),
+        bytes_(bytes)
+    {
+        account_->add(1, static_cast<int64_t>(bytes_));
+    }
+
+    MemoryTracker(const MemoryTracker& other):
+        MemoryTracker(*other.account_, other.bytes_)
+    {
+    }
+
+    MemoryTracker& operator=(const MemoryTracker&) { return *this; }
+
+    ~MemoryTracker() { account_->add(-1, -static_cast<int64_t>(bytes_)); }
+
+    void setBytes(size_t bytes)
+    {
+        if(bytes != bytes_)
+        {
+            account_->add(0, static_cast<int64_t>(bytes) - static_cast<int64_t>(bytes_));
+            bytes_ = bytes;
+        }
+    }
+    size_t bytes() const { return bytes_; }
+
+private:
+    MemoryAccount* account_;
+    size_t bytes_;
+};
+
+// 字符串在对象之外占用的堆内存，短字符串存放在对象内部时为0
+inline size_t heapBytes(const std::string& s)
+{
+    return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+}
+
+// 进程的常驻内存(RSS)字节数，读取失败时返回0
+size_t residentBytes();
+// malloc正在使用的堆内存字节数，不支持时返回0
+size_t heapInUseBytes();
+
+}
+
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef REQUESTARENA_H
+#define REQUESTARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+namespace memory
+{
+
+// 所有线程合并后的请求内存池统计
+struct ArenaStats
+{
+    uint64_t requests = 0;             // 使用过内存池的请求数
+    uint64_t allocations = 0;          // 请求期间从内存池分配的次数
+    uint64_t bytes = 0;                // 请求期间从内存池分配的字节数
+    uint64_t upstreamAllocations = 0;  // 块用完后向全局分配器申请的次数
+};
+
+/*
+    单个请求的内存池：开始解析请求时从本线程的块缓存取一块，请求行、头部、参数、请求体、
+    响应头和响应体都在块上顺序分配，释放是空操作；请求结束时end()把整块还给缓存，不再逐个释放。
+    块用完时才向全局分配器申请，这部分同样在end()时一起释放。
+    只在所属连接的I/O线程上使用
+*/
+class RequestArena: public std::pmr::memory_resource, noncopyable
+{
+public:
+    static constexpr size_t kSlabSize = 16 * 1024;
+
+    RequestArena();
+    ~RequestArena();
+
+    // 开始一个请求，已经开始时什么也不做
+    void begin();
+    // 结束请求，调用前必须销毁所有从内存池分配的对象
+    void end();
+    bool active() const { return resource_.has_value(); }
+
+    // 合并所有线程的统计
+    static ArenaStats stats();
+
+private:
+    // 块用完后的上游，统计向全局分配器申请的次数
+    class Upstream: public std::pmr::memory_resource
+    {
+    public:
+        uint64_t allocations = 0;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    void* slab_;
+    Upstream upstream_;
+    std::optional<std::pmr::monotonic_buffer_resource> resource_;
+    uint64_t allocations_;
+    uint64_t bytes_;
+};
+
+// 当前线程正在处理的请求所用的内存池，不在请求处理期间时为全局分配器
+std::pmr::memory_resource* currentResource();
+
+// 作用域内把resource设为当前线程的请求内存池，供ArenaAllocator使用
+class ArenaScope: noncopyable
+{
+public:
+    explicit ArenaScope(std::pmr::memory_resource* resource);
+    ~ArenaScope();
+
+private:
+    std::pmr::memory_resource* previous_;
+};
+
+// 从currentResource()分配，在块前记录来源，释放时还给原来的memory_resource
+void* allocateTagged(size_t bytes);
+void deallocateTagged(void* p, size_t bytes) noexcept;
+
+/*
+    无状态的分配器，给nlohmann::json这类自己默认构造分配器的容器使用，分配落在当前请求的内存池上。
+    每块记录了自己的来源，在ArenaScope之外释放也不会出错，但对象不能活过所在请求的end()
+*/
+template<typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    ArenaAllocator() noexcept = default;
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+        return static_cast<T*>(allocateTagged(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) noexcept { deallocateTagged(p, n * sizeof(T)); }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>&) const noexcept { return false; }
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace http
+{
+
+namespace metrics
+{
+
+/*
+    HDR风格的对数-线性直方图，记录纳秒级的耗时
+
+    小于8的值每个值一个桶；之后每个2的幂区间[2^m, 2^(m+1))再均分成8个子桶，
+    相对误差不超过1/8，最大记录到2^40纳秒(约18分钟)，共304个桶
+
+    只允许一个线程写(所在线程的分片)，其他线程可以随时读。
+    写入用relaxed的load + store而不是原子加，热路径上只是几条普通的内存指令
+*/
+class Histogram
+{
+public:
+    static const int kSubBucketBits = 3;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kMaxMagnitude = 39;
+    static const int kNumBuckets = kSubBuckets + (kMaxMagnitude - kSubBucketBits + 1) * kSubBuckets;
+
+    Histogram();
+
+    void record(uint64_t value)
+    {
+        bump(buckets_[bucketIndex(value)], 1);
+        bump(count_, 1);
+        bump(sum_, value);
+    }
+
+    static int bucketIndex(uint64_t value);
+    // 桶内的最大值
+    static uint64_t bucketUpperBound(int index);
+
+    friend class HistogramSnapshot;
+
+private:
+    static void bump(std::atomic<uint64_t>& counter, uint64_t delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> buckets_[kNumBuckets];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+};
+
+// 合并后的直方图，用于计算分位数和导出
+class HistogramSnapshot
+{
+public:
+    HistogramSnapshot();
+
+    void merge(const Histogram& histogram);
+    void merge(const HistogramSnapshot& other);
+
+    uint64_t count() const { return count_; }
+    uint64_t sum() const { return sum_; }
+    // 小于等于value的样本数(按桶上界近似)
+    uint64_t countAtOrBelow(uint64_t value) const;
+    uint64_t quantile(double q) const;
+
+private:
+    std::vector<uint64_t> buckets_;
+    uint64_t count_;
+    uint64_t sum_;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Histogram.h"
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+namespace metrics
+{
+
+// 一个请求在服务器内经历的阶段
+enum Phase
+{
+    kParse,    // 解析请求报文
+    kQueue,    // 从poll返回到开始处理
+    kHandler,  // 中间件 + 路由 + 处理器
+    kWrite,    // 序列化响应并写入连接
+    kNumPhases
+};
+
+// 单调时钟的纳秒数，用于计算各阶段耗时
+inline uint64_t nowNanos()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/*
+    每个线程一个分片，只有所属线程写，采集时由MetricsRegistry合并所有分片。
+    分片中路由和计时器的直方图在第一次使用时创建，用原子指针发布，读者无需加锁
+*/
+class ThreadMetrics: noncopyable
+{
+public:
+    static const int kMaxRoutes = 256;   // 超出的路由计入0号(未匹配)
+    static const int kMaxTimers = 32;
+    static const int kMaxStatus = 600;
+
+    ThreadMetrics();
+    ~ThreadMetrics();
+
+    void recordPhase(int routeId, Phase phase, uint64_t nanos);
+    void countStatus(int code);
+    void recordTimer(int timerId, uint64_t nanos);
+
+    friend class MetricsRegistry;
+
+private:
+    struct RouteMetrics
+    {
+        Histogram phases[kNumPhases];
+    };
+
+    RouteMetrics* routeMetrics(int routeId);
+    Histogram* timer(int timerId);
+
+    std::atomic<RouteMetrics*> routes_[kMaxRoutes];
+    std::atomic<Histogram*> timers_[kMaxTimers];
+    std::atomic<uint64_t> statusCounts_[kMaxStatus];
+};
+
+/*
+    指标注册表：路由和计时器在启动阶段注册拿到编号，热路径上只按编号写本线程的分片。
+    /metrics采集时把所有分片合并，输出Prometheus文本格式
+*/
+class MetricsRegistry: noncopyable
+{
+public:
+    static MetricsRegistry& instance();
+
+    // 当前线程的分片，第一次调用时创建
+    static ThreadMetrics& local();
+
+    // 注册路由，返回路由编号，重复注册返回同一个编号
+    int routeId(const std::string& method, const std::string& path);
+    // 注册一个命名的耗时直方图(如数据库连接池等待时间)，返回编号
+    int timerId(const std::string& name, const std::string& help);
+    // 路由编号对应的"方法 路径"，用于诊断输出
+    std::string routeName(int routeId) const;
+
+    // 合并所有线程的数据，输出Prometheus文本格式
+    std::string scrape() const;
+
+private:
+    MetricsRegistry();
+
+    ThreadMetrics* createShard();
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadMetrics>> shards_;
+    std::vector<std::pair<std::string, std::string>> routes_;  // 编号 -> (方法, 路径)
+    std::map<std::pair<std::string, std::string>, int> routeIds_;
+    std::vector<std::pair<std::string, std::string>> timers_;  // 编号 -> (名字, 说明)
+};
+
+// 作用域计时，析构时记录到当前线程分片的计时器中
+class ScopedTimer: noncopyable
+{
+public:
+    explicit ScopedTimer(int timerId):
+        timerId_(timerId),
+        start_(nowNanos())
+    {
+
+    }
+
+    ~ScopedTimer() { MetricsRegistry::local().recordTimer(timerId_, nowNanos() - start_); }
+
+private:
+    int timerId_;
+    uint64_t start_;
+};
+
+}
+
+}
+
+#endif
@@ -15,6 +15,8 @@ class MiddlewareChain
 {
 public:
     void addMiddleware(std::shared_ptr<Middleware> middleware);
+    // 加到链首：before最先执行，after最后执行
+    void addMiddlewareFront(std::shared_ptr<Middleware> middleware);
     void processBefore(HttpRequest& request);
     void processAfter(HttpResponse& response);
 
@@ -0,0 +1,36 @@
+#ifndef CACHECONFIG_H
+#define CACHECONFIG_H
+
+#include <string>
+#include <vector>
+
+namespace http
+{
+
+namespace middleware
+{
+
+// 一个可缓存的GET路由
+struct CacheRule
+{
+    std::string path;   // 精确匹配的请求路径
+    int ttlMs = 1000;   // 新鲜期，期间直接返回缓存
+    int staleMs = 5000; // 过期后仍可返回旧响应的时长，同时在后台重新生成
+    std::vector<std::string> varyHeaders;  // 参与缓存键的请求头(如Accept-Encoding)
+};
+
+/*
+    响应缓存配置，每个I/O线程一个分片，maxBytesPerThread是单个分片的内存上限，
+    超出后按LRU淘汰
+*/
+struct CacheConfig
+{
+    std::vector<CacheRule> rules;
+    size_t maxBytesPerThread = 8 * 1024 * 1024;
+};
+
+}
+
+}
+
+#endif
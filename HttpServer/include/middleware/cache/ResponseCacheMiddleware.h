@@ -0,0 +1,94 @@
+#ifndef RESPONSECACHEMIDDLEWARE_H
+#define RESPONSECACHEMIDDLEWARE_H
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "../Middleware.h"
+#include "../../http/HttpRequest.h"
+#include "../../http/HttpResponse.h"
+#include "CacheConfig.h"
+
+namespace http
+{
+
+namespace middleware
+{
+
+/*
+    GET响应的微缓存：before中按(路径, 查询串, vary请求头)查找，命中时像CORS预检一样抛出响应直接返回，
+    未命中时记下缓存键，在after中保存序列化好的响应尾部
+
+    - 每个线程一个分片，查找和保存都不加锁
+    - 只缓存200且没有Set-Cookie的响应
+    - 过期但仍在staleMs内时先返回旧响应，再通过revalidator在后台重新执行一次请求刷新缓存
+    - 需要放在中间件链的最前面(HttpServer::enableResponseCache会这样做)，
+      这样after最后执行，保存的是其他中间件都处理过的响应
+*/
+class ResponseCacheMiddleware: public Middleware
+{
+public:
+    // 在稍后(当前请求处理完之后)的同一线程上重新执行req
+    using Revalidator = std::function<void(const HttpRequest& req)>;
+
+    explicit ResponseCacheMiddleware(const CacheConfig& config);
+
+    virtual void before(HttpRequest& request) override;
+    virtual void after(HttpResponse& response) override;
+
+    void setRevalidator(const Revalidator& revalidator) { revalidator_ = revalidator; }
+
+    // 作用域内的请求是后台刷新，before不返回缓存；无论刷新结果如何，离开作用域时条目都可以再次触发刷新
+    class RevalidationScope
+    {
+    public:
+        RevalidationScope();
+        ~RevalidationScope();
+    };
+
+private:
+    struct Entry
+    {
+        std::string key;
+        HttpResponse::HttpStatusCode statusCode;
+        std::string statusMessage;
+        std::shared_ptr<const std::string> tail;
+        int64_t expiresAt;   // 微秒
+        int64_t staleUntil;  // 微秒
+        bool revalidating;
+        size_t bytes;
+    };
+
+    struct Shard
+    {
+        std::list<Entry> lru;  // 表头是最近使用的
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+
+        ~Shard();
+    };
+
+    Shard* localShard();
+    std::string makeKey(const HttpRequest& request, const CacheRule& rule) const;
+    void store(Shard* shard, std::string key, const CacheRule& rule, const HttpResponse& response);
+    void evict(Shard* shard, std::list<Entry>::iterator it);
+    // 后台刷新结束(没有保存新响应时也是)，清除条目的revalidating
+    void endRevalidation(const std::string& key);
+
+    CacheConfig config_;
+    std::unordered_map<std::string, CacheRule> rules_;  // 路径 -> 规则
+    Revalidator revalidator_;
+    std::mutex shardsMutex_;
+    std::unordered_map<std::thread::id, std::unique_ptr<Shard>> shards_;
+};
+
+}
+
+}
+
+#endif
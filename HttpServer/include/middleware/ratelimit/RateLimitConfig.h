@@ -0,0 +1,44 @@
+#ifndef RATELIMITCONFIG_H
+#define RATELIMITCONFIG_H
+
+#include <string>
+#include <vector>
+
+namespace http
+{
+
+namespace middleware
+{
+
+// 令牌桶按什么区分
+enum class RateLimitKey
+{
+    kIp,       // 客户端IP(HttpRequest::clientIp)，取不到客户端IP的请求不受该规则限制
+    kSession,  // 会话(sessionId cookie)，没有会话或会话无效(见RateLimitMiddleware::setSessionValidator)的请求退化为按IP
+    kRoute,    // 整条路由共用一个桶
+};
+
+struct RateLimitRule
+{
+    std::string path;              // 精确匹配的请求路径，为空表示所有路径
+    RateLimitKey key = RateLimitKey::kIp;
+    double ratePerSecond = 10;     // 令牌补充速度
+    double burst = 20;             // 桶容量
+};
+
+/*
+    每个I/O线程独立计数(不加锁)，同一个客户端的连接分布在N个线程上时，
+    实际允许的速率最多是配置的N倍。空闲超过idleSeconds的桶在后续请求中顺带回收
+*/
+struct RateLimitConfig
+{
+    std::vector<RateLimitRule> rules;
+    int idleSeconds = 60;
+    int retryAfterSeconds = 1;
+};
+
+}
+
+}
+
+#endif
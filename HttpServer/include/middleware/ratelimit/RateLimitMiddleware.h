@@ -0,0 +1,82 @@
+#ifndef RATELIMITMIDDLEWARE_H
+#define RATELIMITMIDDLEWARE_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "../Middleware.h"
+#include "../../http/HttpRequest.h"
+#include "../../http/HttpResponse.h"
+#include "RateLimitConfig.h"
+
+namespace http
+{
+
+namespace middleware
+{
+
+/*
+    令牌桶限流中间件：before中先确认匹配的每条规则都有令牌，再对每条规则各扣一个；
+    任一规则没有令牌时不创建也不扣除任何桶，抛出预先序列化好的429响应(带Retry-After)，请求不会进入路由
+*/
+class RateLimitMiddleware: public Middleware
+{
+public:
+    explicit RateLimitMiddleware(const RateLimitConfig& config);
+
+    virtual void before(HttpRequest& request) override;
+    virtual void after(HttpResponse& response) override {}
+
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+
+    /*
+        按会话限流时用来确认cookie中的sessionId是服务端发出的、仍然有效的会话，在I/O线程中调用。
+        没有设置时kSession规则一律按IP：客户端每次换一个随机的sessionId就能拿到新的桶
+    */
+    using SessionValidator = std::function<bool(const std::string& sessionId)>;
+    void setSessionValidator(const SessionValidator& validator) { sessionValidator_ = validator; }
+
+private:
+    struct Bucket
+    {
+        double tokens;
+        int64_t lastRefill;  // 微秒
+    };
+
+    struct Shard
+    {
+        std::unordered_map<std::string, Bucket> buckets;
+        int64_t lastSweep = 0;
+
+        ~Shard();
+    };
+
+    // 一个桶占用的内存，计入rate_limit_bucket
+    static size_t bucketBytes(const std::string& key);
+
+    Shard* localShard();
+    // 桶里现在是否有令牌，不存在的桶视为满的，不创建也不修改
+    bool hasToken(Shard* shard, const std::string& key, const RateLimitRule& rule, int64_t now);
+    // 扣一个令牌，桶不存在时创建
+    void take(Shard* shard, const std::string& key, const RateLimitRule& rule, int64_t now);
+    // 回收空闲的桶：补满之后与新建的桶没有区别，可以直接删掉
+    void sweep(Shard* shard, int64_t now);
+
+    RateLimitConfig config_;
+    std::shared_ptr<const std::string> rejectTail_;  // 429响应的头部和响应体
+    std::atomic<uint64_t> rejected_;
+    SessionValidator sessionValidator_;
+    std::mutex shardsMutex_;
+    std::unordered_map<std::thread::id, std::unique_ptr<Shard>> shards_;
+};
+
+}
+
+}
+
+#endif
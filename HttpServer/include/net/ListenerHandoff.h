@@ -0,0 +1,66 @@
+#ifndef LISTENERHANDOFF_H
+#define LISTENERHANDOFF_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+namespace net
+{
+
+/*
+    热升级时在新旧进程之间交接监听socket
+
+        新进程                                   旧进程(ListenerHandoff::serve)
+          | ---- connect(controlPath) -------------> |
+          | <--- 监听fd(SCM_RIGHTS) ---------------- |
+          |  dup2到自己的Acceptor上并开始监听          |
+          | ---- 确认(1字节) ------------------------> |
+          |                                          |  开始排空，结束后退出
+
+    监听socket是同一个打开的文件，交接期间内核里的accept队列一直存在，
+    不会出现端口没人监听、连接被拒绝的窗口
+*/
+class ListenerHandoff: noncopyable
+{
+public:
+    using FdsProvider = std::function<std::vector<int>()>;
+    using HandedOffCallback = std::function<void()>;
+
+    explicit ListenerHandoff(const std::string& controlPath);
+    ~ListenerHandoff();
+
+    // 旧进程：在后台线程中等待新进程连接，交出fdsProvider()返回的fd，收到确认后调用cb
+    bool serve(const FdsProvider& fdsProvider, const HandedOffCallback& cb);
+    void stop();
+
+    // 新进程：向旧进程索取监听fd，成功时返回用于确认的控制连接，没有旧进程时返回-1
+    static int requestListenFds(const std::string& controlPath, std::vector<int>* fds);
+    // 新进程：自己的监听已经就绪，通知旧进程开始排空
+    static void confirmTakeover(int controlFd);
+
+private:
+    void serveLoop();
+    static bool sendFds(int sock, const std::vector<int>& fds);
+    static bool recvFds(int sock, std::vector<int>* fds);
+
+    std::string controlPath_;
+    int listenFd_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    FdsProvider fdsProvider_;
+    HandedOffCallback handedOffCallback_;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef REUSEPORTSERVER_H
+#define REUSEPORTSERVER_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mymuduo/TcpServer.h"
+#include "mymuduo/noncopyable.h"
+
+#include "SocketTuning.h"
+
+namespace http
+{
+
+namespace net
+{
+
+struct ReusePortConfig
+{
+    int numAcceptors = 0;      // acceptor线程数量，每个线程有自己的监听socket
+    std::vector<int> cpus;     // 第i个acceptor绑定到cpus[i % cpus.size()], 为空时不绑核
+    bool cpuSteering = false;  // 是否挂载cBPF，让连接落在收包CPU对应的acceptor上
+};
+
+/*
+    SO_REUSEPORT多acceptor模式:
+    每个线程拥有自己的EventLoop和一个kReusePort的TcpServer(线程数为0),
+    由内核在各个监听socket之间分发连接, 连接在哪个线程被accept就在哪个线程处理,
+    不再经过主循环accept后轮询分发给I/O线程
+*/
+class ReusePortServer: noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+
+    ReusePortServer(const InetAddress& listenAddr, const std::string& name, const ReusePortConfig& config);
+    ~ReusePortServer();
+
+    void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
+    void setThreadInitCallback(const ThreadInitCallback& cb) { threadInitCallback_ = cb; }
+    // 每个acceptor的监听socket在开始accept之前应用，在start()之前调用
+    void setSocketTuning(const SocketTuning& tuning) { tuning_ = tuning; }
+
+    // 按顺序启动所有acceptor, 全部开始监听后才返回
+    void start();
+    void stop();
+
+    int numAcceptors() const { return config_.numAcceptors; }
+    // 所有acceptor的监听fd，顺序即为SO_REUSEPORT组内的顺序
+    std::vector<int> listenFds() const;
+
+private:
+    struct Acceptor
+    {
+        std::thread thread;
+        EventLoop* loop = nullptr;
+        int listenFd = -1;
+    };
+
+    void runAcceptor(int index);
+
+    InetAddress listenAddr_;
+    uint16_t port_;
+    std::string name_;
+    ReusePortConfig config_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    ThreadInitCallback threadInitCallback_;
+    SocketTuning tuning_;
+
+    std::vector<Acceptor> acceptors_;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    int listening_;  // 已经开始监听的acceptor数量
+    bool started_;
+};
+
+}
+
+}
+
+#endif
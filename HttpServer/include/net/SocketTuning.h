@@ -0,0 +1,47 @@
+#ifndef SOCKETTUNING_H
+#define SOCKETTUNING_H
+
+namespace http
+{
+
+namespace net
+{
+
+/*
+    监听socket的调优参数，0/false表示不设置、保留内核默认值
+
+    这些选项都设置在监听socket上，由accept出来的连接继承(Linux上TCP_NODELAY、
+    SO_RCVBUF/SO_SNDBUF和SO_BUSY_POLL都会从监听socket复制到新连接)，
+    因为mymuduo的TcpConnection不暴露连接的fd，这是唯一能对所有连接生效的位置
+*/
+struct SocketTuning
+{
+    bool noDelay = false;        // TCP_NODELAY，关闭Nagle，小响应不必等待上一个段的ACK
+    int deferAcceptSeconds = 0;  // TCP_DEFER_ACCEPT，客户端发来数据后才唤醒accept，最多等待的秒数
+    int fastOpenQueue = 0;       // TCP_FASTOPEN，允许在SYN中携带请求的半连接队列长度
+    int recvBufferBytes = 0;     // SO_RCVBUF，设置后该连接不再自动调整接收缓冲区
+    int sendBufferBytes = 0;     // SO_SNDBUF，同上
+    int busyPollMicros = 0;      // SO_BUSY_POLL，读不到数据时忙轮询网卡队列的微秒数，调高需要CAP_NET_ADMIN
+
+    /*
+        低延迟：关闭Nagle；DEFER_ACCEPT省去只完成握手还没有请求的那次唤醒；
+        TFO让回访的客户端省一个RTT；忙轮询50us换取更低的收包延迟，代价是CPU占用
+    */
+    static SocketTuning lowLatency();
+
+    /*
+        高吞吐：同样关闭Nagle(响应总是一次写出，Nagle只会拖慢最后一个段)；
+        不忙轮询，把CPU留给请求处理；发送缓冲区加大到1MB，大响应可以一次写进内核，
+        接收缓冲区保持自动调整
+    */
+    static SocketTuning highThroughput();
+
+    // 对一个TCP监听socket应用以上选项，失败的选项只记录警告，返回是否全部成功
+    bool applyToListener(int fd) const;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SOCKETUTIL_H
+#define SOCKETUTIL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace http
+{
+
+namespace net
+{
+
+/*
+    mymuduo的Acceptor不对外暴露监听socket的fd，
+    这里通过扫描/proc/self/fd找到绑定在指定端口上的socket，
+    用于在TcpServer创建好socket之后再对它做额外的设置
+*/
+class SocketUtil
+{
+public:
+    /*
+        找到本进程中绑定在port上的TCP socket, listening为true时只返回已经listen的，
+        为false时只返回没有listen的，其中也包括从这个端口accept出来的连接，只在开始accept之前有意义
+    */
+    static std::vector<int> findSockets(uint16_t port, bool listening);
+    // 本进程中所有的TCP socket(按fd排序), listening含义同上
+    static std::vector<int> allSockets(bool listening);
+
+    /*
+        本进程不再从监听socket fd上accept，而新进程通过SCM_RIGHTS持有的同一个socket照常监听：
+        先把fd从本进程所有的epoll实例中删除(socket仍被别的进程引用时，关闭fd并不会让epoll删除它)，
+        再把一个没有绑定的socket dup2到fd上，关闭本进程对监听socket的引用。
+        fd号保持有效，Acceptor析构时关闭的是这个替身
+    */
+    static bool retireListener(int fd);
+
+    // 创建一个绑定在path上、还没有listen的非阻塞Unix域流socket，path上残留的旧socket文件会被删除
+    static int createUnixSocket(const std::string& path);
+
+    // 把当前线程绑定到指定CPU上
+    static bool pinCurrentThread(int cpu);
+
+    /*
+        给SO_REUSEPORT组挂载cBPF程序：按收包所在CPU选择监听socket
+        cpus[i]上收到的连接交给组内第i个socket, 其余CPU按 cpu % groupSize 分配
+        必须挂在组内第一个listen的socket上
+    */
+    static bool attachReusePortCpuSteering(int listenFd, const std::vector<int>& cpus, int groupSize);
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef URINGSERVER_H
+#define URINGSERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/any.hpp>
+
+#include "mymuduo/Buffer.h"
+#include "mymuduo/noncopyable.h"
+
+namespace http
+{
+
+namespace net
+{
+
+struct UringConfig
+{
+    unsigned entries = 4096;      // 每个线程的提交队列长度
+    unsigned bufferCount = 1024;  // 每个线程提供给内核的接收缓冲区个数，必须是2的幂
+    unsigned bufferSize = 4096;   // 每个接收缓冲区的字节数
+    bool sqPoll = false;          // 由内核线程轮询提交队列，省去提交时的系统调用，每个线程额外占用一个内核线程
+    unsigned sqPollIdleMs = 1000; // 提交队列空闲多久后内核轮询线程休眠
+};
+
+class UringServer;
+
+// io_uring传输上的一个连接，只在所属的工作线程上访问
+class UringConnection: noncopyable
+{
+public:
+    int fd() const { return fd_; }
+    const std::string& peerIp() const { return peerIp_; }
+
+    void setContext(const boost::any& context) { context_ = context; }
+    boost::any* getMutableContext() { return &context_; }
+
+private:
+    friend class UringServer;
+
+    UringConnection(int fd, const std::string& peerIp, int worker):
+        fd_(fd),
+        peerIp_(peerIp),
+        worker_(worker),
+        deadline_(0),
+        timerLinked_(false),
+        refs_(0),
+        recvArmed_(false),
+        sendInFlight_(false),
+        closing_(false),
+        closeSubmitted_(false),
+        fdClosed_(false)
+    {}
+
+    int fd_;
+    std::string peerIp_;
+    int worker_;  // 所属工作线程的下标
+    boost::any context_;
+    uint64_t deadline_;  // 超时的tick，在所属线程的时间轮上
+    std::list<UringConnection*>::iterator timerEntry_;
+    bool timerLinked_;
+    Buffer input_;    // 收到还没有处理的数据
+    Buffer output_;   // 等待发送的响应，发送期间继续追加
+    Buffer sending_;  // 已经提交给内核的响应，发送完成前不能移动
+    int refs_;        // 还没有完成的操作数，为0且fd已关闭时释放
+    bool recvArmed_;
+    bool sendInFlight_;
+    bool closing_;        // 发送完剩余的响应后关闭
+    bool closeSubmitted_;
+    bool fdClosed_;
+};
+
+/*
+    基于io_uring的传输，替代mymuduo的epoll反应堆:
+    - 每个工作线程一个ring，都在同一个监听socket上提交multishot accept，连接在哪个线程被accept就在哪个线程处理
+    - 每个连接一个multishot recv，数据写入内核从provided buffer ring中挑选的缓冲区，不需要每次读都提交
+    - 关闭连接时把最后一次send、shutdown和close链接成一组提交，按顺序执行，不必等send完成再回到用户态
+    - 每个线程一个按秒转动的时间轮，由ring上的timeout操作驱动，不需要额外的定时器fd
+    - 可选SQPOLL
+
+    编译时没有开启HTTP_ENABLE_IO_URING时只保留接口，supported()返回false
+*/
+class UringServer: noncopyable
+{
+public:
+    // 收到数据：in中是还没有处理的数据，响应追加到out中；返回false表示发送完out后关闭连接
+    using MessageCallback = std::function<bool(UringConnection*, Buffer* in, Buffer* out)>;
+    // 连接建立(connected为true)和释放
+    using ConnectionCallback = std::function<void(UringConnection*, bool connected)>;
+    // 连接超时：可以向out追加最后的响应，之后连接被关闭
+    using TimeoutCallback = std::function<void(UringConnection*, Buffer* out)>;
+
+    // listenFd必须已经listen，numThreads为工作线程数(至少为1)，调用start()的线程就是第0个工作线程
+    UringServer(int listenFd, int numThreads, const UringConfig& config);
+    ~UringServer();
+
+    // 是否编译了io_uring支持，并且当前内核可以创建ring
+    static bool supported();
+
+    void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
+    void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
+    void setTimeoutCallback(const TimeoutCallback& cb) { timeoutCallback_ = cb; }
+
+    // seconds秒后连接超时，替换之前的设置，seconds<=0时取消。只能在连接所属的工作线程上(即回调中)调用
+    void setTimeout(UringConnection* conn, int seconds);
+
+    // 启动其余工作线程，并在当前线程上运行第0个工作线程，stop()之后返回
+    void start();
+    // 可以在任意线程调用
+    void stop();
+
+private:
+    struct Worker;
+
+    void runWorker(Worker* worker);
+    void handleAccept(Worker* worker, int res, bool more);
+    void handleRecv(Worker* worker, UringConnection* conn, int res, unsigned flags);
+    void handleSend(Worker* worker, UringConnection* conn, int res);
+    void handleClose(Worker* worker, UringConnection* conn, int res);
+    void handleTick(Worker* worker);
+    void handleExpire(Worker* worker, UringConnection* conn);
+    void armTick(Worker* worker);
+    void addTimer(Worker* worker, UringConnection* conn, int seconds);
+    void removeTimer(Worker* worker, UringConnection* conn);
+    // 把output_中的响应提交发送，closing_时在最后链接shutdown和close
+    void flush(Worker* worker, UringConnection* conn);
+    void armRecv(Worker* worker, UringConnection* conn);
+    // 没有未完成的操作并且fd已关闭时释放连接
+    void release(Worker* worker, UringConnection* conn);
+
+    int listenFd_;
+    UringConfig config_;
+    std::atomic<bool> running_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    MessageCallback messageCallback_;
+    ConnectionCallback connectionCallback_;
+    TimeoutCallback timeoutCallback_;
+};
+
+}
+
+}
+
+#endif
@@ -1,14 +1,20 @@
 #ifndef ROUTER_H
 #define ROUTER_H
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <unordered_map>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <functional>
 #include <regex>
 #include <vector>
 
+#include "mymuduo/noncopyable.h"
+
 #include "RouterHandler.h"
 #include "../http/HttpRequest.h"
 #include "../http/HttpResponse.h"
@@ -23,22 +29,27 @@ namespace router
     选择注册对象式的路由处理器还是注册回调函数式的处理器取决于处理器执行的复杂程度
     如果是简单的处理可以注册回调函数，否则注册对象式路由处理器（对象中可以封装多个相关函数）
     二者注册一个即可
+
+    路由表是不可变的，注册和删除时拷贝一份当前的表修改后整体发布(RCU)，所以start()之后也可以随时修改。
+    每个I/O线程缓存一份表的引用，分发时只用一次原子读检查版本号，没有变化就直接使用，
+    旧表在所有线程都换到新表之后随最后一个引用释放
 */
 
-class Router
+class Router: noncopyable
 {
 public:
     using HandlerPtr = std::shared_ptr<RouterHandler>;
     using HandlerCallback = std::function<void(const HttpRequest&, HttpResponse*)>;
 
-    Router() = default;
+    Router();
     ~Router() = default;
 
     // 路由键（请求方法 + URI） POST /api/users ?
+    // path指向routePaths_中保存的路径，查找时直接指向请求里的路径，不需要拷贝
     struct RouteKey
     {
         HttpRequest::Method method;
-        std::string path;
+        std::string_view path;
 
         bool operator==(const RouteKey &other) const { return method == other.method && path == other.path; }
     };
@@ -61,24 +72,23 @@ public:
     // 注册动态路由处理函数
     void addRegexCallback(HttpRequest::Method method, const std::string &path, const HandlerCallback& callback);
 
-    // 处理请求
-    bool route(const HttpRequest &req, HttpResponse* resp);
-
-private:
-    // 将路径模式切换为正则表达式模式，支持匹配任意路径参数
-    std::regex convertToRegex(const std::string &pathPattern);
+    // 删除注册时的method和path(动态路由为注册时的模式)对应的全部处理器，返回是否存在
+    bool removeRoute(HttpRequest::Method method, const std::string &path);
 
-    // 提取路径参数
-    void extractPathParameters(const std::smatch &match, HttpRequest& request);
+    // 处理请求，动态路由的路径参数直接写入req，routeId非空时写入命中路由的指标编号(未命中为0)
+    bool route(HttpRequest &req, HttpResponse* resp, int* routeId = nullptr);
 
+private:
     struct RouteCallbackObj
     {
         HttpRequest::Method method_;
         std::regex pathRegex_;
         HandlerCallback callback_;
+        int routeId_;
+        std::string pattern_;  // 注册时的路径模式，删除时按它查找
 
         RouteCallbackObj(HttpRequest::Method method, std::regex pathRegex,
-                        const HandlerCallback &callback);
+                        const HandlerCallback &callback, int routeId, const std::string &pattern);
     };
 
     struct RouteHandlerObj
@@ -86,17 +96,48 @@ private:
         HttpRequest::Method method_;
         std::regex pathRegex_;
         HandlerPtr handler_;
+        int routeId_;
+        std::string pattern_;
 
         RouteHandlerObj(HttpRequest::Method method, std::regex pathRegex,
-                            HandlerPtr handler);
+                            HandlerPtr handler, int routeId, const std::string &pattern);
+    };
+
+    // 一个版本的路由表，发布之后不再修改
+    struct RouteTable
+    {
+        /* 带regex的就是动态？ */
+        std::unordered_map<RouteKey, HandlerPtr, RouteKeyHash> handlers_;  // 精准匹配
+        std::unordered_map<RouteKey, HandlerCallback, RouteKeyHash> callbacks_;  // 精准匹配
+        std::vector<RouteHandlerObj> regexHandlers_;  // 正则匹配
+        std::vector<RouteCallbackObj> regexCallbacks_;  // 正则匹配
+        std::unordered_map<RouteKey, int, RouteKeyHash> routeIds_;  // 精准匹配路由的指标编号
+        // 静态路由路径的存储，各个版本的表共享，键中的string_view在拷贝后仍然有效
+        std::vector<std::shared_ptr<const std::string>> routePaths_;
+
+        // 保存静态路由的路径，返回的键引用这份拷贝
+        RouteKey makeKey(HttpRequest::Method method, const std::string &path);
     };
 
-    /* 带regex的就是动态？ */
-    std::unordered_map<RouteKey, HandlerPtr, RouteKeyHash> handlers_;  // 精准匹配
-    std::unordered_map<RouteKey, HandlerCallback, RouteKeyHash> callbacks_;  // 精准匹配
-    std::vector<RouteHandlerObj> regexHandlers_;  // 正则匹配
-    std::vector<RouteCallbackObj> regexCallbacks_;  // 正则匹配
+    using TablePtr = std::shared_ptr<const RouteTable>;
+
+    // 将路径模式切换为正则表达式模式，支持匹配任意路径参数
+    std::regex convertToRegex(const std::string &pathPattern);
+
+    // 提取路径参数
+    void extractPathParameters(const std::smatch &match, HttpRequest& request);
+
+    // 拷贝当前的表交给modify修改，然后发布新表，写者之间串行
+    template<typename Modify>
+    void update(Modify modify);
+
+    // 本线程缓存的当前表，版本号变化时才加锁换成新表；嵌套在处理器中的调用由pinned持有表
+    const RouteTable* currentTable(TablePtr* pinned) const;
 
+    std::mutex writeMutex_;  // 串行化写者
+    mutable std::mutex tableMutex_;  // 保护table_与version_的配对，只在发布和读者换表时持有
+    TablePtr table_;
+    std::atomic<uint64_t> version_;  // 全局唯一，读者据此判断缓存是否过期
 };
 
 }
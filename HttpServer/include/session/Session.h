@@ -6,6 +6,8 @@
 #include <unordered_map>
 #include <chrono>
 
+#include "../memory/MemoryAccounting.h"
+
 namespace http
 {
 
@@ -44,11 +46,15 @@ public:
 
 
 private:
+    // 数据变化后重新估计占用的内存
+    void updateMemory();
+
     std::string sessionId_;
     std::unordered_map<std::string, std::string> data_;
     std::chrono::system_clock::time_point expiryTime_;
     int maxAge_;  // 过期时间(秒)
     SessionManager* sessionManager_;
+    memory::MemoryTracker memoryTracker_;  // 计入session
 };
 
 }
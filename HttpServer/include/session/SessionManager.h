@@ -22,6 +22,9 @@ public:
     // 从请求中获取或创建会话
     std::shared_ptr<Session> getSession(const HttpRequest& req, HttpResponse* resp);
 
+    // sessionId是否对应一个存在且没有过期的会话，不创建会话
+    bool hasSession(const std::string& sessionId);
+
     // 销毁会话
     void destorySession(const std::string& sessionId);
 
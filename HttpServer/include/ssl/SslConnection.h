@@ -9,6 +9,7 @@
 #include "mymuduo/TcpConnection.h"
 #include "mymuduo/Buffer.h"
 #include "mymuduo/noncopyable.h"
+#include "../memory/MemoryAccounting.h"
 
 namespace ssl
 {
@@ -58,6 +59,7 @@ private:
     Buffer writeBuffer_;                   // 写缓冲区
     Buffer decryptedBuffer_;               // 解密后的数据
     MessageCallback messageCallback_;      //  消息回调
+    http::memory::MemoryTracker memoryTracker_;  // 计入ssl_connection，不含OpenSSL内部的内存
 };
 
 }
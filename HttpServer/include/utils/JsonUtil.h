@@ -1,8 +1,23 @@
 #ifndef JSONUTIL_H
 #define JSONUTIL_H
 
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
 #include <nlohmann/json.hpp>
 
+#include "../memory/RequestArena.h"
+
 using json = nlohmann::json;
 
-#endif
\ No newline at end of file
+/*
+    处理器内部的临时json：对象、数组和字符串节点分配在当前请求的内存池上，请求结束时一起释放。
+    超过短字符串优化长度的字符串内容仍由std::string自己分配。
+    不能保存到请求结束之后(如放进会话或缓存)，需要保存时先dump()或转换成json
+*/
+using ArenaJson = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t,
+                                       std::uint64_t, double, http::memory::ArenaAllocator>;
+
+#endif
@@ -0,0 +1,359 @@
+#include "../../include/diagnostics/CpuProfiler.h"
+
+#include <cxxabi.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+
+#include "mymuduo/Alogger.h"
+
+// 旧版本glibc没有这个名字
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace http
+{
+
+namespace diagnostics
+{
+
+namespace
+{
+
+// 另一个线程的CPU时钟，与glibc的pthread_getcpuclockid相同的编码(CPUCLOCK_SCHED | CPUCLOCK_PERTHREAD)，但只需要tid
+clockid_t threadCpuClock(pid_t tid)
+{
+    return static_cast<clockid_t>((~static_cast<unsigned>(tid) << 3) | 6);
+}
+
+std::string threadName(pid_t tid)
+{
+    std::ifstream comm("/proc/self/task/" + std::to_string(tid) + "/comm");
+    std::string name;
+    if(!std::getline(comm, name) || name.empty())
+    {
+        return "tid-" + std::to_string(tid);
+    }
+    return name + "-" + std::to_string(tid);
+}
+
+// 地址对应的函数名，没有符号时用"模块+偏移"
+std::string symbolize(void* address)
+{
+    Dl_info info;
+    if(!::dladdr(address, &info) || !info.dli_fname)
+    {
+        char buf[32];
+        snprintf(buf, sizeof buf, "[%p]", address);
+        return buf;
+    }
+    std::string name;
+    if(info.dli_sname)
+    {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        name = status == 0 ? demangled : info.dli_sname;
+        free(demangled);
+    }
+    else
+    {
+        const char* module = std::strrchr(info.dli_fname, '/');
+        char buf[32];
+        snprintf(buf, sizeof buf, "+0x%lx", static_cast<unsigned long>(
+            static_cast<char*>(address) - static_cast<char*>(info.dli_fbase)));
+        name = std::string(module ? module + 1 : info.dli_fname) + buf;
+    }
+    // 分号是折叠格式的分隔符
+    std::replace(name.begin(), name.end(), ';', ':');
+    return name;
+}
+
+}
+
+struct CpuProfiler::Sample
+{
+    std::atomic<bool> ready{false};
+    pid_t tid;
+    int depth;
+    void* frames[kMaxFrames];
+};
+
+struct CpuProfiler::Session
+{
+    ProfileOptions options;
+    std::unique_ptr<Sample[]> samples;
+    size_t capacity;
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> dropped{0};
+    timer_t timer;  // 只采样一个线程时使用
+};
+
+std::atomic<CpuProfiler::Session*> CpuProfiler::s_active{nullptr};
+std::atomic<int> CpuProfiler::s_inHandler{0};
+
+CpuProfiler::CpuProfiler():
+    state_(kIdle)
+{
+    // backtrace第一次调用时会加载libgcc，不能发生在信号处理函数里
+    void* warmup[1];
+    ::backtrace(warmup, 1);
+
+    // 处理函数一直保留，停止后仍在路上的SIGPROF不会走默认动作终止进程
+    struct sigaction action;
+    std::memset(&action, 0, sizeof action);
+    action.sa_handler = &CpuProfiler::onProfSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if(::sigaction(SIGPROF, &action, nullptr) < 0)
+    {
+        logger_->ERROR("Failed to install SIGPROF handler");
+    }
+}
+
+CpuProfiler& CpuProfiler::instance()
+{
+    // 故意不析构：进程退出时后台线程可能还在采样
+    static CpuProfiler* profiler = new CpuProfiler;
+    return *profiler;
+}
+
+void CpuProfiler::onProfSignal(int)
+{
+    int savedErrno = errno;
+    s_inHandler.fetch_add(1);
+    Session* session = s_active.load();
+    if(session)
+    {
+        size_t index = session->next.fetch_add(1, std::memory_order_relaxed);
+        if(index < session->capacity)
+        {
+            Sample& sample = session->samples[index];
+            sample.tid = static_cast<pid_t>(::syscall(SYS_gettid));
+            sample.depth = ::backtrace(sample.frames, kMaxFrames);
+            sample.ready.store(true, std::memory_order_release);
+        }
+        else
+        {
+            session->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    s_inHandler.fetch_sub(1);
+    errno = savedErrno;
+}
+
+bool CpuProfiler::start(const ProfileOptions& options, std::string* error)
+{
+    if(options.seconds <= 0 || options.seconds > kMaxSeconds)
+    {
+        *error = "seconds must be between 1 and " + std::to_string(kMaxSeconds);
+        return false;
+    }
+    if(options.hz <= 0 || options.hz > kMaxHz)
+    {
+        *error = "hz must be between 1 and " + std::to_string(kMaxHz);
+        return false;
+    }
+    if(options.tid != 0 && ::access(("/proc/self/task/" + std::to_string(options.tid)).c_str(), F_OK) < 0)
+    {
+        *error = "no such thread " + std::to_string(options.tid);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(state_ == kRunning)
+    {
+        *error = "a profile is already running";
+        return false;
+    }
+    if(worker_.joinable())
+    {
+        worker_.join();  // 上一次的后台线程已经写完结果，马上就会退出
+    }
+
+    // 整个进程时每个CPU都可能贡献样本
+    size_t cpus = options.tid != 0 ? 1 : static_cast<size_t>(std::max(1L, ::sysconf(_SC_NPROCESSORS_ONLN)));
+    auto session = std::make_unique<Session>();
+    session->options = options;
+    session->capacity = std::min(kMaxSamples, static_cast<size_t>(options.hz) * options.seconds * cpus);
+    session->samples.reset(new Sample[session->capacity]);
+
+    // 先发布会话再启动定时器，第一个信号到达时就有地方写
+    s_active.store(session.get());
+    long intervalUs = 1000000L / options.hz;
+    int ret;
+    if(options.tid != 0)
+    {
+        struct sigevent event;
+        std::memset(&event, 0, sizeof event);
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGPROF;
+        event.sigev_notify_thread_id = options.tid;
+        ret = ::timer_create(threadCpuClock(options.tid), &event, &session->timer);
+        if(ret == 0)
+        {
+            struct itimerspec spec;
+            spec.it_interval.tv_sec = intervalUs / 1000000;
+            spec.it_interval.tv_nsec = (intervalUs % 1000000) * 1000;
+            spec.it_value = spec.it_interval;
+            ret = ::timer_settime(session->timer, 0, &spec, nullptr);
+            if(ret < 0)
+            {
+                ::timer_delete(session->timer);
+            }
+        }
+    }
+    else
+    {
+        struct itimerval timer;
+        timer.it_interval.tv_sec = intervalUs / 1000000;
+        timer.it_interval.tv_usec = intervalUs % 1000000;
+        timer.it_value = timer.it_interval;
+        ret = ::setitimer(ITIMER_PROF, &timer, nullptr);
+    }
+    if(ret < 0)
+    {
+        *error = std::string("failed to start profiling timer: ") + strerror(errno);
+        s_active.store(nullptr);
+        while(s_inHandler.load() != 0)
+        {
+            std::this_thread::yield();
+        }
+        return false;
+    }
+
+    logger_->INFO("CPU profile started for " + std::to_string(options.seconds) + "s at " + std::to_string(options.hz) +
+                  "Hz" + (options.tid != 0 ? " on thread " + std::to_string(options.tid) : std::string()));
+    state_ = kRunning;
+    worker_ = std::thread(&CpuProfiler::run, this, std::move(session));
+    return true;
+}
+
+void CpuProfiler::run(std::unique_ptr<Session> session)
+{
+    std::this_thread::sleep_for(std::chrono::seconds(session->options.seconds));
+
+    if(session->options.tid != 0)
+    {
+        ::timer_delete(session->timer);
+    }
+    else
+    {
+        struct itimerval timer;
+        std::memset(&timer, 0, sizeof timer);
+        ::setitimer(ITIMER_PROF, &timer, nullptr);
+    }
+    // 之后进入的信号处理函数看到的是空会话，等已经进入的处理函数返回后样本就不会再变
+    s_active.store(nullptr);
+    while(s_inHandler.load() != 0)
+    {
+        std::this_thread::yield();
+    }
+
+    std::string folded = fold(*session);
+    size_t samples = std::min(session->next.load(), session->capacity);
+    logger_->INFO("CPU profile finished with " + std::to_string(samples) + " samples, " +
+                  std::to_string(session->dropped.load()) + " dropped");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    folded_ = std::move(folded);
+    state_ = kDone;
+}
+
+std::string CpuProfiler::fold(const Session& session) const
+{
+    std::unordered_map<void*, std::string> symbols;
+    std::unordered_map<pid_t, std::string> names;
+    std::map<std::string, uint64_t> stacks;
+    size_t count = std::min(session.next.load(), session.capacity);
+    for(size_t i = 0; i < count; ++i)
+    {
+        const Sample& sample = session.samples[i];
+        if(!sample.ready.load(std::memory_order_acquire))
+        {
+            continue;
+        }
+        auto nameIt = names.find(sample.tid);
+        if(nameIt == names.end())
+        {
+            nameIt = names.emplace(sample.tid, threadName(sample.tid)).first;
+        }
+        std::string stack = nameIt->second;
+        // 第0、1帧是信号处理函数和信号跳板，第2帧是被打断的位置，更外层的是返回地址，减一落回call指令所在的函数
+        for(int f = sample.depth - 1; f >= 2; --f)
+        {
+            void* address = f == 2 ? sample.frames[f] : static_cast<char*>(sample.frames[f]) - 1;
+            auto symbolIt = symbols.find(address);
+            if(symbolIt == symbols.end())
+            {
+                symbolIt = symbols.emplace(address, symbolize(address)).first;
+            }
+            stack += ';';
+            stack += symbolIt->second;
+        }
+        ++stacks[stack];
+    }
+
+    std::string folded;
+    for(const auto& item: stacks)
+    {
+        folded += item.first + " " + std::to_string(item.second) + "\n";
+    }
+    return folded;
+}
+
+CpuProfiler::State CpuProfiler::result(std::string* folded) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(state_ == kDone)
+    {
+        *folded = folded_;
+    }
+    return state_;
+}
+
+bool CpuProfiler::running() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_ == kRunning;
+}
+
+std::vector<std::pair<pid_t, std::string>> CpuProfiler::threads()
+{
+    std::vector<std::pair<pid_t, std::string>> result;
+    DIR* dir = ::opendir("/proc/self/task");
+    if(!dir)
+    {
+        return result;
+    }
+    while(struct dirent* entry = ::readdir(dir))
+    {
+        pid_t tid = static_cast<pid_t>(std::atoi(entry->d_name));
+        if(tid > 0)
+        {
+            result.emplace_back(tid, threadName(tid));
+        }
+    }
+    ::closedir(dir);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+}
+
+}
@@ -0,0 +1,314 @@
+#include "../../include/diagnostics/LoopWatchdog.h"
+
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include "mymuduo/Alogger.h"
+#include "../../include/metrics/Metrics.h"
+
+namespace http
+{
+
+namespace diagnostics
+{
+
+namespace
+{
+
+const int kMaxFrames = 64;
+// 等待卡住的线程执行信号处理函数的最长时间，线程阻塞在不可中断的系统调用里时可能一直拿不到调用栈
+const int kCaptureWaitMs = 100;
+
+// 信号处理函数的状态
+enum CaptureState
+{
+    kIdle,
+    kRequested,  // 检测线程已发出信号
+    kCapturing,  // 信号处理函数正在填写
+    kCaptured,
+};
+
+// 线程退出时标记对应的循环不再监视，避免把已经退出的线程当作卡住
+struct SlotRetirer
+{
+    std::atomic<bool>* retired = nullptr;
+
+    ~SlotRetirer()
+    {
+        if(retired)
+        {
+            retired->store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local SlotRetirer t_retirer;
+
+void copyBounded(char* dst, size_t capacity, const char* src, size_t len)
+{
+    len = std::min(len, capacity - 1);
+    std::memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+std::string formatMillis(uint64_t nanos)
+{
+    char buf[32];
+    snprintf(buf, sizeof buf, "%.1f", nanos / 1e6);
+    return buf;
+}
+
+}
+
+struct LoopWatchdog::Slot
+{
+    pthread_t thread;
+    long tid;
+    std::atomic<uint64_t> heartbeat{0};  // 上一次心跳的时间
+    std::atomic<bool> retired{false};
+    uint64_t reported = 0;  // 已经报告过的卡顿对应的心跳，只有检测线程访问
+
+    // 当前请求，由所属线程写，同一线程上的信号处理函数读
+    std::atomic<bool> inRequest{false};
+    const char* method = nullptr;
+    const char* path = nullptr;
+    size_t pathLen = 0;
+    const std::string* connection = nullptr;
+    const int* routeId = nullptr;
+
+    // 由信号处理函数填写
+    std::atomic<int> capture{kIdle};
+    void* frames[kMaxFrames];
+    int depth = 0;
+    bool capturedRequest = false;
+    char capturedMethod[16];
+    char capturedPath[256];
+    char capturedConnection[128];
+    int capturedRouteId = 0;
+};
+
+thread_local LoopWatchdog::Slot* LoopWatchdog::t_slot = nullptr;
+
+void LoopWatchdog::onStackSignal(int)
+{
+    int savedErrno = errno;
+    Slot* slot = t_slot;
+    int expected = kRequested;
+    if(slot && slot->capture.compare_exchange_strong(expected, kCapturing, std::memory_order_acquire))
+    {
+        slot->depth = ::backtrace(slot->frames, kMaxFrames);
+        slot->capturedRequest = slot->inRequest.load(std::memory_order_acquire);
+        if(slot->capturedRequest)
+        {
+            copyBounded(slot->capturedMethod, sizeof slot->capturedMethod, slot->method, std::strlen(slot->method));
+            copyBounded(slot->capturedPath, sizeof slot->capturedPath, slot->path, slot->pathLen);
+            copyBounded(slot->capturedConnection, sizeof slot->capturedConnection,
+                        slot->connection->data(), slot->connection->size());
+            slot->capturedRouteId = slot->routeId ? *slot->routeId : 0;
+        }
+        slot->capture.store(kCaptured, std::memory_order_release);
+    }
+    errno = savedErrno;
+}
+
+LoopWatchdog::LoopWatchdog(const WatchdogConfig& config):
+    config_(config),
+    lagTimerId_(metrics::MetricsRegistry::instance().timerId("http_loop_lag_seconds",
+        "How much later than scheduled each event loop heartbeat ran")),
+    stalls_(0),
+    running_(true)
+{
+    // backtrace第一次调用时会加载libgcc，不能发生在信号处理函数里
+    void* warmup[1];
+    ::backtrace(warmup, 1);
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof action);
+    action.sa_handler = &LoopWatchdog::onStackSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if(::sigaction(config_.stackSignal, &action, nullptr) < 0)
+    {
+        logger_->ERROR("Failed to install watchdog signal handler");
+        abort();
+    }
+    thread_ = std::thread(&LoopWatchdog::run, this);
+}
+
+LoopWatchdog::~LoopWatchdog()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void LoopWatchdog::watch(EventLoop* loop)
+{
+    if(t_slot)
+    {
+        return;  // 本线程已经被监视，同一个线程登记两份会重复报告卡顿
+    }
+    Slot* slot = new Slot;
+    slot->thread = ::pthread_self();
+    slot->tid = ::syscall(SYS_gettid);
+    slot->heartbeat.store(metrics::nowNanos(), std::memory_order_release);
+    t_slot = slot;
+    t_retirer.retired = &slot->retired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_.push_back(slot);
+    }
+
+    // 定时器只引用slot，slot不释放，循环比检测器活得久也没有问题
+    uint64_t intervalNanos = static_cast<uint64_t>(config_.heartbeatSeconds * 1e9);
+    uint64_t thresholdNanos = static_cast<uint64_t>(config_.stallThresholdMs * 1e6);
+    int timerId = lagTimerId_;
+    loop->runEvery(config_.heartbeatSeconds, [slot, intervalNanos, thresholdNanos, timerId] {
+        uint64_t now = metrics::nowNanos();
+        uint64_t elapsed = now - slot->heartbeat.load(std::memory_order_relaxed);
+        uint64_t lag = elapsed > intervalNanos ? elapsed - intervalNanos : 0;
+        slot->heartbeat.store(now, std::memory_order_release);
+        metrics::MetricsRegistry::local().recordTimer(timerId, lag);
+        if(lag >= thresholdNanos)
+        {
+            logger_->WARN("Event loop on thread " + std::to_string(slot->tid) + " recovered after " +
+                          formatMillis(lag) + " ms stall");
+        }
+    });
+}
+
+void LoopWatchdog::run()
+{
+    // 检查间隔取阈值的四分之一，卡顿最多晚这么久被发现
+    auto interval = std::chrono::microseconds(std::max<int64_t>(1000,
+        static_cast<int64_t>(config_.stallThresholdMs * 1000 / 4)));
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(running_)
+    {
+        cond_.wait_for(lock, interval);
+        if(!running_)
+        {
+            break;
+        }
+        std::vector<Slot*> slots = slots_;
+        lock.unlock();  // 报告时要等待信号处理函数，不能挡住新循环的注册
+        uint64_t now = metrics::nowNanos();
+        for(Slot* slot: slots)
+        {
+            check(slot, now);
+        }
+        lock.lock();
+    }
+}
+
+void LoopWatchdog::check(Slot* slot, uint64_t now)
+{
+    if(slot->retired.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    uint64_t heartbeat = slot->heartbeat.load(std::memory_order_acquire);
+    uint64_t stalled = now > heartbeat ? now - heartbeat : 0;
+    if(stalled < static_cast<uint64_t>(config_.stallThresholdMs * 1e6) || slot->reported == heartbeat)
+    {
+        return;
+    }
+    slot->reported = heartbeat;
+    stalls_.fetch_add(1, std::memory_order_relaxed);
+    report(slot, stalled);
+}
+
+void LoopWatchdog::report(Slot* slot, uint64_t stalledNanos)
+{
+    std::string message = "Event loop stalled for " + formatMillis(stalledNanos) + " ms on thread " + std::to_string(slot->tid);
+
+    slot->capture.store(kRequested, std::memory_order_release);
+    bool captured = false;
+    if(::pthread_kill(slot->thread, config_.stackSignal) == 0)
+    {
+        for(int waited = 0; waited < kCaptureWaitMs; ++waited)
+        {
+            if(slot->capture.load(std::memory_order_acquire) == kCaptured)
+            {
+                captured = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    int expected = kRequested;
+    if(!captured && !slot->capture.compare_exchange_strong(expected, kIdle, std::memory_order_acquire))
+    {
+        // 信号处理函数已经开始填写，很快就会结束
+        while(slot->capture.load(std::memory_order_acquire) != kCaptured)
+        {
+            std::this_thread::yield();
+        }
+        captured = true;
+    }
+
+    if(!captured)
+    {
+        logger_->ERROR(message + ", stack unavailable");
+        return;
+    }
+    if(slot->capturedRequest)
+    {
+        message += ", request " + std::string(slot->capturedMethod) + " " + slot->capturedPath +
+                   " (route " + metrics::MetricsRegistry::instance().routeName(slot->capturedRouteId) +
+                   ") on connection " + slot->capturedConnection;
+    }
+    else
+    {
+        message += ", not in a request";
+    }
+    message += "\n";
+    char** symbols = ::backtrace_symbols(slot->frames, slot->depth);
+    // 第0、1帧是信号处理函数和信号跳板
+    for(int i = 2; i < slot->depth; ++i)
+    {
+        message += "  #" + std::to_string(i - 2) + " " + (symbols ? symbols[i] : "?") + "\n";
+    }
+    free(symbols);
+    slot->capture.store(kIdle, std::memory_order_release);
+    logger_->ERROR(message);
+}
+
+LoopWatchdog::RequestScope::RequestScope(const char* method, std::string_view path, const std::string& connection, const int* routeId)
+{
+    Slot* slot = t_slot;
+    if(slot)
+    {
+        slot->method = method;
+        slot->path = path.data();
+        slot->pathLen = path.size();
+        slot->connection = &connection;
+        slot->routeId = routeId;
+        slot->inRequest.store(true, std::memory_order_release);
+    }
+}
+
+LoopWatchdog::RequestScope::~RequestScope()
+{
+    Slot* slot = t_slot;
+    if(slot)
+    {
+        slot->inRequest.store(false, std::memory_order_release);
+    }
+}
+
+}
+
+}
@@ -0,0 +1,67 @@
+#include "../../include/diagnostics/RequestTrace.h"
+
+#include <cstdio>
+
+namespace http
+{
+
+namespace diagnostics
+{
+
+namespace
+{
+
+// Server-Timing中使用的阶段名
+const char* const kPhaseNames[RequestTrace::kNumPhases] = {
+    "parse", "queue", "mw", "route", "app", "ser", "write"
+};
+
+std::string formatMillis(uint64_t nanos)
+{
+    char buf[32];
+    snprintf(buf, sizeof buf, "%.3f", nanos / 1e6);
+    return buf;
+}
+
+}
+
+void RequestTrace::reset()
+{
+    for(uint64_t& duration: durations_)
+    {
+        duration = 0;
+    }
+    last_ = 0;
+}
+
+std::string RequestTrace::serverTiming() const
+{
+    // 序列化和写入发生在响应头生成之后，只出现在跟踪记录里
+    std::string value;
+    for(int phase = kParse; phase < kSerialize; ++phase)
+    {
+        if(!value.empty())
+        {
+            value += ", ";
+        }
+        value += std::string(kPhaseNames[phase]) + ";dur=" + formatMillis(durations_[phase]);
+    }
+    return value;
+}
+
+std::string RequestTrace::record(const std::string& method, const std::string& path, int statusCode) const
+{
+    uint64_t total = 0;
+    std::string phases;
+    for(int phase = kParse; phase < kNumPhases; ++phase)
+    {
+        total += durations_[phase];
+        phases += std::string(" ") + kPhaseNames[phase] + "=" + formatMillis(durations_[phase]);
+    }
+    return "trace " + method + " " + path + " status=" + std::to_string(statusCode) + 
+           " total=" + formatMillis(total) + "ms" + phases;
+}
+
+}
+
+}
@@ -0,0 +1,282 @@
+#include "../../include/diagnostics/TrafficCapture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "mymuduo/Alogger.h"
+#include "../../include/metrics/Metrics.h"
+
+namespace http
+{
+
+namespace diagnostics
+{
+
+namespace
+{
+
+const char kMagic[8] = {'H', 'T', 'C', 'A', 'P', '1', '\0', '\0'};
+// 至少能放下几条最长的记录
+const size_t kMinRingBytes = 4 * TrafficCapture::kMaxChunk;
+// 后台线程没有数据可写时的休眠时间
+const int kIdleSleepMs = 5;
+
+std::atomic<uint64_t> g_nextInstanceId{1};
+
+size_t roundUpPowerOfTwo(size_t n)
+{
+    size_t capacity = kMinRingBytes;
+    while(capacity < n)
+    {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+}
+
+/*
+    单生产者(所属I/O线程)单消费者(后台线程)的字节环形缓冲区。
+    生产者写完整条记录后才推进head，消费者看到的[tail, head)总是整数条记录
+*/
+struct TrafficCapture::Ring
+{
+    explicit Ring(size_t bytes):
+        data(new char[bytes]),
+        capacity(bytes),
+        mask(bytes - 1)
+    {
+    }
+
+    bool push(const CaptureRecordHeader& header, const char* payload, size_t len)
+    {
+        size_t need = sizeof header + len;
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        if(pos + need - cachedTail > capacity)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if(pos + need - cachedTail > capacity)
+            {
+                dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        copyIn(pos, &header, sizeof header);
+        copyIn(pos + sizeof header, payload, len);
+        head.store(pos + need, std::memory_order_release);
+        return true;
+    }
+
+    void copyIn(uint64_t pos, const void* src, size_t len)
+    {
+        size_t offset = pos & mask;
+        size_t first = std::min(len, capacity - offset);
+        std::memcpy(data.get() + offset, src, first);
+        std::memcpy(data.get(), static_cast<const char*>(src) + first, len - first);
+    }
+
+    std::unique_ptr<char[]> data;
+    const size_t capacity;
+    const size_t mask;
+    alignas(64) std::atomic<uint64_t> head{0};  // 生产者写
+    uint64_t cachedTail = 0;                    // 生产者缓存的tail，空间够用时不读消费者的缓存行
+    std::atomic<uint64_t> dropped{0};           // 生产者写
+    alignas(64) std::atomic<uint64_t> tail{0};  // 消费者写
+};
+
+thread_local TrafficCapture::Ring* TrafficCapture::t_ring = nullptr;
+thread_local uint64_t TrafficCapture::t_ringOwner = 0;
+
+TrafficCapture::TrafficCapture(const CaptureConfig& config):
+    instanceId_(g_nextInstanceId.fetch_add(1)),
+    ringBytes_(roundUpPowerOfTwo(config.ringBytes)),
+    start_(metrics::nowNanos()),
+    file_(::fopen(config.path.c_str(), "wb")),
+    nextConnectionId_(1),
+    writtenBytes_(0),
+    running_(true)
+{
+    if(!file_)
+    {
+        logger_->ERROR("Failed to open capture file " + config.path);
+        abort();
+    }
+    CaptureFileHeader header;
+    std::memcpy(header.magic, kMagic, sizeof kMagic);
+    header.startEpochNanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    ::fwrite(&header, sizeof header, 1, file_);
+    thread_ = std::thread(&TrafficCapture::run, this);
+    logger_->WARN("Capturing inbound traffic to " + config.path);
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    running_ = false;
+    thread_.join();
+    drain();
+    ::fclose(file_);
+}
+
+TrafficCapture::Ring* TrafficCapture::localRing()
+{
+    if(t_ringOwner != instanceId_)
+    {
+        auto ring = std::make_unique<Ring>(ringBytes_);
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        t_ring = ring.get();
+        t_ringOwner = instanceId_;
+        rings_.push_back(std::move(ring));
+    }
+    return t_ring;
+}
+
+void TrafficCapture::append(uint64_t connectionId, CaptureRecordType type, const char* data, size_t len)
+{
+    CaptureRecordHeader header;
+    std::memset(&header, 0, sizeof header);
+    header.timestampNanos = metrics::nowNanos() - start_;
+    header.connectionId = connectionId;
+    header.length = static_cast<uint32_t>(len);
+    header.type = type;
+    localRing()->push(header, data, len);
+}
+
+uint64_t TrafficCapture::openConnection(const std::string& peer)
+{
+    uint64_t id = nextConnectionId_.fetch_add(1, std::memory_order_relaxed);
+    append(id, kCaptureOpen, peer.data(), peer.size());
+    return id;
+}
+
+void TrafficCapture::data(uint64_t connectionId, const char* data, size_t len)
+{
+    while(len > 0)
+    {
+        size_t chunk = std::min(len, kMaxChunk);
+        append(connectionId, kCaptureData, data, chunk);
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+void TrafficCapture::response(uint64_t connectionId, int statusCode)
+{
+    int32_t status = statusCode;
+    append(connectionId, kCaptureResponse, reinterpret_cast<const char*>(&status), sizeof status);
+}
+
+void TrafficCapture::closeConnection(uint64_t connectionId)
+{
+    append(connectionId, kCaptureClose, nullptr, 0);
+}
+
+uint64_t TrafficCapture::droppedRecords() const
+{
+    uint64_t dropped = 0;
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    for(const auto& ring: rings_)
+    {
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+void TrafficCapture::run()
+{
+    while(running_)
+    {
+        if(drain() == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kIdleSleepMs));
+        }
+    }
+}
+
+size_t TrafficCapture::drain()
+{
+    std::vector<Ring*> rings;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        for(const auto& ring: rings_)
+        {
+            rings.push_back(ring.get());
+        }
+    }
+
+    size_t total = 0;
+    for(Ring* ring: rings)
+    {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        if(head == tail)
+        {
+            continue;
+        }
+        size_t len = head - tail;
+        size_t offset = tail & ring->mask;
+        size_t first = std::min(len, ring->capacity - offset);
+        ::fwrite(ring->data.get() + offset, 1, first, file_);
+        ::fwrite(ring->data.get(), 1, len - first, file_);
+        ring->tail.store(head, std::memory_order_release);
+        total += len;
+    }
+    if(total > 0)
+    {
+        ::fflush(file_);
+        writtenBytes_.fetch_add(total, std::memory_order_relaxed);
+    }
+    return total;
+}
+
+bool TrafficCapture::readFile(const std::string& path, std::vector<CaptureRecord>* records, std::string* error)
+{
+    FILE* file = ::fopen(path.c_str(), "rb");
+    if(!file)
+    {
+        *error = "cannot open " + path;
+        return false;
+    }
+    CaptureFileHeader fileHeader;
+    if(::fread(&fileHeader, sizeof fileHeader, 1, file) != 1 || std::memcmp(fileHeader.magic, kMagic, sizeof kMagic) != 0)
+    {
+        ::fclose(file);
+        *error = path + " is not a capture file";
+        return false;
+    }
+
+    records->clear();
+    CaptureRecordHeader header;
+    // 抓包的进程被杀掉时最后一条记录可能不完整，读到那里为止
+    while(::fread(&header, sizeof header, 1, file) == 1)
+    {
+        if(header.type < kCaptureOpen || header.type > kCaptureClose || header.length > kMaxChunk)
+        {
+            ::fclose(file);
+            *error = "corrupt record in " + path;
+            return false;
+        }
+        CaptureRecord record;
+        record.timestampNanos = header.timestampNanos;
+        record.connectionId = header.connectionId;
+        record.type = static_cast<CaptureRecordType>(header.type);
+        record.data.resize(header.length);
+        if(header.length > 0 && ::fread(&record.data[0], 1, header.length, file) != header.length)
+        {
+            break;
+        }
+        records->push_back(std::move(record));
+    }
+    ::fclose(file);
+
+    std::stable_sort(records->begin(), records->end(), [](const CaptureRecord& a, const CaptureRecord& b) {
+        return a.timestampNanos < b.timestampNanos;
+    });
+    return true;
+}
+
+}
+
+}
@@ -0,0 +1,156 @@
+#include "../../include/http/AdmissionController.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "mymuduo/TimeStamp.h"
+
+namespace http
+{
+
+namespace
+{
+
+const double kProbeIntervalSeconds = 0.1;  // 事件循环延迟的探测间隔
+const double kEwmaAlpha = 0.3;             // 滑动平均中新样本的权重
+
+// 每个I/O线程自己的负载统计，只在本线程读写
+struct LoadStats
+{
+    double loopLagMs = 0;
+    double queueDelayMs = 0;
+    int64_t lastProbeUs = 0;
+    bool probing = false;  // 本线程已经有探测定时器，两个定时器交替更新lastProbeUs会把延迟算成负数
+    uint32_t rng = 2463534242u;
+};
+
+thread_local LoadStats t_loadStats;
+
+double ewma(double old, double sample)
+{
+    return old + kEwmaAlpha * (sample - old);
+}
+
+// 超出阈值的比例映射为丢弃概率：阈值处为0，两倍阈值处为1
+double shedProbability(double value, double threshold)
+{
+    if(threshold <= 0 || value <= threshold)
+    {
+        return 0;
+    }
+    return std::min(1.0, (value - threshold) / threshold);
+}
+
+uint32_t xorshift32(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+}
+
+AdmissionController::AdmissionController(const OverloadConfig& config):
+    config_(config),
+    activeConnections_(0),
+    rejectedConnections_(0),
+    shedRequests_(0)
+{
+    overloadResponse_ = "HTTP/1.1 503 Service Unavailable\r\n"
+                        "Connection: close\r\n"
+                        "Retry-After: " + std::to_string(config_.retryAfterSeconds) + "\r\n"
+                        "Content-Length: 0\r\n"
+                        "\r\n";
+}
+
+bool AdmissionController::admitConnection(const std::string& ip)
+{
+    int active = activeConnections_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if(config_.maxConnections > 0 && active > config_.maxConnections)
+    {
+        activeConnections_.fetch_sub(1, std::memory_order_relaxed);
+        rejectedConnections_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if(config_.maxConnectionsPerIp > 0 && !ip.empty())
+    {
+        IpShard& shard = shardFor(ip);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        int& count = shard.counts[ip];
+        if(count >= config_.maxConnectionsPerIp)
+        {
+            activeConnections_.fetch_sub(1, std::memory_order_relaxed);
+            rejectedConnections_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        ++count;
+    }
+    return true;
+}
+
+void AdmissionController::releaseConnection(const std::string& ip)
+{
+    activeConnections_.fetch_sub(1, std::memory_order_relaxed);
+    if(config_.maxConnectionsPerIp > 0 && !ip.empty())
+    {
+        IpShard& shard = shardFor(ip);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.counts.find(ip);
+        if(it != shard.counts.end() && --it->second <= 0)
+        {
+            shard.counts.erase(it);
+        }
+    }
+}
+
+void AdmissionController::startLoopLagProbe(EventLoop* loop)
+{
+    if(config_.maxLoopLagMs <= 0 || t_loadStats.probing)
+    {
+        return;
+    }
+    t_loadStats.probing = true;
+    t_loadStats.lastProbeUs = TimeStamp::now().microSecondsSinceEpoch();
+    loop->runEvery(kProbeIntervalSeconds, []{
+        // 定时器实际触发的时间比预期晚了多少，就是事件循环被阻塞的时间
+        int64_t now = TimeStamp::now().microSecondsSinceEpoch();
+        double lagMs = (now - t_loadStats.lastProbeUs) / 1000.0 - kProbeIntervalSeconds * 1000;
+        t_loadStats.loopLagMs = ewma(t_loadStats.loopLagMs, std::max(lagMs, 0.0));
+        t_loadStats.lastProbeUs = now;
+    });
+}
+
+void AdmissionController::recordQueueDelay(double ms)
+{
+    t_loadStats.queueDelayMs = ewma(t_loadStats.queueDelayMs, ms);
+}
+
+bool AdmissionController::shouldShed()
+{
+    double p = std::max(shedProbability(t_loadStats.loopLagMs, config_.maxLoopLagMs),
+                        shedProbability(t_loadStats.queueDelayMs, config_.maxQueueDelayMs));
+    if(p <= 0)
+    {
+        return false;
+    }
+    if(p < 1 && xorshift32(t_loadStats.rng) >= p * 4294967295.0)
+    {
+        return false;
+    }
+    shedRequests_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+double AdmissionController::loopLagMs()
+{
+    return t_loadStats.loopLagMs;
+}
+
+AdmissionController::IpShard& AdmissionController::shardFor(const std::string& ip)
+{
+    return ipShards_[std::hash<std::string>{}(ip) % kShards];
+}
+
+}
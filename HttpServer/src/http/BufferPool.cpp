@@ -0,0 +1,103 @@
+#include "../../include/http/BufferPool.h"
+#include "../../include/memory/MemoryAccounting.h"
+
+namespace http
+{
+
+namespace
+{
+
+// 池中空闲的Buffer，正在使用的不算
+memory::MemoryAccount g_memoryAccount("buffer_pool_free");
+
+int64_t bufferBytes(const Buffer* buf)
+{
+    return static_cast<int64_t>(sizeof(Buffer) + buf->internalCapacity());
+}
+
+}
+
+const size_t BufferPool::kClassSizes[BufferPool::kNumClasses] = {2 * 1024, 8 * 1024, 32 * 1024, 128 * 1024};
+
+BufferPool::BufferPool(size_t maxPerClass):
+    maxPerClass_(maxPerClass)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    for(size_t i = 0; i < kNumClasses; ++i)
+    {
+        for(Buffer* buf: free_[i])
+        {
+            g_memoryAccount.add(-1, -bufferBytes(buf));
+            delete buf;
+        }
+    }
+}
+
+size_t BufferPool::classFor(size_t size)
+{
+    for(size_t i = 0; i < kNumClasses; ++i)
+    {
+        if(size <= kClassSizes[i])
+        {
+            return i;
+        }
+    }
+    return kNumClasses;
+}
+
+Buffer* BufferPool::acquire(size_t sizeHint)
+{
+    size_t cls = classFor(sizeHint);
+    // 优先用刚好够大的等级，没有时用更大的等级
+    for(size_t i = cls; i < kNumClasses; ++i)
+    {
+        if(!free_[i].empty())
+        {
+            Buffer* buf = free_[i].back();
+            free_[i].pop_back();
+            g_memoryAccount.add(-1, -bufferBytes(buf));
+            return buf;
+        }
+    }
+    return new Buffer(cls < kNumClasses ? kClassSizes[cls] : sizeHint);
+}
+
+void BufferPool::release(Buffer* buf)
+{
+    buf->retrieveAll();
+    size_t capacity = buf->internalCapacity() - Buffer::kCheapPrepend;
+    if(capacity > kClassSizes[kNumClasses - 1])
+    {
+        buf->shrink(kClassSizes[kNumClasses - 1]);  // 收缩回最大等级
+        capacity = buf->internalCapacity() - Buffer::kCheapPrepend;
+    }
+
+    // 放入容量能满足的最大等级
+    size_t cls = kNumClasses;
+    while(cls > 0 && capacity < kClassSizes[cls - 1])
+    {
+        --cls;
+    }
+    if(cls == 0 || free_[cls - 1].size() >= maxPerClass_)
+    {
+        delete buf;  // 不是从池中取出的小Buffer，或者该等级已满
+        return;
+    }
+    free_[cls - 1].push_back(buf);
+    g_memoryAccount.add(1, bufferBytes(buf));
+}
+
+size_t BufferPool::freeCount() const
+{
+    size_t count = 0;
+    for(size_t i = 0; i < kNumClasses; ++i)
+    {
+        count += free_[i].size();
+    }
+    return count;
+}
+
+}
@@ -0,0 +1,44 @@
+#include "../../include/http/ConnectionState.h"
+
+namespace http
+{
+
+ConnectionStatePool::ConnectionStatePool(size_t maxFree):
+    maxFree_(maxFree)
+{
+}
+
+ConnectionStatePool::~ConnectionStatePool()
+{
+    for(ConnectionState* state: free_)
+    {
+        delete state;
+    }
+}
+
+ConnectionState* ConnectionStatePool::acquire()
+{
+    if(free_.empty())
+    {
+        return new ConnectionState();
+    }
+    ConnectionState* state = free_.back();
+    free_.pop_back();
+    return state;
+}
+
+void ConnectionStatePool::release(ConnectionState* state)
+{
+    state->ssl.reset();
+    state->captureId = 0;
+    state->capturedBytes = 0;
+    state->context.recycle();
+    if(free_.size() >= maxFree_)
+    {
+        delete state;
+        return;
+    }
+    free_.push_back(state);
+}
+
+}
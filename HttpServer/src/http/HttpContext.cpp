@@ -1,14 +1,29 @@
 #include "../../include/http/HttpContext.h"
 
+#include <charconv>
 #include <cstring>
 
 namespace http
 {
 
-HttpContext::HttpContext():
-    state_(kExpectRequestLine)
+namespace
 {
 
+memory::MemoryAccount g_memoryAccount("http_context");
+
+}
+
+HttpContext::HttpContext():
+    state_(kExpectRequestLine),
+    timeoutPhase_(kHeaderRead),
+    timeoutGeneration_(0),
+    admitted_(false),
+    parseNanos_(0),
+    readPaused_(false),
+    waitingFlight_(false),
+    memoryTracker_(g_memoryAccount, sizeof(HttpContext))
+{
+    request_.emplace();
 }
 
 
@@ -17,6 +32,12 @@ bool HttpContext::parseRequest(Buffer* buf, TimeStamp receiveTime)
 {
     bool ok = true;  // 解析每行请求格式是否正确
     bool hasMore = true;
+    if(!arena_.active() && buf->readableBytes() > 0)
+    {
+        // 新请求的第一段数据到达时才占用内存池，空闲的keep-alive连接不持有块
+        arena_.begin();
+        request_.emplace(&arena_);
+    }
     while(hasMore)
     {
         /* POST /api/users HTTP/1.1 */
@@ -33,7 +54,7 @@ bool HttpContext::parseRequest(Buffer* buf, TimeStamp receiveTime)
                 ok = processRequestLine(buf->peek(), crlf);  // 可读区域的起始位置，到crlf行结束符之前
                 if(ok)
                 {
-                    request_.setReceiveTime(receiveTime);
+                    request_->setReceiveTime(receiveTime);
                     buf->retrieveUntil(crlf+2);  // 包含了crlf,表示这一段已经读取
                     state_ = kExpectHeaders;  // 检测完请求行后，接下来就是检测请求头
                 }   
@@ -66,19 +87,22 @@ bool HttpContext::parseRequest(Buffer* buf, TimeStamp receiveTime)
                 const char* colon = std::find(buf->peek(), crlf, ':');
                 if(colon < crlf)
                 {
-                    request_.addHeader(buf->peek(), colon, crlf);
+                    request_->addHeader(buf->peek(), colon, crlf);
                 }
                 else if(buf->peek() == crlf)  // 空行， 说明头结束了
                 {
                     // 根据请求方法和Content-Length判断是否需要继续读取body
-                    if(request_.method() == HttpRequest::kPost || 
-                        request_.method() == HttpRequest::kPut)  // 只有这两种方法需要body
+                    if(request_->method() == HttpRequest::kPost || 
+                        request_->method() == HttpRequest::kPut)  // 只有这两种方法需要body
                     {
-                        std::string contentLength = request_.getHeader("Content-Length");
-                        if(!contentLength.empty())
+                        const std::pmr::string& contentLength = request_->getHeader("Content-Length");
+                        // 直接在头部的值上解析，不构造临时字符串
+                        uint64_t length = 0;
+                        const char* last = contentLength.data() + contentLength.size();
+                        if(!contentLength.empty() && std::from_chars(contentLength.data(), last, length).ptr == last)
                         {
-                            request_.setContentLength(std::stoi(contentLength));
-                            if(request_.contentLength() > 0)
+                            request_->setContentLength(length);
+                            if(request_->contentLength() > 0)
                             {
                                 state_ = kExpectBody;  // 大于0说明需要继续读取body
                             }
@@ -90,7 +114,7 @@ bool HttpContext::parseRequest(Buffer* buf, TimeStamp receiveTime)
                         }
                         else
                         {
-                            // POST/PUT 请求没有 Content-Length, 是HTTP语法错误
+                            // POST/PUT 请求没有合法的 Content-Length, 是HTTP语法错误
                             ok = false;
                             hasMore = false;
                         }
@@ -116,18 +140,17 @@ bool HttpContext::parseRequest(Buffer* buf, TimeStamp receiveTime)
         else if(state_ == kExpectBody)
         {
             // 检查缓冲区中是否有足够的数据
-            if(buf->readableBytes() < request_.contentLength())
+            if(buf->readableBytes() < request_->contentLength())
             {
                 hasMore = false;  // 数据不完整，等待更多数据
                 return true;
             }
 
-            // 只读取Content-Length指定的长度
-            std::string body(buf->peek(), buf->peek() + request_.contentLength());
-            request_.setBody(body);
+            // 只读取Content-Length指定的长度，直接拷贝到内存池上
+            request_->setBody(buf->peek(), buf->peek() + request_->contentLength());
 
             // 准备移动读指针
-            buf->retrieve(request_.contentLength());
+            buf->retrieve(request_->contentLength());
 
             state_ = kGotAll;
             hasMore = false;
@@ -140,8 +163,22 @@ bool HttpContext::parseRequest(Buffer* buf, TimeStamp receiveTime)
 void HttpContext::reset()
 {
     state_ = kExpectRequestLine;
-    HttpRequest dummyData;
-    request_.swap(dummyData);  // swap中包含各种成员变量的交换
+    parseNanos_ = 0;
+    // 先销毁请求再归还内存池，新构造的空请求使用全局分配器但不会分配
+    request_.emplace();
+    arena_.end();
+}
+
+
+void HttpContext::recycle()
+{
+    reset();
+    timeoutPhase_ = kHeaderRead;
+    // timeoutGeneration_继续递增，时间轮中属于上一个连接的条目不会误匹配
+    peerIp_.clear();
+    admitted_ = false;
+    readPaused_ = false;
+    waitingFlight_ = false;
 }
 
 
@@ -154,7 +191,7 @@ bool HttpContext::processRequestLine(const char* begin, const char* end)
     bool succeed = false;
     const char* start = begin;
     const char* space = std::find(start, end, ' ');  // 找到第一个空格
-    if(space != end && request_.setMethod(start, space));  // 左闭右开，故截取的就是POST
+    if(space != end && request_->setMethod(start, space));  // 左闭右开，故截取的就是POST
     {
         start = space + 1;
         space = std::find(start, end, ' '); 
@@ -163,12 +200,12 @@ bool HttpContext::processRequestLine(const char* begin, const char* end)
             const char* argumentStart = std::find(start, end, '?');  // 参数从？后面开始
             if(argumentStart != end)  // 请求中带有参数
             {
-                request_.setPath(start, argumentStart);   // /api/products
-                request_.setQueryParameters(argumentStart + 1, space);  // 让request_自己分割
+                request_->setPath(start, argumentStart);   // /api/products
+                request_->setQueryParameters(argumentStart + 1, space);  // 让request_自己分割
             }
             else  // 请求中不带有参数
             {
-                request_.setPath(start, space);
+                request_->setPath(start, space);
             }
 
             start = space + 1;  // 来到HTTP/1.1的‘H’处
@@ -178,11 +215,11 @@ bool HttpContext::processRequestLine(const char* begin, const char* end)
             {   // HTTP的两种版本，定义了客户端和服务器之间如何交换数据
                 if(*(end-1) == '1')
                 {
-                    request_.setVersion("HTTP/1.1");
+                    request_->setVersion("HTTP/1.1");
                 }
                 else if(*(end - 1) == '0')
                 {
-                    request_.setVersion("HTTP/1.0");
+                    request_->setVersion("HTTP/1.0");
                 }
                 else
                 {
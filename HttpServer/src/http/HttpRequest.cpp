@@ -1,13 +1,27 @@
 #include "../../include/http/HttpRequest.h"
 
+#include <algorithm>
 #include <cassert>
 
 namespace http
 {
 
 HttpRequest::HttpRequest():
+    HttpRequest(std::pmr::get_default_resource())
+{
+
+}
+
+HttpRequest::HttpRequest(std::pmr::memory_resource* resource):
     method_(kInvalid),
-    version_("Unknown")
+    version_("Unknown"),
+    pathParameters_(resource),
+    queryParameters_(resource),
+    query_(resource),
+    headers_(resource),
+    content_(resource),
+    peerIp_(resource),
+    clientIp_(resource)
 {
 
 }
@@ -39,6 +53,20 @@ bool HttpRequest::setMethod(const char* start, const char* end)
     return method_ != kInvalid;  // 判断是否修改成功
 }
 
+const char* HttpRequest::methodString(Method method)
+{
+    switch(method)
+    {
+        case kGet: return "GET";
+        case kPost: return "POST";
+        case kHead: return "HEAD";
+        case kPut: return "PUT";
+        case kDelete: return "DELETE";
+        case kOptions: return "OPTIONS";
+        default: return "INVALID";
+    }
+}
+
 
 void HttpRequest::setPath(const char* start, const char* end)
 {
@@ -47,106 +75,109 @@ void HttpRequest::setPath(const char* start, const char* end)
 }
 
 
-void HttpRequest::setPathParameters(const std::string &key, const std::string &value)
+void HttpRequest::setPathParameters(std::string_view key, std::string_view value)
 {
-    pathParameters_[key] = value;
+    auto it = pathParameters_.find(key);
+    if(it != pathParameters_.end())
+    {
+        it->second.assign(value);
+    }
+    else
+    {
+        pathParameters_.emplace(key, value);  // 键和值都用容器的分配器构造
+    }
 }
 
-std::string HttpRequest::getPathParameters(const std::string &key) const
+const std::pmr::string& HttpRequest::getPathParameters(std::string_view key) const
 {
+    static const std::pmr::string empty;
     auto it = pathParameters_.find(key);
     if(it != pathParameters_.end())
     {
         return it->second;
     }
-    return "";
+    return empty;
 }
 
 
 void HttpRequest::setQueryParameters(const char* start, const char* end)
 {   // 带参数的请求行例子：page=2&limit=20&sort=name&order=asc
-    std::string argumentStr(start, end);
-    std::string::size_type pos = 0;
-    std::string::size_type prev = 0;
-
-    // 按照‘&’分割参数列表
-    while((pos = argumentStr.find('&', prev)) != std::string::npos)
+    query_.assign(start, end);
+    // 直接在请求行的内存上按‘&’分割参数列表，只为键和值各构造一次字符串
+    while(start < end)
     {
-        std::string pair = argumentStr.substr(prev, pos-prev);
-        std::string::size_type equalPos = pair.find('=');
-        if(equalPos != std::string::npos)
+        const char* amp = std::find(start, end, '&');
+        const char* equal = std::find(start, amp, '=');
+        if(equal != amp)
         {
-            std::string key = pair.substr(prev, equalPos);
-            std::string value = pair.substr(equalPos+1, pos);
-            queryParameters_[key] = value;
+            std::string_view key(start, equal - start);
+            std::string_view value(equal + 1, amp - equal - 1);
+            auto it = queryParameters_.find(key);
+            if(it != queryParameters_.end())
+            {
+                it->second.assign(value);
+            }
+            else
+            {
+                queryParameters_.emplace(key, value);
+            }
         }
-        prev = pos + 1;
+        start = (amp == end) ? end : amp + 1;
     }
-    // 因为&不会出现在最后一个参数的结尾，因此最后一个要单独处理一下
-    std::string pair = argumentStr.substr(prev, pos-prev);
-    std::string::size_type equalPos = pair.find('=');
-    if(equalPos != std::string::npos)
-    {
-        std::string key = pair.substr(prev, equalPos);
-        std::string value = pair.substr(equalPos+1, pos);
-        queryParameters_[key] = value;
-    }
-
 }
 
-std::string HttpRequest::getQueryParameters(const std::string &key) const
+const std::pmr::string& HttpRequest::getQueryParameters(std::string_view key) const
 {
+    static const std::pmr::string empty;
     auto it = queryParameters_.find(key);
-    if(it != pathParameters_.end())
+    if(it != queryParameters_.end())
     {
         return it->second;
     }
-    return "";
+    return empty;
 }
 
-
 void HttpRequest::addHeader(const char* start, const char* colon, const char* end)
 {   // 请求头里有很多组，应该多次调用
-    std::string key(start, colon++);  // colon应该是“：”的位置
+    const char* keyEnd = colon++;  // colon应该是“：”的位置
     while(colon < end && isspace(*colon))  // 跳过空格
     {
         ++colon;
     }
-    std::string value(colon, end);
-    while(!value.empty() && isspace(value[value.size() - 1]))  // 判断结尾是否是空
+    while(end > colon && isspace(*(end - 1)))  // 去掉结尾的空白，先确定范围再构造，避免多次修改字符串
+    {
+        --end;
+    }
+    std::string_view key(start, keyEnd - start);
+    auto it = headers_.find(key);
+    if(it != headers_.end())
+    {
+        it->second.assign(colon, end);
+    }
+    else
     {
-        value.resize(value.size() - 1);
+        headers_.emplace(key, std::string_view(colon, end - colon));
     }
-    headers_[key] = value;
 }
 
-std::string HttpRequest::getHeader(const std::string& field) const
+const std::pmr::string& HttpRequest::getHeader(std::string_view field) const
 {   // field: “Host”, "User-Agent", .....
+    static const std::pmr::string empty;
     auto it = headers_.find(field);
     if(it != headers_.end())
     {
         return it->second;
     }
-    return "";
+    return empty;
 }
 
 
+
+
 void HttpRequest::setBody(const char* start, const char* end)
 {   // 应该就是直接{}的一托
     content_.assign(start, end);
 }
 
 
-void HttpRequest::swap(HttpRequest& that)
-{
-    std::swap(method_, that.method_);
-    std::swap(path_, that.path_);
-    std::swap(pathParameters_, that.pathParameters_);
-    std::swap(queryParameters_, that.queryParameters_);
-    std::swap(version_, that.version_);
-    std::swap(headers_, that.headers_);
-    std::swap(receiveTime_, that.receiveTime_);
-}
-
-
 }
\ No newline at end of file
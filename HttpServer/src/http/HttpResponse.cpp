@@ -3,14 +3,30 @@
 namespace http
 {
 
-HttpResponse::HttpResponse(bool close):
+HttpResponse::HttpResponse(bool close, std::pmr::memory_resource* resource):
     statusCode_(kUnknown),
-    closeConnection_(close)
+    closeConnection_(close),
+    headers_(resource),
+    body_(resource)
 {
 
 }
 
 
+void HttpResponse::addHeader(std::string_view key, std::string_view value)
+{
+    auto it = headers_.find(key);
+    if(it != headers_.end())
+    {
+        it->second.assign(value);
+    }
+    else
+    {
+        headers_.emplace(key, value);
+    }
+}
+
+
 void HttpResponse::setStatusLine(const std::string& version, 
                         HttpStatusCode statusCode, 
                         const std::string& statusMessage)
@@ -52,13 +68,33 @@ void HttpResponse::appendToBuffer(Buffer* outputBuf) const
     
     for(const auto& header: headers_)
     {
-        outputBuf->append(header.first);
+        outputBuf->append(header.first.data(), header.first.size());
         outputBuf->append(": ");
-        outputBuf->append(header.second);
+        outputBuf->append(header.second.data(), header.second.size());
         outputBuf->append("\r\n");
     }
+    if(serializedTail_)
+    {
+        outputBuf->append(*serializedTail_);  // 已经包含了其余头部、空行和响应体
+        return;
+    }
     outputBuf->append("\r\n");  // 空行
-    outputBuf->append(body_);   // 响应体
+    outputBuf->append(body_.data(), body_.size());   // 响应体
+}
+
+std::string HttpResponse::serializeTail() const
+{
+    std::string tail;
+    for(const auto& header: headers_)
+    {
+        tail += header.first;
+        tail += ": ";
+        tail += header.second;
+        tail += "\r\n";
+    }
+    tail += "\r\n";
+    tail += body_;
+    return tail;
 }
 
 }
\ No newline at end of file
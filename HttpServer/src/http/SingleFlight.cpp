@@ -0,0 +1,99 @@
+#include "../../include/http/SingleFlight.h"
+
+#include <algorithm>
+
+namespace http
+{
+
+SingleFlight::SingleFlight(const SingleFlightConfig& config):
+    config_(config)
+{
+
+}
+
+std::string SingleFlight::keyFor(const HttpRequest& req) const
+{
+    if(req.method() != HttpRequest::kGet || 
+       std::find(config_.paths.begin(), config_.paths.end(), req.path()) == config_.paths.end())
+    {
+        return std::string();
+    }
+
+    std::string key = req.path();
+    key += '?';
+    key += req.query();
+    for(const std::string& header: config_.varyHeaders)
+    {
+        key += '\n';
+        key += header;
+        key += ':';
+        key += req.getHeader(header);
+    }
+    return key;
+}
+
+bool SingleFlight::join(const std::string& key, const std::function<Waiter()>& makeWaiter)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = flights_.find(key);
+    if(it == flights_.end())
+    {
+        flights_.emplace(key, std::vector<Waiter>());
+        return true;
+    }
+    it->second.push_back(makeWaiter());
+    return false;
+}
+
+void SingleFlight::complete(const std::string& key, const Result& result)
+{
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = flights_.find(key);
+        if(it == flights_.end())
+        {
+            return;
+        }
+        waiters.swap(it->second);
+        flights_.erase(it);
+    }
+    // 锁外唤醒，waiter里会跨线程投递任务
+    for(const Waiter& waiter: waiters)
+    {
+        waiter(result);
+    }
+}
+
+SingleFlight::Flight::Flight(SingleFlight* owner, std::string key, std::function<Waiter()> makeWaiter):
+    owner_(owner),
+    key_(std::move(key)),
+    makeWaiter_(std::move(makeWaiter)),
+    state_(kIdle)
+{
+
+}
+
+SingleFlight::Flight::~Flight()
+{
+    if(state_ == kLeader)
+    {
+        // 没有走到complete()，等待者拿到500，而不是各自重新执行一次失败的处理
+        static const std::shared_ptr<const std::string> kFailedTail = std::make_shared<const std::string>("Content-Length: 0\r\n\r\n");
+        owner_->complete(key_, Result{HttpResponse::k500InternalServerError, "Internal Server Error", kFailedTail});
+    }
+}
+
+bool SingleFlight::Flight::join()
+{
+    state_ = owner_->join(key_, makeWaiter_) ? kLeader : kWaiting;
+    return state_ == kLeader;
+}
+
+void SingleFlight::Flight::complete(const Result& result)
+{
+    state_ = kDone;
+    owner_->complete(key_, result);
+}
+
+}
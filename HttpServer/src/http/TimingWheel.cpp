@@ -0,0 +1,84 @@
+#include "../../include/http/TimingWheel.h"
+
+#include <algorithm>
+
+namespace http
+{
+
+TimingWheel::TimingWheel(EventLoop* loop, int maxTimeout, const ExpireCallback& cb):
+    loop_(loop),
+    alive_(std::make_shared<bool>(true)),
+    buckets_(std::max(maxTimeout, 1) + 1),  // 多一格，保证current_ + maxTimeout不会落在当前格
+    current_(0),
+    size_(0),
+    expireCallback_(cb)
+{
+
+}
+
+void TimingWheel::start()
+{
+    // mymuduo的定时器无法可靠地取消，这里让定时器在时间轮析构后什么都不做
+    std::weak_ptr<bool> alive = alive_;
+    loop_->runEvery(1.0, [this, alive] {
+        if(alive.lock())
+        {
+            onTick();
+        }
+    });
+}
+
+void TimingWheel::add(const TcpConnectionPtr& conn, uint64_t generation, int seconds, Slot* slot)
+{
+    int maxSeconds = static_cast<int>(buckets_.size()) - 1;
+    seconds = std::min(std::max(seconds, 1), maxSeconds);
+    size_t target = (current_ + seconds) % buckets_.size();
+    if(slot->linked)
+    {
+        // 已有的条目直接挪到新的桶，不重新分配
+        buckets_[target].splice(buckets_[target].end(), buckets_[slot->bucket], slot->entry);
+        slot->entry->generation = generation;
+    }
+    else
+    {
+        slot->entry = buckets_[target].insert(buckets_[target].end(), Entry{conn, generation, slot});
+        slot->linked = true;
+        ++size_;
+    }
+    slot->bucket = target;
+}
+
+void TimingWheel::remove(Slot* slot)
+{
+    if(slot->linked)
+    {
+        buckets_[slot->bucket].erase(slot->entry);
+        slot->linked = false;
+        --size_;
+    }
+}
+
+void TimingWheel::onTick()
+{
+    current_ = (current_ + 1) % buckets_.size();
+
+    /*
+        逐个取出到期的条目再回调：回调中可能删除同一个桶里的其他条目(关闭连接)，
+        也可能重新添加条目，但新条目至少落在下一格，不会回到当前格
+    */
+    Bucket& bucket = buckets_[current_];
+    while(!bucket.empty())
+    {
+        Entry entry = std::move(bucket.front());
+        bucket.pop_front();
+        entry.slot->linked = false;
+        --size_;
+        TcpConnectionPtr conn = entry.conn.lock();
+        if(conn)
+        {
+            expireCallback_(conn, entry.generation);
+        }
+    }
+}
+
+}
@@ -0,0 +1,138 @@
+#include "../../include/memory/MemoryAccounting.h"
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+
+namespace http
+{
+
+namespace memory
+{
+
+namespace
+{
+
+// 每个线程一份计数，只有所属线程写，usage()合并时读
+struct ThreadAccounts
+{
+    std::atomic<int64_t> objects[MemoryAccount::kMaxAccounts];
+    std::atomic<int64_t> bytes[MemoryAccount::kMaxAccounts];
+
+    ThreadAccounts()
+    {
+        for(int i = 0; i < MemoryAccount::kMaxAccounts; ++i)
+        {
+            objects[i].store(0, std::memory_order_relaxed);
+            bytes[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// 静态对象的构造顺序不确定，登记表放在函数内的静态变量里；线程退出后计数仍然保留
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<const MemoryAccount*> accounts;
+    std::vector<std::unique_ptr<ThreadAccounts>> threads;
+};
+
+Registry& registry()
+{
+    // 故意不析构：其他静态对象析构时可能还在记账
+    static Registry* instance = new Registry;
+    return *instance;
+}
+
+ThreadAccounts& localAccounts()
+{
+    thread_local ThreadAccounts* accounts = nullptr;
+    if(!accounts)
+    {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(std::make_unique<ThreadAccounts>());
+        accounts = reg.threads.back().get();
+    }
+    return *accounts;
+}
+
+void add(std::atomic<int64_t>& counter, int64_t n)
+{
+    // 单写者，不需要原子的读改写
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+}
+
+MemoryAccount::MemoryAccount(const char* name):
+    name_(name)
+{
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if(reg.accounts.size() >= static_cast<size_t>(kMaxAccounts))
+    {
+        std::fprintf(stderr, "too many memory accounts, raise MemoryAccount::kMaxAccounts\n");
+        abort();
+    }
+    index_ = static_cast<int>(reg.accounts.size());
+    reg.accounts.push_back(this);
+}
+
+void MemoryAccount::add(int64_t objects, int64_t bytes)
+{
+    ThreadAccounts& accounts = localAccounts();
+    memory::add(accounts.objects[index_], objects);
+    memory::add(accounts.bytes[index_], bytes);
+}
+
+std::vector<MemoryUsage> MemoryAccount::usage()
+{
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    std::vector<MemoryUsage> result(reg.accounts.size());
+    for(size_t i = 0; i < reg.accounts.size(); ++i)
+    {
+        result[i].name = reg.accounts[i]->name();
+        for(const auto& thread: reg.threads)
+        {
+            result[i].objects += thread->objects[i].load(std::memory_order_relaxed);
+            result[i].bytes += thread->bytes[i].load(std::memory_order_relaxed);
+        }
+    }
+    return result;
+}
+
+size_t residentBytes()
+{
+    // 第二项是常驻的页数
+    FILE* statm = ::fopen("/proc/self/statm", "r");
+    if(!statm)
+    {
+        return 0;
+    }
+    unsigned long size = 0, resident = 0;
+    int n = ::fscanf(statm, "%lu %lu", &size, &resident);
+    ::fclose(statm);
+    return n == 2 ? resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE)) : 0;
+}
+
+size_t heapInUseBytes()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = ::mallinfo2();
+    // 主堆和各个线程arena中已分配的小块，加上直接mmap的大块
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+}
+
+}
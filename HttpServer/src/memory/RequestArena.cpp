@@ -0,0 +1,219 @@
+#include "../../include/memory/RequestArena.h"
+#include "../../include/memory/MemoryAccounting.h"
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace http
+{
+
+namespace memory
+{
+
+namespace
+{
+
+// 每个线程一份统计，只有所属线程写，stats()合并时读
+struct ThreadStats
+{
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> upstreamAllocations{0};
+};
+
+// 线程退出后统计仍然保留，和指标分片一样只增不减
+std::mutex g_statsMutex;
+std::vector<std::unique_ptr<ThreadStats>> g_stats;
+
+ThreadStats& localStats()
+{
+    thread_local ThreadStats* stats = nullptr;
+    if(!stats)
+    {
+        std::lock_guard<std::mutex> lock(g_statsMutex);
+        g_stats.push_back(std::make_unique<ThreadStats>());
+        stats = g_stats.back().get();
+    }
+    return *stats;
+}
+
+void add(std::atomic<uint64_t>& counter, uint64_t n)
+{
+    // 单写者，不需要原子的读改写
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// 所有存在的块，包括正在使用的和各线程缓存的
+MemoryAccount g_slabAccount("request_arena_slab");
+
+// 本线程空闲的块，连接上同时进行中的请求一般不多，超过上限的直接释放
+const size_t kMaxCachedSlabs = 64;
+
+struct SlabCache
+{
+    std::vector<void*> slabs;
+
+    ~SlabCache();
+};
+
+thread_local SlabCache t_slabCache;
+// 线程退出时缓存可能先于仍在使用内存池的连接析构，之后归还的块直接释放
+thread_local bool t_slabCacheDestroyed = false;
+
+SlabCache::~SlabCache()
+{
+    for(void* slab: slabs)
+    {
+        g_slabAccount.add(-1, -static_cast<int64_t>(RequestArena::kSlabSize));
+        ::operator delete(slab);
+    }
+    slabs.clear();
+    t_slabCacheDestroyed = true;
+}
+
+void* acquireSlab()
+{
+    if(!t_slabCacheDestroyed && !t_slabCache.slabs.empty())
+    {
+        void* slab = t_slabCache.slabs.back();
+        t_slabCache.slabs.pop_back();
+        return slab;
+    }
+    g_slabAccount.add(1, static_cast<int64_t>(RequestArena::kSlabSize));
+    return ::operator new(RequestArena::kSlabSize);
+}
+
+void releaseSlab(void* slab)
+{
+    if(!t_slabCacheDestroyed && t_slabCache.slabs.size() < kMaxCachedSlabs)
+    {
+        t_slabCache.slabs.push_back(slab);
+        return;
+    }
+    g_slabAccount.add(-1, -static_cast<int64_t>(RequestArena::kSlabSize));
+    ::operator delete(slab);
+}
+
+thread_local std::pmr::memory_resource* t_current = nullptr;
+
+// allocateTagged在每块前面保留的头部，保持max_align_t对齐
+const size_t kTagSize = alignof(std::max_align_t);
+
+}
+
+void* RequestArena::Upstream::do_allocate(size_t bytes, size_t alignment)
+{
+    ++allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void RequestArena::Upstream::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+RequestArena::RequestArena():
+    slab_(nullptr),
+    allocations_(0),
+    bytes_(0)
+{
+
+}
+
+RequestArena::~RequestArena()
+{
+    end();
+}
+
+void RequestArena::begin()
+{
+    if(resource_)
+    {
+        return;
+    }
+    slab_ = acquireSlab();
+    resource_.emplace(slab_, kSlabSize, &upstream_);
+}
+
+void RequestArena::end()
+{
+    if(!resource_)
+    {
+        return;
+    }
+    resource_.reset();  // 释放向上游申请的内存
+    releaseSlab(slab_);
+    slab_ = nullptr;
+
+    ThreadStats& stats = localStats();
+    add(stats.requests, 1);
+    add(stats.allocations, allocations_);
+    add(stats.bytes, bytes_);
+    add(stats.upstreamAllocations, upstream_.allocations);
+    allocations_ = 0;
+    bytes_ = 0;
+    upstream_.allocations = 0;
+}
+
+void* RequestArena::do_allocate(size_t bytes, size_t alignment)
+{
+    // 只有begin()之后构造的请求会从这里分配，拷贝出来的请求使用全局分配器
+    assert(resource_);
+    ++allocations_;
+    bytes_ += bytes;
+    return resource_->allocate(bytes, alignment);
+}
+
+ArenaStats RequestArena::stats()
+{
+    ArenaStats total;
+    std::lock_guard<std::mutex> lock(g_statsMutex);
+    for(const auto& stats: g_stats)
+    {
+        total.requests += stats->requests.load(std::memory_order_relaxed);
+        total.allocations += stats->allocations.load(std::memory_order_relaxed);
+        total.bytes += stats->bytes.load(std::memory_order_relaxed);
+        total.upstreamAllocations += stats->upstreamAllocations.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::pmr::memory_resource* currentResource()
+{
+    return t_current ? t_current : std::pmr::new_delete_resource();
+}
+
+ArenaScope::ArenaScope(std::pmr::memory_resource* resource):
+    previous_(t_current)
+{
+    t_current = resource;
+}
+
+ArenaScope::~ArenaScope()
+{
+    t_current = previous_;
+}
+
+void* allocateTagged(size_t bytes)
+{
+    std::pmr::memory_resource* resource = currentResource();
+    char* block = static_cast<char*>(resource->allocate(bytes + kTagSize, alignof(std::max_align_t)));
+    *reinterpret_cast<std::pmr::memory_resource**>(block) = resource;
+    return block + kTagSize;
+}
+
+void deallocateTagged(void* p, size_t bytes) noexcept
+{
+    char* block = static_cast<char*>(p) - kTagSize;
+    std::pmr::memory_resource* resource = *reinterpret_cast<std::pmr::memory_resource**>(block);
+    resource->deallocate(block, bytes + kTagSize, alignof(std::max_align_t));
+}
+
+}
+
+}
@@ -0,0 +1,112 @@
+#include "../../include/metrics/Histogram.h"
+
+#include <cmath>
+
+namespace http
+{
+
+namespace metrics
+{
+
+Histogram::Histogram():
+    count_(0),
+    sum_(0)
+{
+    for(auto& bucket: buckets_)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+int Histogram::bucketIndex(uint64_t value)
+{
+    if(value < static_cast<uint64_t>(kSubBuckets))
+    {
+        return static_cast<int>(value);
+    }
+    int magnitude = 63 - __builtin_clzll(value);  // 最高位
+    if(magnitude > kMaxMagnitude)
+    {
+        return kNumBuckets - 1;
+    }
+    int shift = magnitude - kSubBucketBits;
+    int sub = static_cast<int>((value >> shift) & (kSubBuckets - 1));
+    return kSubBuckets + shift * kSubBuckets + sub;
+}
+
+uint64_t Histogram::bucketUpperBound(int index)
+{
+    if(index < kSubBuckets)
+    {
+        return static_cast<uint64_t>(index);
+    }
+    int shift = (index - kSubBuckets) / kSubBuckets;
+    int sub = (index - kSubBuckets) % kSubBuckets;
+    uint64_t lower = static_cast<uint64_t>(kSubBuckets + sub) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+}
+
+HistogramSnapshot::HistogramSnapshot():
+    buckets_(Histogram::kNumBuckets, 0),
+    count_(0),
+    sum_(0)
+{
+
+}
+
+void HistogramSnapshot::merge(const Histogram& histogram)
+{
+    for(int i = 0; i < Histogram::kNumBuckets; ++i)
+    {
+        buckets_[i] += histogram.buckets_[i].load(std::memory_order_relaxed);
+    }
+    count_ += histogram.count_.load(std::memory_order_relaxed);
+    sum_ += histogram.sum_.load(std::memory_order_relaxed);
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other)
+{
+    for(int i = 0; i < Histogram::kNumBuckets; ++i)
+    {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+}
+
+uint64_t HistogramSnapshot::countAtOrBelow(uint64_t value) const
+{
+    uint64_t total = 0;
+    for(int i = 0; i < Histogram::kNumBuckets && Histogram::bucketUpperBound(i) <= value; ++i)
+    {
+        total += buckets_[i];
+    }
+    return total;
+}
+
+uint64_t HistogramSnapshot::quantile(double q) const
+{
+    if(count_ == 0)
+    {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(std::ceil(q * count_));
+    if(target == 0)
+    {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < Histogram::kNumBuckets; ++i)
+    {
+        seen += buckets_[i];
+        if(seen >= target)
+        {
+            return Histogram::bucketUpperBound(i);
+        }
+    }
+    return Histogram::bucketUpperBound(Histogram::kNumBuckets - 1);
+}
+
+}
+
+}
@@ -0,0 +1,323 @@
+#include "../../include/metrics/Metrics.h"
+
+#include <cstdio>
+
+namespace http
+{
+
+namespace metrics
+{
+
+namespace
+{
+
+thread_local ThreadMetrics* t_metrics = nullptr;
+
+// 导出时使用的直方图边界(秒)
+const double kExportBuckets[] = {
+    0.00001, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+    0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+const double kExportQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+const char* phaseName(int phase)
+{
+    switch(phase)
+    {
+        case kParse: return "parse";
+        case kQueue: return "queue";
+        case kHandler: return "handler";
+        case kWrite: return "write";
+        default: return "unknown";
+    }
+}
+
+std::string escapeLabel(const std::string& value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for(char c: value)
+    {
+        if(c == '\\' || c == '"')
+        {
+            escaped += '\\';
+        }
+        if(c == '\n')
+        {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+std::string formatDouble(double value)
+{
+    char buf[32];
+    snprintf(buf, sizeof buf, "%.9g", value);
+    return buf;
+}
+
+// 输出一个直方图：_bucket / _sum / _count，以及单独的分位数
+void appendHistogram(std::string& out, const std::string& name, const std::string& labels, 
+                     const HistogramSnapshot& snapshot)
+{
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    for(double bound: kExportBuckets)
+    {
+        uint64_t count = snapshot.countAtOrBelow(static_cast<uint64_t>(bound * 1e9));
+        out += name + "_bucket{" + prefix + "le=\"" + formatDouble(bound) + "\"} " + std::to_string(count) + "\n";
+    }
+    out += name + "_bucket{" + prefix + "le=\"+Inf\"} " + std::to_string(snapshot.count()) + "\n";
+    out += name + "_sum{" + labels + "} " + formatDouble(snapshot.sum() / 1e9) + "\n";
+    out += name + "_count{" + labels + "} " + std::to_string(snapshot.count()) + "\n";
+}
+
+void appendQuantiles(std::string& out, const std::string& name, const std::string& labels,
+                     const HistogramSnapshot& snapshot)
+{
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    for(double q: kExportQuantiles)
+    {
+        out += name + "{" + prefix + "quantile=\"" + formatDouble(q) + "\"} " + 
+               formatDouble(snapshot.quantile(q) / 1e9) + "\n";
+    }
+}
+
+}
+
+ThreadMetrics::ThreadMetrics()
+{
+    for(auto& route: routes_)
+    {
+        route.store(nullptr, std::memory_order_relaxed);
+    }
+    for(auto& timer: timers_)
+    {
+        timer.store(nullptr, std::memory_order_relaxed);
+    }
+    for(auto& count: statusCounts_)
+    {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+ThreadMetrics::~ThreadMetrics()
+{
+    for(auto& route: routes_)
+    {
+        delete route.load(std::memory_order_relaxed);
+    }
+    for(auto& timer: timers_)
+    {
+        delete timer.load(std::memory_order_relaxed);
+    }
+}
+
+void ThreadMetrics::recordPhase(int routeId, Phase phase, uint64_t nanos)
+{
+    routeMetrics(routeId)->phases[phase].record(nanos);
+}
+
+void ThreadMetrics::countStatus(int code)
+{
+    if(code <= 0 || code >= kMaxStatus)
+    {
+        code = 0;
+    }
+    std::atomic<uint64_t>& counter = statusCounts_[code];
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void ThreadMetrics::recordTimer(int timerId, uint64_t nanos)
+{
+    Histogram* histogram = timer(timerId);
+    if(histogram)
+    {
+        histogram->record(nanos);
+    }
+}
+
+ThreadMetrics::RouteMetrics* ThreadMetrics::routeMetrics(int routeId)
+{
+    if(routeId < 0 || routeId >= kMaxRoutes)
+    {
+        routeId = 0;
+    }
+    RouteMetrics* metrics = routes_[routeId].load(std::memory_order_relaxed);
+    if(!metrics)
+    {
+        // 只有本线程会创建，release保证采集线程看到的是构造完成的对象
+        metrics = new RouteMetrics;
+        routes_[routeId].store(metrics, std::memory_order_release);
+    }
+    return metrics;
+}
+
+Histogram* ThreadMetrics::timer(int timerId)
+{
+    if(timerId < 0 || timerId >= kMaxTimers)
+    {
+        return nullptr;
+    }
+    Histogram* histogram = timers_[timerId].load(std::memory_order_relaxed);
+    if(!histogram)
+    {
+        histogram = new Histogram;
+        timers_[timerId].store(histogram, std::memory_order_release);
+    }
+    return histogram;
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+    routes_.emplace_back("", "unmatched");  // 0号路由：未匹配到的请求
+}
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+    // 故意不析构：进程退出时可能还有线程(如数据库检查线程)在写自己的分片
+    static MetricsRegistry* registry = new MetricsRegistry;
+    return *registry;
+}
+
+ThreadMetrics& MetricsRegistry::local()
+{
+    if(!t_metrics)
+    {
+        t_metrics = instance().createShard();
+    }
+    return *t_metrics;
+}
+
+ThreadMetrics* MetricsRegistry::createShard()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    shards_.push_back(std::make_unique<ThreadMetrics>());
+    return shards_.back().get();
+}
+
+int MetricsRegistry::routeId(const std::string& method, const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto key = std::make_pair(method, path);
+    auto it = routeIds_.find(key);
+    if(it != routeIds_.end())
+    {
+        return it->second;
+    }
+    int id = static_cast<int>(routes_.size());
+    routes_.push_back(key);
+    routeIds_[key] = id;
+    return id;
+}
+
+int MetricsRegistry::timerId(const std::string& name, const std::string& help)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(size_t i = 0; i < timers_.size(); ++i)
+    {
+        if(timers_[i].first == name)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    timers_.emplace_back(name, help);
+    return static_cast<int>(timers_.size()) - 1;
+}
+
+std::string MetricsRegistry::routeName(int routeId) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(routeId <= 0 || routeId >= static_cast<int>(routes_.size()))
+    {
+        return "unmatched";
+    }
+    return routes_[routeId].first + " " + routes_[routeId].second;
+}
+
+std::string MetricsRegistry::scrape() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string out;
+
+    // 按路由和阶段合并所有分片
+    size_t numRoutes = std::min<size_t>(routes_.size(), ThreadMetrics::kMaxRoutes);
+    std::vector<std::vector<HistogramSnapshot>> routeSnapshots(numRoutes, std::vector<HistogramSnapshot>(kNumPhases));
+    std::vector<bool> routeUsed(numRoutes, false);
+    std::vector<uint64_t> statusCounts(ThreadMetrics::kMaxStatus, 0);
+    std::vector<HistogramSnapshot> timerSnapshots(timers_.size());
+
+    for(const auto& shard: shards_)
+    {
+        for(size_t r = 0; r < numRoutes; ++r)
+        {
+            const ThreadMetrics::RouteMetrics* metrics = shard->routes_[r].load(std::memory_order_acquire);
+            if(metrics)
+            {
+                routeUsed[r] = true;
+                for(int p = 0; p < kNumPhases; ++p)
+                {
+                    routeSnapshots[r][p].merge(metrics->phases[p]);
+                }
+            }
+        }
+        for(int code = 0; code < ThreadMetrics::kMaxStatus; ++code)
+        {
+            statusCounts[code] += shard->statusCounts_[code].load(std::memory_order_relaxed);
+        }
+        for(size_t t = 0; t < timers_.size() && t < ThreadMetrics::kMaxTimers; ++t)
+        {
+            const Histogram* histogram = shard->timers_[t].load(std::memory_order_acquire);
+            if(histogram)
+            {
+                timerSnapshots[t].merge(*histogram);
+            }
+        }
+    }
+
+    out += "# HELP http_request_phase_seconds Request latency by route and phase\n";
+    out += "# TYPE http_request_phase_seconds histogram\n";
+    std::string quantiles;
+    for(size_t r = 0; r < numRoutes; ++r)
+    {
+        if(!routeUsed[r])
+        {
+            continue;
+        }
+        for(int p = 0; p < kNumPhases; ++p)
+        {
+            std::string labels = "method=\"" + escapeLabel(routes_[r].first) + "\",route=\"" + 
+                                 escapeLabel(routes_[r].second) + "\",phase=\"" + phaseName(p) + "\"";
+            appendHistogram(out, "http_request_phase_seconds", labels, routeSnapshots[r][p]);
+            appendQuantiles(quantiles, "http_request_phase_quantile_seconds", labels, routeSnapshots[r][p]);
+        }
+    }
+    out += "# HELP http_request_phase_quantile_seconds Request latency quantiles by route and phase\n";
+    out += "# TYPE http_request_phase_quantile_seconds gauge\n";
+    out += quantiles;
+
+    out += "# HELP http_responses_total Responses by status code\n";
+    out += "# TYPE http_responses_total counter\n";
+    for(int code = 0; code < ThreadMetrics::kMaxStatus; ++code)
+    {
+        if(statusCounts[code] > 0)
+        {
+            out += "http_responses_total{code=\"" + std::to_string(code) + "\"} " + std::to_string(statusCounts[code]) + "\n";
+        }
+    }
+
+    for(size_t t = 0; t < timerSnapshots.size(); ++t)
+    {
+        out += "# HELP " + timers_[t].first + " " + timers_[t].second + "\n";
+        out += "# TYPE " + timers_[t].first + " histogram\n";
+        appendHistogram(out, timers_[t].first, "", timerSnapshots[t]);
+    }
+    return out;
+}
+
+}
+
+}
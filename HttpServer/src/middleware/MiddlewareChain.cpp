@@ -12,6 +12,11 @@ void MiddlewareChain::addMiddleware(std::shared_ptr<Middleware> middleware)
     middlewares_.push_back(middleware);
 }
 
+void MiddlewareChain::addMiddlewareFront(std::shared_ptr<Middleware> middleware)
+{
+    middlewares_.insert(middlewares_.begin(), middleware);
+}
+
 void MiddlewareChain::processBefore(HttpRequest& request)
 {
     for(auto &middleware: middlewares_)
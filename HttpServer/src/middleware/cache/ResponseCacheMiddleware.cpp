@@ -0,0 +1,229 @@
+#include "../../../include/middleware/cache/ResponseCacheMiddleware.h"
+#include "mymuduo/Alogger.h"
+#include "mymuduo/TimeStamp.h"
+#include "../../../include/memory/MemoryAccounting.h"
+
+namespace http
+{
+
+namespace middleware
+{
+
+namespace
+{
+
+// 本线程最近使用的分片，通常只有一个缓存中间件，避免每次都加锁查表
+thread_local const void* t_shardOwner = nullptr;
+thread_local void* t_shard = nullptr;
+
+// before中未命中的请求，等after保存
+thread_local const void* t_pendingOwner = nullptr;
+thread_local const CacheRule* t_pendingRule = nullptr;
+thread_local std::string t_pendingKey;
+
+thread_local int t_revalidationDepth = 0;
+// 正在后台刷新的条目，由刷新请求经过before时记下，RevalidationScope析构时清除它的revalidating
+thread_local ResponseCacheMiddleware* t_revalidatingOwner = nullptr;
+thread_local std::string t_revalidatingKey;
+
+// 每个条目除键和响应之外的大致开销(链表节点、哈希表节点、状态信息)
+const size_t kEntryOverhead = 128;
+
+memory::MemoryAccount g_memoryAccount("response_cache_entry");
+
+int64_t nowMicros()
+{
+    return TimeStamp::now().microSecondsSinceEpoch();
+}
+
+}
+
+ResponseCacheMiddleware::RevalidationScope::RevalidationScope()
+{
+    ++t_revalidationDepth;
+    t_revalidatingOwner = nullptr;
+}
+
+ResponseCacheMiddleware::RevalidationScope::~RevalidationScope()
+{
+    --t_revalidationDepth;
+    // 处理器出错、响应不可缓存或者被其他中间件拦截时不会走到store()，否则条目再也不会被刷新
+    if(t_revalidatingOwner)
+    {
+        t_revalidatingOwner->endRevalidation(t_revalidatingKey);
+        t_revalidatingOwner = nullptr;
+    }
+}
+
+ResponseCacheMiddleware::ResponseCacheMiddleware(const CacheConfig& config):
+    config_(config)
+{
+    for(const CacheRule& rule: config_.rules)
+    {
+        rules_[rule.path] = rule;
+    }
+}
+
+void ResponseCacheMiddleware::before(HttpRequest& request)
+{
+    // 上一个请求可能在after之前就抛出了异常，残留的键作废
+    t_pendingOwner = nullptr;
+
+    if(request.method() != HttpRequest::kGet)
+    {
+        return;
+    }
+    auto ruleIt = rules_.find(request.path());
+    if(ruleIt == rules_.end())
+    {
+        return;
+    }
+
+    const CacheRule& rule = ruleIt->second;
+    std::string key = makeKey(request, rule);
+    if(t_revalidationDepth > 0)
+    {
+        t_revalidatingOwner = this;
+        t_revalidatingKey = key;
+    }
+    Shard* shard = localShard();
+    auto it = shard->index.find(key);
+    if(it != shard->index.end() && t_revalidationDepth == 0)
+    {
+        Entry& entry = *it->second;
+        int64_t now = nowMicros();
+        bool fresh = now < entry.expiresAt;
+        if(fresh || now < entry.staleUntil)
+        {
+            if(!fresh && !entry.revalidating && revalidator_)
+            {
+                // 先返回旧响应，后台只刷新一次
+                entry.revalidating = true;
+                revalidator_(request);
+            }
+            shard->lru.splice(shard->lru.begin(), shard->lru, it->second);
+
+            HttpResponse hit(false);  // 连接是否保持仍由请求决定
+            hit.setStatusLine(request.getVersion(), entry.statusCode, entry.statusMessage);
+            hit.setSerializedTail(entry.tail);
+            throw hit;
+        }
+    }
+
+    t_pendingOwner = this;
+    t_pendingRule = &rule;
+    t_pendingKey = std::move(key);
+}
+
+void ResponseCacheMiddleware::after(HttpResponse& response)
+{
+    if(t_pendingOwner != this)
+    {
+        return;
+    }
+    t_pendingOwner = nullptr;
+
+    // 带Set-Cookie的响应属于某个用户，不能给其他人
+    if(response.getStatusCode() != HttpResponse::k200Ok || response.hasHeader("Set-Cookie"))
+    {
+        return;
+    }
+    store(localShard(), std::move(t_pendingKey), *t_pendingRule, response);
+}
+
+ResponseCacheMiddleware::Shard* ResponseCacheMiddleware::localShard()
+{
+    if(t_shardOwner == this)
+    {
+        return static_cast<Shard*>(t_shard);
+    }
+
+    std::lock_guard<std::mutex> lock(shardsMutex_);
+    std::unique_ptr<Shard>& shard = shards_[std::this_thread::get_id()];
+    if(!shard)
+    {
+        shard = std::make_unique<Shard>();
+    }
+    t_shardOwner = this;
+    t_shard = shard.get();
+    return shard.get();
+}
+
+std::string ResponseCacheMiddleware::makeKey(const HttpRequest& request, const CacheRule& rule) const
+{
+    std::string key = request.path();
+    key += '?';
+    key += request.query();
+    for(const std::string& header: rule.varyHeaders)
+    {
+        key += '\n';
+        key += header;
+        key += ':';
+        key += request.getHeader(header);
+    }
+    return key;
+}
+
+ResponseCacheMiddleware::Shard::~Shard()
+{
+    g_memoryAccount.add(-static_cast<int64_t>(lru.size()), -static_cast<int64_t>(bytes));
+}
+
+void ResponseCacheMiddleware::store(Shard* shard, std::string key, const CacheRule& rule, const HttpResponse& response)
+{
+    auto tail = std::make_shared<const std::string>(response.serializeTail());
+    size_t bytes = key.size() + tail->size() + kEntryOverhead;
+    if(bytes > config_.maxBytesPerThread / 4)
+    {
+        return;  // 太大的响应不缓存，避免一条就挤掉整个分片
+    }
+
+    auto old = shard->index.find(key);
+    if(old != shard->index.end())
+    {
+        evict(shard, old->second);
+    }
+
+    int64_t now = nowMicros();
+    Entry entry;
+    entry.key = std::move(key);
+    entry.statusCode = response.getStatusCode();
+    entry.statusMessage = response.getStatusMessage();
+    entry.tail = std::move(tail);
+    entry.expiresAt = now + static_cast<int64_t>(rule.ttlMs) * 1000;
+    entry.staleUntil = entry.expiresAt + static_cast<int64_t>(rule.staleMs) * 1000;
+    entry.revalidating = false;
+    entry.bytes = bytes;
+
+    shard->lru.push_front(std::move(entry));
+    shard->index[shard->lru.front().key] = shard->lru.begin();
+    shard->bytes += bytes;
+    g_memoryAccount.add(1, static_cast<int64_t>(bytes));
+
+    while(shard->bytes > config_.maxBytesPerThread && !shard->lru.empty())
+    {
+        evict(shard, std::prev(shard->lru.end()));
+    }
+}
+
+void ResponseCacheMiddleware::endRevalidation(const std::string& key)
+{
+    Shard* shard = localShard();
+    auto it = shard->index.find(key);
+    if(it != shard->index.end())
+    {
+        it->second->revalidating = false;
+    }
+}
+
+void ResponseCacheMiddleware::evict(Shard* shard, std::list<Entry>::iterator it)
+{
+    shard->bytes -= it->bytes;
+    g_memoryAccount.add(-1, -static_cast<int64_t>(it->bytes));
+    shard->index.erase(it->key);
+    shard->lru.erase(it);
+}
+
+}
+
+}
@@ -95,7 +95,7 @@ bool CorsMiddleware::isOriginAllowed(const std::string& origin) const
 
 void CorsMiddleware::handlePreflightRequest(const HttpRequest& request, HttpResponse& response)
 {
-    const std::string &origin = request.getHeader("Origin");
+    const std::string origin(request.getHeader("Origin"));  // 只有预检请求走到这里，拷贝一份
 
     if(!isOriginAllowed(origin))  // 检查是否是允许的来源
     {
@@ -0,0 +1,215 @@
+#include "../../../include/middleware/ratelimit/RateLimitMiddleware.h"
+#include "mymuduo/Alogger.h"
+#include "mymuduo/TimeStamp.h"
+#include "../../../include/memory/MemoryAccounting.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace http
+{
+
+namespace middleware
+{
+
+namespace
+{
+
+// 本线程最近使用的分片
+thread_local const void* t_shardOwner = nullptr;
+thread_local void* t_shard = nullptr;
+
+memory::MemoryAccount g_memoryAccount("rate_limit_bucket");
+
+// 一次请求匹配到的规则和桶的键，先全部检查再统一扣除；每个线程复用，键保留已分配的容量
+struct Pending
+{
+    const RateLimitRule* rule = nullptr;
+    std::string key;
+};
+thread_local std::vector<Pending> t_pending;
+
+// 从Cookie中取出sessionId的值
+std::string sessionIdFromCookie(std::string_view cookie)
+{
+    size_t pos = cookie.find("sessionId=");
+    if(pos == std::string_view::npos)
+    {
+        return std::string();
+    }
+    pos += 10;
+    size_t end = cookie.find(';', pos);
+    return std::string(cookie.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos));
+}
+
+}
+
+RateLimitMiddleware::RateLimitMiddleware(const RateLimitConfig& config):
+    config_(config),
+    rejected_(0)
+{
+    const char body[] = "Too Many Requests";
+    HttpResponse response;
+    response.setContentType("text/plain");
+    response.setContentLength(sizeof(body) - 1);
+    response.addHeader("Retry-After", std::to_string(config_.retryAfterSeconds));
+    response.setBody(body);
+    rejectTail_ = std::make_shared<const std::string>(response.serializeTail());
+}
+
+void RateLimitMiddleware::before(HttpRequest& request)
+{
+    Shard* shard = nullptr;
+    int64_t now = 0;
+    std::vector<Pending>& pending = t_pending;
+    size_t count = 0;
+    for(size_t i = 0; i < config_.rules.size(); ++i)
+    {
+        const RateLimitRule& rule = config_.rules[i];
+        if(!rule.path.empty() && rule.path != request.path())
+        {
+            continue;
+        }
+
+        // 桶的键：规则编号 + 区分对象，不同规则互不影响
+        std::string sessionId;
+        if(rule.key == RateLimitKey::kSession)
+        {
+            // 只有服务端确认过的会话才单独计数，伪造的sessionId按IP
+            sessionId = sessionIdFromCookie(request.getHeader("Cookie"));
+            if(!sessionId.empty() && !(sessionValidator_ && sessionValidator_(sessionId)))
+            {
+                sessionId.clear();
+            }
+        }
+        if(rule.key != RateLimitKey::kRoute && sessionId.empty() && request.clientIp().empty())
+        {
+            // 反向代理没有转发客户端地址，所有客户端共用一个键会互相限流
+            continue;
+        }
+        if(!shard)
+        {
+            shard = localShard();
+            now = TimeStamp::now().microSecondsSinceEpoch();
+        }
+        if(count == pending.size())
+        {
+            pending.emplace_back();
+        }
+        Pending& item = pending[count++];
+        item.rule = &rule;
+        item.key = std::to_string(i);
+        item.key += ':';
+        if(rule.key == RateLimitKey::kRoute)
+        {
+            item.key += request.path();
+        }
+        else
+        {
+            item.key.append(sessionId.empty() ? std::string_view(request.clientIp()) : std::string_view(sessionId));
+        }
+
+        if(!hasToken(shard, item.key, rule, now))
+        {
+            // 还没有扣除任何令牌，被拒绝的请求不消耗其他规则的配额，也不新建桶
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            logger_->DEBUG("Rate limited: " + item.key);
+            HttpResponse response(false);
+            response.setStatusLine(request.getVersion(), HttpResponse::k429TooManyRequests, "Too Many Requests");
+            response.setSerializedTail(rejectTail_);
+            throw response;
+        }
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        take(shard, pending[i].key, *pending[i].rule, now);
+    }
+
+    if(shard && now - shard->lastSweep > static_cast<int64_t>(config_.idleSeconds) * 1000000)
+    {
+        sweep(shard, now);
+    }
+}
+
+RateLimitMiddleware::Shard* RateLimitMiddleware::localShard()
+{
+    if(t_shardOwner == this)
+    {
+        return static_cast<Shard*>(t_shard);
+    }
+
+    std::lock_guard<std::mutex> lock(shardsMutex_);
+    std::unique_ptr<Shard>& shard = shards_[std::this_thread::get_id()];
+    if(!shard)
+    {
+        shard = std::make_unique<Shard>();
+        shard->lastSweep = TimeStamp::now().microSecondsSinceEpoch();
+    }
+    t_shardOwner = this;
+    t_shard = shard.get();
+    return shard.get();
+}
+
+bool RateLimitMiddleware::hasToken(Shard* shard, const std::string& key, const RateLimitRule& rule, int64_t now)
+{
+    auto it = shard->buckets.find(key);
+    if(it == shard->buckets.end())
+    {
+        return rule.burst >= 1.0;
+    }
+    const Bucket& bucket = it->second;
+    double elapsed = (now - bucket.lastRefill) / 1e6;
+    return std::min(rule.burst, bucket.tokens + elapsed * rule.ratePerSecond) >= 1.0;
+}
+
+void RateLimitMiddleware::take(Shard* shard, const std::string& key, const RateLimitRule& rule, int64_t now)
+{
+    auto it = shard->buckets.find(key);
+    if(it == shard->buckets.end())
+    {
+        it = shard->buckets.emplace(key, Bucket{rule.burst, now}).first;
+        g_memoryAccount.add(1, static_cast<int64_t>(bucketBytes(key)));
+    }
+
+    Bucket& bucket = it->second;
+    double elapsed = (now - bucket.lastRefill) / 1e6;
+    bucket.tokens = std::min(rule.burst, bucket.tokens + elapsed * rule.ratePerSecond) - 1.0;
+    bucket.lastRefill = now;
+}
+
+void RateLimitMiddleware::sweep(Shard* shard, int64_t now)
+{
+    int64_t idle = static_cast<int64_t>(config_.idleSeconds) * 1000000;
+    for(auto it = shard->buckets.begin(); it != shard->buckets.end(); )
+    {
+        if(now - it->second.lastRefill > idle)
+        {
+            g_memoryAccount.add(-1, -static_cast<int64_t>(bucketBytes(it->first)));
+            it = shard->buckets.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    shard->lastSweep = now;
+}
+
+size_t RateLimitMiddleware::bucketBytes(const std::string& key)
+{
+    // 哈希表节点：键值对加上next指针和缓存的哈希值
+    return sizeof(std::pair<const std::string, Bucket>) + 2 * sizeof(void*) + memory::heapBytes(key);
+}
+
+RateLimitMiddleware::Shard::~Shard()
+{
+    for(const auto& item: buckets)
+    {
+        g_memoryAccount.add(-1, -static_cast<int64_t>(bucketBytes(item.first)));
+    }
+}
+
+}
+
+}
@@ -0,0 +1,228 @@
+#include "../../include/net/ListenerHandoff.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "mymuduo/Alogger.h"
+
+namespace http
+{
+
+namespace net
+{
+
+namespace
+{
+
+const int kMaxFds = 64;               // 一次最多交接的fd数量
+const int kConfirmTimeoutSeconds = 30;  // 等待新进程确认的时间
+
+bool fillAddress(const std::string& path, struct sockaddr_un* addr)
+{
+    if(path.size() >= sizeof(addr->sun_path))
+    {
+        logger_->ERROR("Control socket path too long: " + path);
+        return false;
+    }
+    ::memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    ::strncpy(addr->sun_path, path.c_str(), sizeof(addr->sun_path) - 1);
+    return true;
+}
+
+}
+
+ListenerHandoff::ListenerHandoff(const std::string& controlPath):
+    controlPath_(controlPath),
+    listenFd_(-1),
+    running_(false)
+{
+
+}
+
+ListenerHandoff::~ListenerHandoff()
+{
+    stop();
+}
+
+bool ListenerHandoff::serve(const FdsProvider& fdsProvider, const HandedOffCallback& cb)
+{
+    struct sockaddr_un addr;
+    if(!fillAddress(controlPath_, &addr))
+    {
+        return false;
+    }
+
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listenFd_ < 0)
+    {
+        logger_->ERROR("Failed to create control socket");
+        return false;
+    }
+    ::unlink(controlPath_.c_str());  // 旧进程已经把连接交给我们了，它的路径可以直接替换
+    if(::bind(listenFd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0 || ::listen(listenFd_, 1) < 0)
+    {
+        logger_->ERROR("Failed to listen on control socket " + controlPath_);
+        ::close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+
+    fdsProvider_ = fdsProvider;
+    handedOffCallback_ = cb;
+    running_ = true;
+    thread_ = std::thread(&ListenerHandoff::serveLoop, this);
+    return true;
+}
+
+void ListenerHandoff::stop()
+{
+    running_ = false;
+    if(listenFd_ >= 0)
+    {
+        ::shutdown(listenFd_, SHUT_RDWR);  // 唤醒阻塞在accept上的线程
+    }
+    if(thread_.joinable())
+    {
+        thread_.join();
+    }
+    if(listenFd_ >= 0)
+    {
+        ::close(listenFd_);
+        listenFd_ = -1;
+    }
+}
+
+void ListenerHandoff::serveLoop()
+{
+    while(running_)
+    {
+        int sock = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if(sock < 0)
+        {
+            if(running_)
+            {
+                logger_->ERROR("Control socket accept failed");
+            }
+            return;
+        }
+
+        // 新进程可能在初始化过程中崩溃，确认要有超时
+        struct timeval tv{kConfirmTimeoutSeconds, 0};
+        ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+
+        char ack = 0;
+        bool handedOff = sendFds(sock, fdsProvider_()) && ::read(sock, &ack, 1) == 1;
+        ::close(sock);
+        if(handedOff)
+        {
+            logger_->WARN("Listen sockets handed off to new process, start draining");
+            running_ = false;
+            handedOffCallback_();
+            return;
+        }
+        logger_->ERROR("Listener handoff aborted, keep serving");
+    }
+}
+
+int ListenerHandoff::requestListenFds(const std::string& controlPath, std::vector<int>* fds)
+{
+    struct sockaddr_un addr;
+    if(!fillAddress(controlPath, &addr))
+    {
+        return -1;
+    }
+
+    int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(sock < 0)
+    {
+        return -1;
+    }
+    if(::connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        ::close(sock);  // 没有正在运行的旧进程
+        return -1;
+    }
+    if(!recvFds(sock, fds))
+    {
+        ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+void ListenerHandoff::confirmTakeover(int controlFd)
+{
+    char ack = 1;
+    if(::write(controlFd, &ack, 1) != 1)
+    {
+        logger_->ERROR("Failed to confirm listener takeover");
+    }
+    ::close(controlFd);
+}
+
+bool ListenerHandoff::sendFds(int sock, const std::vector<int>& fds)
+{
+    if(fds.empty() || fds.size() > kMaxFds)
+    {
+        logger_->ERROR("No listen socket to hand off");
+        return false;
+    }
+
+    uint32_t count = static_cast<uint32_t>(fds.size());
+    struct iovec iov{&count, sizeof count};
+
+    char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+    ::memset(control, 0, sizeof control);
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    ::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    return ::sendmsg(sock, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof count);
+}
+
+bool ListenerHandoff::recvFds(int sock, std::vector<int>* fds)
+{
+    uint32_t count = 0;
+    struct iovec iov{&count, sizeof count};
+
+    char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    if(::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof count))
+    {
+        return false;
+    }
+    for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            fds->assign(data, data + n);
+        }
+    }
+    return !fds->empty() && fds->size() == count;
+}
+
+}
+
+}
@@ -0,0 +1,142 @@
+#include "../../include/net/ReusePortServer.h"
+#include "../../include/net/SocketUtil.h"
+
+#include <algorithm>
+
+#include "mymuduo/Alogger.h"
+
+namespace http
+{
+
+namespace net
+{
+
+ReusePortServer::ReusePortServer(const InetAddress& listenAddr, const std::string& name, const ReusePortConfig& config):
+    listenAddr_(listenAddr),
+    port_(listenAddr.toPort()),
+    name_(name),
+    config_(config),
+    acceptors_(std::max(config.numAcceptors, 1)),
+    listening_(0),
+    started_(false)
+{
+    config_.numAcceptors = static_cast<int>(acceptors_.size());
+}
+
+ReusePortServer::~ReusePortServer()
+{
+    stop();
+}
+
+void ReusePortServer::start()
+{
+    if(started_)
+    {
+        return;
+    }
+    started_ = true;
+
+    /*
+        SO_REUSEPORT组内socket的下标由listen的先后顺序决定，
+        cBPF程序返回的就是这个下标，所以必须一个一个地启动，
+        等上一个acceptor开始监听后再启动下一个
+    */
+    for(int i = 0; i < config_.numAcceptors; ++i)
+    {
+        acceptors_[i].thread = std::thread(&ReusePortServer::runAcceptor, this, i);
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this, i]{ return listening_ > i; });
+    }
+
+    if(config_.cpuSteering)
+    {
+        int firstFd = acceptors_[0].listenFd;
+        if(firstFd < 0 || !SocketUtil::attachReusePortCpuSteering(firstFd, config_.cpus, config_.numAcceptors))
+        {
+            logger_->WARN("ReusePortServer[" + name_ + "] cpu steering disabled, fall back to kernel hash");
+        }
+    }
+    logger_->WARN("ReusePortServer[" + name_ + "] " + std::to_string(config_.numAcceptors) + " acceptors listening on " + listenAddr_.toIpPort());
+}
+
+void ReusePortServer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(auto& acceptor: acceptors_)
+        {
+            if(acceptor.loop)
+            {
+                acceptor.loop->quit();
+            }
+        }
+    }
+    for(auto& acceptor: acceptors_)
+    {
+        if(acceptor.thread.joinable())
+        {
+            acceptor.thread.join();
+        }
+    }
+}
+
+std::vector<int> ReusePortServer::listenFds() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<int> fds;
+    for(const auto& acceptor: acceptors_)
+    {
+        fds.push_back(acceptor.listenFd);
+    }
+    return fds;
+}
+
+void ReusePortServer::runAcceptor(int index)
+{
+    if(!config_.cpus.empty())
+    {
+        SocketUtil::pinCurrentThread(config_.cpus[index % config_.cpus.size()]);
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, listenAddr_, name_ + "-acceptor" + std::to_string(index), TcpServer::kReusePort);
+    server.setConnectionCallback(connectionCallback_);
+    server.setMessageCallback(messageCallback_);
+    if(threadInitCallback_)
+    {
+        threadInitCallback_(&loop);
+    }
+    server.start();  // 在loop所在线程调用，listen会立即完成
+
+    {
+        // 新出现的那个监听socket就是本acceptor的
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(int fd: SocketUtil::findSockets(port_, true))
+        {
+            bool known = std::any_of(acceptors_.begin(), acceptors_.end(),
+                                    [fd](const Acceptor& a){ return a.listenFd == fd; });
+            if(!known)
+            {
+                acceptors_[index].listenFd = fd;
+                break;
+            }
+        }
+        if(acceptors_[index].listenFd >= 0)
+        {
+            // loop还没有运行，还没有accept任何连接
+            tuning_.applyToListener(acceptors_[index].listenFd);
+        }
+        acceptors_[index].loop = &loop;
+        ++listening_;
+    }
+    cond_.notify_all();
+
+    loop.loop();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    acceptors_[index].loop = nullptr;
+}
+
+}
+
+}
@@ -0,0 +1,85 @@
+#include "../../include/net/SocketTuning.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <string>
+
+#include "mymuduo/Alogger.h"
+
+namespace http
+{
+
+namespace net
+{
+
+namespace
+{
+
+bool setIntOption(int fd, int level, int name, int value, const char* optionName)
+{
+    if(::setsockopt(fd, level, name, &value, sizeof value) < 0)
+    {
+        logger_->WARN(std::string("SocketTuning - failed to set ") + optionName + " on fd " + std::to_string(fd));
+        return false;
+    }
+    return true;
+}
+
+}
+
+SocketTuning SocketTuning::lowLatency()
+{
+    SocketTuning tuning;
+    tuning.noDelay = true;
+    tuning.deferAcceptSeconds = 1;
+    tuning.fastOpenQueue = 256;
+    tuning.busyPollMicros = 50;
+    return tuning;
+}
+
+SocketTuning SocketTuning::highThroughput()
+{
+    SocketTuning tuning;
+    tuning.noDelay = true;
+    tuning.deferAcceptSeconds = 1;
+    tuning.fastOpenQueue = 256;
+    tuning.sendBufferBytes = 1024 * 1024;
+    return tuning;
+}
+
+bool SocketTuning::applyToListener(int fd) const
+{
+    bool ok = true;
+    if(noDelay)
+    {
+        ok &= setIntOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+    if(deferAcceptSeconds > 0)
+    {
+        ok &= setIntOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, deferAcceptSeconds, "TCP_DEFER_ACCEPT");
+    }
+    if(fastOpenQueue > 0)
+    {
+        // 还需要net.ipv4.tcp_fastopen的第2位(服务端)打开才会生效
+        ok &= setIntOption(fd, IPPROTO_TCP, TCP_FASTOPEN, fastOpenQueue, "TCP_FASTOPEN");
+    }
+    if(recvBufferBytes > 0)
+    {
+        ok &= setIntOption(fd, SOL_SOCKET, SO_RCVBUF, recvBufferBytes, "SO_RCVBUF");
+    }
+    if(sendBufferBytes > 0)
+    {
+        ok &= setIntOption(fd, SOL_SOCKET, SO_SNDBUF, sendBufferBytes, "SO_SNDBUF");
+    }
+    if(busyPollMicros > 0)
+    {
+        ok &= setIntOption(fd, SOL_SOCKET, SO_BUSY_POLL, busyPollMicros, "SO_BUSY_POLL");
+    }
+    return ok;
+}
+
+}
+
+}
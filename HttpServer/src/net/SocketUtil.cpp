@@ -0,0 +1,237 @@
+#include "../../include/net/SocketUtil.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <linux/filter.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "mymuduo/Alogger.h"
+
+namespace http
+{
+
+namespace net
+{
+
+std::vector<int> SocketUtil::findSockets(uint16_t port, bool listening)
+{
+    std::vector<int> fds;
+    for(int fd: allSockets(listening))
+    {
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof addr;
+        if(::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len) < 0)
+        {
+            continue;
+        }
+
+        uint16_t boundPort = 0;
+        if(addr.ss_family == AF_INET)
+        {
+            boundPort = ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port);
+        }
+        else if(addr.ss_family == AF_INET6)
+        {
+            boundPort = ntohs(reinterpret_cast<struct sockaddr_in6*>(&addr)->sin6_port);
+        }
+        else
+        {
+            continue;  // Unix域socket没有端口
+        }
+
+        if(boundPort == port)
+        {
+            fds.push_back(fd);
+        }
+    }
+    return fds;
+}
+
+std::vector<int> SocketUtil::allSockets(bool listening)
+{
+    std::vector<int> fds;
+    DIR* dir = ::opendir("/proc/self/fd");
+    if(!dir)
+    {
+        logger_->ERROR("SocketUtil::allSockets - cannot open /proc/self/fd");
+        return fds;
+    }
+
+    int dirFd = ::dirfd(dir);
+    struct dirent* entry;
+    while((entry = ::readdir(dir)) != nullptr)
+    {
+        if(entry->d_name[0] == '.') { continue; }
+        int fd = ::atoi(entry->d_name);
+        if(fd == dirFd) { continue; }
+
+        int type = 0;
+        socklen_t len = sizeof type;
+        if(::getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0 || type != SOCK_STREAM)
+        {
+            continue;  // 不是socket或者不是TCP
+        }
+
+        int acceptConn = 0;
+        len = sizeof acceptConn;
+        if(::getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &acceptConn, &len) < 0 || 
+            (acceptConn != 0) != listening)
+        {
+            continue;
+        }
+
+        fds.push_back(fd);
+    }
+    ::closedir(dir);
+
+    std::sort(fds.begin(), fds.end());
+    return fds;
+}
+
+bool SocketUtil::retireListener(int fd)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof addr;
+    if(::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len) < 0)
+    {
+        logger_->ERROR("SocketUtil::retireListener - not a socket: " + std::to_string(fd));
+        return false;
+    }
+
+    DIR* dir = ::opendir("/proc/self/fd");
+    if(!dir)
+    {
+        logger_->ERROR("SocketUtil::retireListener - cannot open /proc/self/fd");
+        return false;
+    }
+    struct dirent* entry;
+    while((entry = ::readdir(dir)) != nullptr)
+    {
+        if(entry->d_name[0] == '.') { continue; }
+        char link[64];
+        std::string path = std::string("/proc/self/fd/") + entry->d_name;
+        ssize_t n = ::readlink(path.c_str(), link, sizeof link - 1);
+        if(n <= 0) { continue; }
+        link[n] = '\0';
+        if(std::strcmp(link, "anon_inode:[eventpoll]") == 0)
+        {
+            ::epoll_ctl(::atoi(entry->d_name), EPOLL_CTL_DEL, fd, nullptr);  // 没有注册在这个实例中时返回ENOENT
+        }
+    }
+    ::closedir(dir);
+
+    int dummy = ::socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(dummy < 0 || ::dup2(dummy, fd) < 0)
+    {
+        logger_->ERROR("SocketUtil::retireListener - cannot replace fd " + std::to_string(fd));
+        if(dummy >= 0)
+        {
+            ::close(dummy);
+        }
+        return false;
+    }
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);  // dup2不保留close-on-exec
+    ::close(dummy);
+    return true;
+}
+
+int SocketUtil::createUnixSocket(const std::string& path)
+{
+    struct sockaddr_un addr;
+    if(path.empty() || path.size() >= sizeof addr.sun_path)
+    {
+        logger_->ERROR("SocketUtil::createUnixSocket - invalid path " + path);
+        return -1;
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        logger_->ERROR("SocketUtil::createUnixSocket - socket error");
+        return -1;
+    }
+
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    ::unlink(path.c_str());  // 上次运行留下的socket文件
+    if(::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        logger_->ERROR("SocketUtil::createUnixSocket - cannot bind " + path);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool SocketUtil::pinCurrentThread(int cpu)
+{
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int ret = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpuset), &cpuset);
+    if(ret != 0)
+    {
+        logger_->ERROR("Failed to pin thread to cpu " + std::to_string(cpu));
+        return false;
+    }
+    return true;
+}
+
+bool SocketUtil::attachReusePortCpuSteering(int listenFd, const std::vector<int>& cpus, int groupSize)
+{
+    if(groupSize <= 0)
+    {
+        return false;
+    }
+
+    /*
+        程序结构(A为累加器):
+            ld   A = 当前CPU
+            jeq  A == cpus[0] ? 跳到 ret 0
+            ...
+            jeq  A == cpus[m-1] ? 跳到 ret m-1
+            mod  A = A % groupSize
+            ret  A
+            ret  0 ... ret m-1
+        每条jeq到它对应的ret的偏移都是 m + 1, 所以m不能超过254
+    */
+    size_t mapped = std::min<size_t>({cpus.size(), static_cast<size_t>(groupSize), 254});
+    std::vector<struct sock_filter> code;
+    code.push_back({BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)});
+    for(size_t i = 0; i < mapped; ++i)
+    {
+        code.push_back({BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint8_t>(mapped + 1), 0, static_cast<uint32_t>(cpus[i])});
+    }
+    code.push_back({BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(groupSize)});
+    code.push_back({BPF_RET | BPF_A, 0, 0, 0});
+    for(size_t i = 0; i < mapped; ++i)
+    {
+        code.push_back({BPF_RET | BPF_K, 0, 0, static_cast<uint32_t>(i)});
+    }
+
+    struct sock_fprog prog;
+    prog.len = static_cast<unsigned short>(code.size());
+    prog.filter = code.data();
+    if(::setsockopt(listenFd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof prog) < 0)
+    {
+        logger_->ERROR("Failed to attach SO_REUSEPORT cBPF program");
+        return false;
+    }
+    return true;
+}
+
+}
+
+}
@@ -0,0 +1,609 @@
+#include "../../include/net/UringServer.h"
+
+#include <stdlib.h>
+
+#include <string>
+
+#include "mymuduo/Alogger.h"
+
+#ifdef HTTP_ENABLE_IO_URING
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <liburing.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <thread>
+#include <unordered_set>
+
+namespace http
+{
+
+namespace net
+{
+
+namespace
+{
+
+// user_data的低3位是操作类型，其余是连接指针(连接按8字节对齐)
+enum OpType
+{
+    kAccept = 0,
+    kRecv,
+    kSend,
+    kShutdown,
+    kClose,
+    kWake,
+    kTick,
+};
+
+const uint64_t kOpMask = 7;
+const int kBufferGroup = 0;  // buffer group只在一个ring内有效，每个ring都用0
+const unsigned kCqeBatch = 256;
+const size_t kWheelSize = 64;  // 超时超过一圈的连接留在桶里，转到deadline_时才到期
+const int kCloseGrace = 1;     // 超时关闭时最后的响应在这么多秒内发不出去就直接断开
+
+inline uint64_t makeTag(UringConnection* conn, OpType op)
+{
+    return reinterpret_cast<uint64_t>(conn) | op;
+}
+
+std::string peerIpOf(int fd)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof addr;
+    char ip[INET6_ADDRSTRLEN] = "";
+    if(::getpeername(fd, reinterpret_cast<struct sockaddr*>(&addr), &len) == 0)
+    {
+        if(addr.ss_family == AF_INET)
+        {
+            ::inet_ntop(AF_INET, &reinterpret_cast<struct sockaddr_in*>(&addr)->sin_addr, ip, sizeof ip);
+        }
+        else if(addr.ss_family == AF_INET6)
+        {
+            ::inet_ntop(AF_INET6, &reinterpret_cast<struct sockaddr_in6*>(&addr)->sin6_addr, ip, sizeof ip);
+        }
+    }
+    return ip;
+}
+
+}
+
+struct UringServer::Worker
+{
+    int index = 0;
+    std::thread thread;
+    struct io_uring ring;
+    struct io_uring_buf_ring* bufRing = nullptr;
+    std::vector<char> buffers;  // bufferCount个bufferSize大小的接收缓冲区
+    int wakeFd = -1;            // stop()通过它唤醒阻塞在submit_and_wait上的线程
+    uint64_t wakeValue = 0;
+    std::unordered_set<UringConnection*> conns;
+    std::array<std::list<UringConnection*>, kWheelSize> wheel;
+    uint64_t tick = 0;
+    struct __kernel_timespec tickInterval{1, 0};  // 提交后到内核处理前都要有效
+
+    // 提交队列满时先提交已有的请求再取
+    struct io_uring_sqe* getSqe()
+    {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        while(!sqe)
+        {
+            io_uring_submit(&ring);
+            sqe = io_uring_get_sqe(&ring);
+        }
+        return sqe;
+    }
+};
+
+UringServer::UringServer(int listenFd, int numThreads, const UringConfig& config):
+    listenFd_(listenFd),
+    config_(config),
+    running_(false)
+{
+    for(int i = 0; i < std::max(numThreads, 1); ++i)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+        workers_.back()->index = i;
+    }
+}
+
+UringServer::~UringServer()
+{
+    stop();
+}
+
+bool UringServer::supported()
+{
+    struct io_uring ring;
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof params);
+    if(io_uring_queue_init_params(8, &ring, &params) < 0)
+    {
+        return false;  // 内核不支持或者被seccomp/sysctl禁用
+    }
+    io_uring_queue_exit(&ring);
+    return true;
+}
+
+void UringServer::start()
+{
+    running_ = true;
+    for(size_t i = 1; i < workers_.size(); ++i)
+    {
+        Worker* worker = workers_[i].get();
+        worker->thread = std::thread(&UringServer::runWorker, this, worker);
+    }
+    runWorker(workers_[0].get());
+    for(size_t i = 1; i < workers_.size(); ++i)
+    {
+        if(workers_[i]->thread.joinable())
+        {
+            workers_[i]->thread.join();
+        }
+    }
+}
+
+void UringServer::stop()
+{
+    running_ = false;
+    for(auto& worker: workers_)
+    {
+        if(worker->wakeFd >= 0)
+        {
+            uint64_t one = 1;
+            ssize_t n = ::write(worker->wakeFd, &one, sizeof one);
+            (void)n;
+        }
+    }
+}
+
+void UringServer::runWorker(Worker* worker)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof params);
+    if(config_.sqPoll)
+    {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = config_.sqPollIdleMs;
+    }
+    int ret = io_uring_queue_init_params(config_.entries, &worker->ring, &params);
+    if(ret < 0)
+    {
+        logger_->ERROR("UringServer - io_uring_queue_init failed: " + std::string(std::strerror(-ret)));
+        abort();
+    }
+
+    // 注册provided buffer ring，multishot recv由内核从中挑选缓冲区
+    worker->buffers.resize(static_cast<size_t>(config_.bufferCount) * config_.bufferSize);
+    worker->bufRing = io_uring_setup_buf_ring(&worker->ring, config_.bufferCount, kBufferGroup, 0, &ret);
+    if(!worker->bufRing)
+    {
+        logger_->ERROR("UringServer - io_uring_setup_buf_ring failed: " + std::string(std::strerror(-ret)));
+        abort();
+    }
+    int mask = io_uring_buf_ring_mask(config_.bufferCount);
+    for(unsigned i = 0; i < config_.bufferCount; ++i)
+    {
+        io_uring_buf_ring_add(worker->bufRing, &worker->buffers[static_cast<size_t>(i) * config_.bufferSize],
+                              config_.bufferSize, static_cast<unsigned short>(i), mask, static_cast<int>(i));
+    }
+    io_uring_buf_ring_advance(worker->bufRing, static_cast<int>(config_.bufferCount));
+
+    worker->wakeFd = ::eventfd(0, EFD_CLOEXEC);
+    struct io_uring_sqe* sqe = worker->getSqe();
+    io_uring_prep_read(sqe, worker->wakeFd, &worker->wakeValue, sizeof worker->wakeValue, 0);
+    io_uring_sqe_set_data64(sqe, makeTag(nullptr, kWake));
+    sqe = worker->getSqe();
+    io_uring_prep_multishot_accept(sqe, listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, makeTag(nullptr, kAccept));
+    armTick(worker);
+
+    logger_->WARN("UringServer worker " + std::to_string(worker->index) + " started" + (config_.sqPoll ? " with SQPOLL" : ""));
+    while(running_)
+    {
+        ret = io_uring_submit_and_wait(&worker->ring, 1);
+        if(ret < 0 && ret != -EINTR)
+        {
+            logger_->ERROR("UringServer - io_uring_submit_and_wait failed: " + std::string(std::strerror(-ret)));
+            break;
+        }
+
+        struct io_uring_cqe* cqes[kCqeBatch];
+        unsigned count = io_uring_peek_batch_cqe(&worker->ring, cqes, kCqeBatch);
+        for(unsigned i = 0; i < count; ++i)
+        {
+            struct io_uring_cqe* cqe = cqes[i];
+            UringConnection* conn = reinterpret_cast<UringConnection*>(cqe->user_data & ~kOpMask);
+            switch(static_cast<OpType>(cqe->user_data & kOpMask))
+            {
+            case kAccept:
+                handleAccept(worker, cqe->res, cqe->flags & IORING_CQE_F_MORE);
+                break;
+            case kRecv:
+                handleRecv(worker, conn, cqe->res, cqe->flags);
+                break;
+            case kSend:
+                handleSend(worker, conn, cqe->res);
+                break;
+            case kShutdown:
+                --conn->refs_;
+                release(worker, conn);
+                break;
+            case kClose:
+                handleClose(worker, conn, cqe->res);
+                break;
+            case kWake:
+                break;  // running_已经为false
+            case kTick:
+                handleTick(worker);
+                break;
+            }
+        }
+        io_uring_cq_advance(&worker->ring, count);
+    }
+
+    // 退出时直接关闭剩余的连接，不再等待未完成的操作
+    for(UringConnection* conn: worker->conns)
+    {
+        if(!conn->fdClosed_)
+        {
+            ::close(conn->fd_);
+        }
+        if(connectionCallback_)
+        {
+            connectionCallback_(conn, false);
+        }
+        delete conn;
+    }
+    worker->conns.clear();
+    for(auto& bucket: worker->wheel)
+    {
+        bucket.clear();
+    }
+    io_uring_free_buf_ring(&worker->ring, worker->bufRing, config_.bufferCount, kBufferGroup);
+    io_uring_queue_exit(&worker->ring);
+    ::close(worker->wakeFd);
+    worker->wakeFd = -1;
+}
+
+void UringServer::handleAccept(Worker* worker, int res, bool more)
+{
+    if(res >= 0)
+    {
+        UringConnection* conn = new UringConnection(res, peerIpOf(res), worker->index);
+        worker->conns.insert(conn);
+        if(connectionCallback_)
+        {
+            connectionCallback_(conn, true);
+        }
+        armRecv(worker, conn);
+    }
+    else
+    {
+        logger_->WARN("UringServer - accept failed: " + std::string(std::strerror(-res)));
+    }
+
+    if(!more && running_)
+    {
+        // multishot accept被内核终止(如出错)，重新提交
+        struct io_uring_sqe* sqe = worker->getSqe();
+        io_uring_prep_multishot_accept(sqe, listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        io_uring_sqe_set_data64(sqe, makeTag(nullptr, kAccept));
+    }
+}
+
+void UringServer::armRecv(Worker* worker, UringConnection* conn)
+{
+    struct io_uring_sqe* sqe = worker->getSqe();
+    io_uring_prep_recv_multishot(sqe, conn->fd_, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    io_uring_sqe_set_data64(sqe, makeTag(conn, kRecv));
+    conn->recvArmed_ = true;
+    ++conn->refs_;
+}
+
+void UringServer::handleRecv(Worker* worker, UringConnection* conn, int res, unsigned flags)
+{
+    if(!(flags & IORING_CQE_F_MORE))
+    {
+        conn->recvArmed_ = false;
+        --conn->refs_;
+    }
+
+    if(res > 0)
+    {
+        // 数据在内核挑选的缓冲区里，拷贝到连接的输入缓冲区后立即还给内核
+        unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        char* data = &worker->buffers[static_cast<size_t>(bid) * config_.bufferSize];
+        if(!conn->closing_)
+        {
+            conn->input_.append(data, static_cast<size_t>(res));
+        }
+        io_uring_buf_ring_add(worker->bufRing, data, config_.bufferSize, static_cast<unsigned short>(bid),
+                              io_uring_buf_ring_mask(config_.bufferCount), 0);
+        io_uring_buf_ring_advance(worker->bufRing, 1);
+
+        if(!conn->closing_)
+        {
+            if(!messageCallback_(conn, &conn->input_, &conn->output_))
+            {
+                conn->closing_ = true;
+            }
+            flush(worker, conn);
+        }
+    }
+    else if(res != -ENOBUFS)  // ENOBUFS: 接收缓冲区暂时用完，multishot已终止，下面重新提交
+    {
+        // 对端关闭或者出错，发送完已经生成的响应后关闭
+        conn->closing_ = true;
+        conn->input_.retrieveAll();
+        flush(worker, conn);
+    }
+
+    if(!conn->recvArmed_ && !conn->closing_)
+    {
+        armRecv(worker, conn);
+    }
+    release(worker, conn);
+}
+
+void UringServer::flush(Worker* worker, UringConnection* conn)
+{
+    if(conn->sendInFlight_ || conn->closeSubmitted_ || conn->fdClosed_)
+    {
+        return;  // 发送完成或者关闭链被取消时会再次调用
+    }
+
+    // sending_在发送期间不能被追加(内存可能被移动)，新的响应都写在output_里
+    if(conn->sending_.readableBytes() == 0)
+    {
+        conn->sending_.swap(conn->output_);
+    }
+    bool closeNow = conn->closing_ && conn->output_.readableBytes() == 0;
+
+    if(conn->sending_.readableBytes() > 0)
+    {
+        struct io_uring_sqe* sqe = worker->getSqe();
+        io_uring_prep_send(sqe, conn->fd_, conn->sending_.peek(), conn->sending_.readableBytes(), MSG_NOSIGNAL);
+        io_uring_sqe_set_data64(sqe, makeTag(conn, kSend));
+        if(closeNow)
+        {
+            // 只发送了一部分时链接的操作会被取消(-ECANCELED)，在handleClose中重新发送
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+        conn->sendInFlight_ = true;
+        ++conn->refs_;
+    }
+
+    if(closeNow)
+    {
+        // shutdown让还挂着的multishot recv结束，无论shutdown成功与否都继续close
+        struct io_uring_sqe* sqe = worker->getSqe();
+        io_uring_prep_shutdown(sqe, conn->fd_, SHUT_RDWR);
+        io_uring_sqe_set_data64(sqe, makeTag(conn, kShutdown));
+        sqe->flags |= IOSQE_IO_HARDLINK;
+        ++conn->refs_;
+
+        sqe = worker->getSqe();
+        io_uring_prep_close(sqe, conn->fd_);
+        io_uring_sqe_set_data64(sqe, makeTag(conn, kClose));
+        ++conn->refs_;
+        conn->closeSubmitted_ = true;
+    }
+}
+
+void UringServer::handleSend(Worker* worker, UringConnection* conn, int res)
+{
+    --conn->refs_;
+    conn->sendInFlight_ = false;
+    if(res < 0)
+    {
+        // 对端已经不可写，丢弃剩余数据直接关闭
+        conn->sending_.retrieveAll();
+        conn->output_.retrieveAll();
+        conn->input_.retrieveAll();
+        conn->closing_ = true;
+    }
+    else
+    {
+        conn->sending_.retrieve(static_cast<size_t>(res));
+    }
+
+    if(!conn->closing_ && conn->sending_.readableBytes() == 0 &&
+       conn->output_.readableBytes() == 0 && conn->input_.readableBytes() > 0)
+    {
+        // 输出积压时留在输入缓冲区里的流水线请求
+        if(!messageCallback_(conn, &conn->input_, &conn->output_))
+        {
+            conn->closing_ = true;
+        }
+    }
+    flush(worker, conn);
+    release(worker, conn);
+}
+
+void UringServer::handleClose(Worker* worker, UringConnection* conn, int res)
+{
+    --conn->refs_;
+    if(res == -ECANCELED)
+    {
+        // 前面的send只发出了一部分，继续发送剩余数据后重新提交关闭
+        conn->closeSubmitted_ = false;
+        flush(worker, conn);
+    }
+    else
+    {
+        conn->fdClosed_ = true;
+    }
+    release(worker, conn);
+}
+
+void UringServer::release(Worker* worker, UringConnection* conn)
+{
+    if(conn->fdClosed_ && conn->refs_ == 0)
+    {
+        if(connectionCallback_)
+        {
+            connectionCallback_(conn, false);
+        }
+        removeTimer(worker, conn);
+        worker->conns.erase(conn);
+        delete conn;
+    }
+}
+
+void UringServer::setTimeout(UringConnection* conn, int seconds)
+{
+    Worker* worker = workers_[static_cast<size_t>(conn->worker_)].get();
+    removeTimer(worker, conn);
+    if(seconds > 0)
+    {
+        addTimer(worker, conn, seconds);
+    }
+}
+
+void UringServer::armTick(Worker* worker)
+{
+    struct io_uring_sqe* sqe = worker->getSqe();
+    io_uring_prep_timeout(sqe, &worker->tickInterval, 0, 0);
+    io_uring_sqe_set_data64(sqe, makeTag(nullptr, kTick));
+}
+
+void UringServer::addTimer(Worker* worker, UringConnection* conn, int seconds)
+{
+    conn->deadline_ = worker->tick + static_cast<uint64_t>(seconds);
+    std::list<UringConnection*>& bucket = worker->wheel[conn->deadline_ % kWheelSize];
+    conn->timerEntry_ = bucket.insert(bucket.end(), conn);
+    conn->timerLinked_ = true;
+}
+
+void UringServer::removeTimer(Worker* worker, UringConnection* conn)
+{
+    if(conn->timerLinked_)
+    {
+        worker->wheel[conn->deadline_ % kWheelSize].erase(conn->timerEntry_);
+        conn->timerLinked_ = false;
+    }
+}
+
+void UringServer::handleTick(Worker* worker)
+{
+    if(running_)
+    {
+        armTick(worker);  // 单次timeout，每次完成后重新提交
+    }
+
+    ++worker->tick;
+    std::list<UringConnection*>& bucket = worker->wheel[worker->tick % kWheelSize];
+    // 先摘下到期的连接再处理，处理时可能重新加入时间轮
+    std::vector<UringConnection*> expired;
+    for(auto it = bucket.begin(); it != bucket.end();)
+    {
+        UringConnection* conn = *it;
+        if(conn->deadline_ <= worker->tick)
+        {
+            conn->timerLinked_ = false;
+            it = bucket.erase(it);
+            expired.push_back(conn);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    for(UringConnection* conn: expired)
+    {
+        handleExpire(worker, conn);
+    }
+}
+
+void UringServer::handleExpire(Worker* worker, UringConnection* conn)
+{
+    if(conn->fdClosed_)
+    {
+        return;
+    }
+
+    if(!conn->closing_ && !conn->sendInFlight_)
+    {
+        if(timeoutCallback_)
+        {
+            timeoutCallback_(conn, &conn->output_);
+        }
+        conn->closing_ = true;
+        conn->input_.retrieveAll();
+        flush(worker, conn);
+        addTimer(worker, conn, kCloseGrace);  // 对端不读时最后的响应会一直发不完
+    }
+    else
+    {
+        // 发送卡在对端不读上：shutdown让挂起的send失败，之后在handleSend/handleClose中提交close
+        conn->closing_ = true;
+        conn->output_.retrieveAll();
+        conn->input_.retrieveAll();
+        ::shutdown(conn->fd_, SHUT_RDWR);
+        flush(worker, conn);
+    }
+}
+
+}
+
+}
+
+#else  // HTTP_ENABLE_IO_URING
+
+namespace http
+{
+
+namespace net
+{
+
+struct UringServer::Worker
+{
+};
+
+UringServer::UringServer(int listenFd, int numThreads, const UringConfig& config):
+    listenFd_(listenFd),
+    config_(config),
+    running_(false)
+{
+}
+
+UringServer::~UringServer()
+{
+}
+
+bool UringServer::supported()
+{
+    return false;
+}
+
+void UringServer::start()
+{
+    logger_->ERROR("UringServer - built without HTTP_ENABLE_IO_URING");
+    abort();
+}
+
+void UringServer::stop()
+{
+}
+
+void UringServer::setTimeout(UringConnection* conn, int seconds)
+{
+}
+
+}
+
+}
+
+#endif  // HTTP_ENABLE_IO_URING
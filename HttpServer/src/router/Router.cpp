@@ -1,4 +1,7 @@
 #include "../../include/router/Router.h"
+#include "../../include/metrics/Metrics.h"
+#include "../../include/diagnostics/RequestTrace.h"
+#include "../../include/diagnostics/Probes.h"
 
 namespace http
 {
@@ -6,101 +9,273 @@ namespace http
 namespace router
 {
 
+namespace
+{
+
+// 以注册时的路径模式(而不是实际请求路径)作为指标标签，避免动态路由造成标签爆炸
+int registerRouteId(HttpRequest::Method method, const std::string &path)
+{
+    return metrics::MetricsRegistry::instance().routeId(HttpRequest::methodString(method), path);
+}
+
+// 每次发布新表取一个新版本号，不同Router之间也不重复，线程缓存不需要再区分是哪个Router
+uint64_t nextVersion()
+{
+    static std::atomic<uint64_t> version(0);
+    return version.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+// 本线程缓存的路由表和它的版本号，类型擦除后所有Router共用这一个缓存
+thread_local uint64_t t_cachedVersion = 0;
+thread_local std::shared_ptr<const void> t_cachedTable;
+// 本线程上正在执行的route()层数，处理器中嵌套调用route()时外层还在使用缓存的表，不能替换
+thread_local int t_routeDepth = 0;
+
+struct RouteDepthGuard
+{
+    RouteDepthGuard() { ++t_routeDepth; }
+    ~RouteDepthGuard() { --t_routeDepth; }
+};
+
+// 未开启跟踪时trace为空
+inline void markPhase(diagnostics::RequestTrace* trace, diagnostics::RequestTrace::Phase phase)
+{
+    if(trace)
+    {
+        trace->mark(phase);
+    }
+}
+
+}
+
 size_t Router::RouteKeyHash::operator()(const RouteKey& key) const
 {
     size_t methodHash = std::hash<int>{}(static_cast<int>(key.method));
-    size_t pathHash = std::hash<std::string>{}(key.path);
+    size_t pathHash = std::hash<std::string_view>{}(key.path);
     return methodHash * 31 + pathHash;
 }
 
+Router::Router():
+    table_(std::make_shared<RouteTable>()),
+    version_(nextVersion())
+{
+
+}
+
+template<typename Modify>
+void Router::update(Modify modify)
+{
+    std::lock_guard<std::mutex> writeLock(writeMutex_);
+    // 写者串行，table_只会被自己替换，这里读不需要tableMutex_
+    auto table = std::make_shared<RouteTable>(*table_);
+    modify(*table);
+
+    std::lock_guard<std::mutex> lock(tableMutex_);
+    table_ = std::move(table);
+    version_.store(nextVersion(), std::memory_order_release);
+}
+
+const Router::RouteTable* Router::currentTable(TablePtr* pinned) const
+{
+    // 绝大多数请求只有这一次原子读
+    if(t_cachedVersion == version_.load(std::memory_order_acquire))
+    {
+        return static_cast<const RouteTable*>(t_cachedTable.get());
+    }
+
+    std::lock_guard<std::mutex> lock(tableMutex_);
+    if(t_routeDepth == 0)
+    {
+        t_cachedTable = table_;
+        t_cachedVersion = version_.load(std::memory_order_relaxed);
+        return table_.get();
+    }
+    *pinned = table_;  // 嵌套调用，外层的表不能动，这次单独持有一份
+    return pinned->get();
+}
+
 // 注册路由处理器
 void Router::registerHandler(HttpRequest::Method method, const std::string &path, HandlerPtr handler)
 {
-    RouteKey key{method, path};  // 方法和URL
-    handlers_[key] = std::move(handler);   // URL到函数的映射————路由
+    int id = registerRouteId(method, path);
+    update([&](RouteTable& table) {
+        RouteKey key = table.makeKey(method, path);  // 方法和URL
+        table.handlers_[key] = std::move(handler);   // URL到函数的映射————路由
+        table.routeIds_[key] = id;
+    });
 }
 
 // 注册回调函数形式的处理器
 void Router::registerCallback(HttpRequest::Method method, const std::string &path, const HandlerCallback& callback)
 {
-    RouteKey key{method, path};
-    callbacks_[key] = std::move(callback);  // 同上
+    int id = registerRouteId(method, path);
+    update([&](RouteTable& table) {
+        RouteKey key = table.makeKey(method, path);
+        table.callbacks_[key] = callback;  // 同上
+        table.routeIds_[key] = id;
+    });
 }
 
 // 注册动态路由处理器
 void Router::addRegexHandler(HttpRequest::Method method, const std::string &path, HandlerPtr handler)
 {
-    std::regex pathRegex = convertToRegex(path);
-    regexHandlers_.emplace_back(method, pathRegex, handler);
+    std::regex pathRegex = convertToRegex(path);  // 在锁外编译正则
+    int id = registerRouteId(method, path);
+    update([&](RouteTable& table) {
+        table.regexHandlers_.emplace_back(method, pathRegex, handler, id, path);
+    });
 }
 
 // 注册动态路由处理函数
 void Router::addRegexCallback(HttpRequest::Method method, const std::string &path, const HandlerCallback& callback)
 {
     std::regex pathRegex = convertToRegex(path);
-    regexCallbacks_.emplace_back(method, pathRegex, callback);
+    int id = registerRouteId(method, path);
+    update([&](RouteTable& table) {
+        table.regexCallbacks_.emplace_back(method, pathRegex, callback, id, path);
+    });
+}
+
+bool Router::removeRoute(HttpRequest::Method method, const std::string &path)
+{
+    bool removed = false;
+    update([&](RouteTable& table) {
+        auto idIt = table.routeIds_.find(RouteKey{method, path});
+        if(idIt != table.routeIds_.end())
+        {
+            RouteKey key = idIt->first;
+            table.handlers_.erase(key);
+            table.callbacks_.erase(key);
+            table.routeIds_.erase(idIt);
+            // 新表不再需要这份路径，仍在使用旧表的线程各自持有它的引用
+            auto pathIt = std::find_if(table.routePaths_.begin(), table.routePaths_.end(),
+                [&key](const std::shared_ptr<const std::string>& p) { return p->data() == key.path.data(); });
+            if(pathIt != table.routePaths_.end())
+            {
+                table.routePaths_.erase(pathIt);
+            }
+            removed = true;
+        }
+
+        auto matches = [&](const auto& obj) { return obj.method_ == method && obj.pattern_ == path; };
+        size_t handlers = table.regexHandlers_.size();
+        size_t callbacks = table.regexCallbacks_.size();
+        table.regexHandlers_.erase(std::remove_if(table.regexHandlers_.begin(), table.regexHandlers_.end(), matches),
+                                   table.regexHandlers_.end());
+        table.regexCallbacks_.erase(std::remove_if(table.regexCallbacks_.begin(), table.regexCallbacks_.end(), matches),
+                                    table.regexCallbacks_.end());
+        removed = removed || handlers != table.regexHandlers_.size() || callbacks != table.regexCallbacks_.size();
+    });
+    return removed;
 }
 
 // 处理请求
-bool Router::route(const HttpRequest &req, HttpResponse* resp)
+bool Router::route(HttpRequest &req, HttpResponse* resp, int* routeId)
 {
     /*  GET /api/search?q=keyword&page=1 HTTP/1.1 【这是请求行】
         Method: GET
         Path: /api/search
     */
     RouteKey key{req.method(), req.path()};
+    diagnostics::RequestTrace* trace = req.trace();
+    TablePtr pinned;
+    const RouteTable& table = *currentTable(&pinned);
+    RouteDepthGuard depthGuard;
+
+    if(routeId)
+    {
+        auto idIt = table.routeIds_.find(key);
+        *routeId = idIt != table.routeIds_.end() ? idIt->second : 0;
+    }
 
     // 查找处理器
-    auto handleIt = handlers_.find(key);
-    if(handleIt != handlers_.end())
+    auto handleIt = table.handlers_.find(key);
+    if(handleIt != table.handlers_.end())
     {   // HandlerPtr::handle()方法
+        markPhase(trace, diagnostics::RequestTrace::kRoute);
+        HTTP_PROBE2(route__matched, routeId ? *routeId : 0, req.path().c_str());
+        HTTP_PROBE1(handler__start, routeId ? *routeId : 0);
         handleIt->second->handle(req, resp);
+        HTTP_PROBE1(handler__end, routeId ? *routeId : 0);
+        markPhase(trace, diagnostics::RequestTrace::kHandler);
         return true;
     }
 
     // 查找回调函数
-    auto callbackIt = callbacks_.find(key);
-    if(callbackIt != callbacks_.end())
+    auto callbackIt = table.callbacks_.find(key);
+    if(callbackIt != table.callbacks_.end())
     {
+        markPhase(trace, diagnostics::RequestTrace::kRoute);
+        HTTP_PROBE2(route__matched, routeId ? *routeId : 0, req.path().c_str());
+        HTTP_PROBE1(handler__start, routeId ? *routeId : 0);
         callbackIt->second(req, resp);
+        HTTP_PROBE1(handler__end, routeId ? *routeId : 0);
+        markPhase(trace, diagnostics::RequestTrace::kHandler);
         return true;
     }
 
     // 查找动态路由处理器
-    for(const auto &[method, pathRegex, handler]: regexHandlers_)
+    for(const auto &[method, pathRegex, handler, id, pattern]: table.regexHandlers_)
     {
         std::smatch match;
-        std::string pathStr(req.path());
-        // 如果方法匹配并且动态路由匹配，则执行处理器
-        if(method == req.method() && std::regex_match(pathStr, match, pathRegex))
+        // 如果方法匹配并且动态路由匹配，则执行处理器，先比较方法，不匹配时跳过正则
+        if(method == req.method() && std::regex_match(req.path(), match, pathRegex))
         {
-            HttpRequest newReq(req);
-            extractPathParameters(match, newReq);
+            extractPathParameters(match, req);
 
-            handler->handle(newReq, resp);
+            if(routeId)
+            {
+                *routeId = id;
+            }
+            markPhase(trace, diagnostics::RequestTrace::kRoute);
+            HTTP_PROBE2(route__matched, id, pattern.c_str());
+            HTTP_PROBE1(handler__start, id);
+            handler->handle(req, resp);
+            HTTP_PROBE1(handler__end, id);
+            markPhase(trace, diagnostics::RequestTrace::kHandler);
             return true;
         }
     }
 
     // 查找动态路由回调函数
-    for(const auto &[method, pathRegex, callback]: regexCallbacks_){
+    for(const auto &[method, pathRegex, callback, id, pattern]: table.regexCallbacks_){
         std::smatch match;
-        std::string pathStr(req.path());
-        // 如果方法匹配并且动态路由匹配，则执行处理器
-        if(method == req.method() && std::regex_match(pathStr, match, pathRegex))
+        // 如果方法匹配并且动态路由匹配，则执行处理器，先比较方法，不匹配时跳过正则
+        if(method == req.method() && std::regex_match(req.path(), match, pathRegex))
         {
-            HttpRequest newReq(req);
-            extractPathParameters(match, newReq);
+            extractPathParameters(match, req);
 
-            callback(newReq, resp);
+            if(routeId)
+            {
+                *routeId = id;
+            }
+            markPhase(trace, diagnostics::RequestTrace::kRoute);
+            HTTP_PROBE2(route__matched, id, pattern.c_str());
+            HTTP_PROBE1(handler__start, id);
+            callback(req, resp);
+            HTTP_PROBE1(handler__end, id);
+            markPhase(trace, diagnostics::RequestTrace::kHandler);
             return true;
         }
     }
 
+    markPhase(trace, diagnostics::RequestTrace::kRoute);
     return false;
 }
 
 
+Router::RouteKey Router::RouteTable::makeKey(HttpRequest::Method method, const std::string &path)
+{
+    RouteKey key{method, path};
+    auto it = routeIds_.find(key);
+    if(it != routeIds_.end())
+    {
+        return it->first;  // 重复注册，沿用已保存的路径
+    }
+    routePaths_.push_back(std::make_shared<const std::string>(path));
+    return RouteKey{method, *routePaths_.back()};
+}
+
 std::regex Router::convertToRegex(const std::string &pathPattern)
 {   
     std::string regexPattern = "^" + std::regex_replace(pathPattern, std::regex(R"(/:([^/]+))"), R"(/([^/]+))") + "$";
@@ -111,24 +286,30 @@ void Router::extractPathParameters(const std::smatch &match, HttpRequest& reques
 {
     for(size_t i = 1; i < match.size(); ++i)
     {   // 键 和 值
-        request.setPathParameters("param" + std::to_string(i), match[i].str());
+        // 值直接引用路径中匹配到的部分，拷贝到请求的内存池上
+        std::string_view value = match[i].length() > 0 ? std::string_view(&*match[i].first, match[i].length()) : std::string_view();
+        request.setPathParameters("param" + std::to_string(i), value);
     }
 }
 
 Router::RouteCallbackObj::RouteCallbackObj(HttpRequest::Method method, 
-                    std::regex pathRegex, const HandlerCallback &callback):
+                    std::regex pathRegex, const HandlerCallback &callback, int routeId, const std::string &pattern):
     method_(method),
     pathRegex_(pathRegex),
-    callback_(callback)
+    callback_(callback),
+    routeId_(routeId),
+    pattern_(pattern)
 {
 
 }
 
 Router::RouteHandlerObj::RouteHandlerObj(HttpRequest::Method method, 
-                    std::regex pathRegex, HandlerPtr handler):
+                    std::regex pathRegex, HandlerPtr handler, int routeId, const std::string &pattern):
     method_(method), 
     pathRegex_(pathRegex),
-    handler_(handler)   
+    handler_(handler),
+    routeId_(routeId),
+    pattern_(pattern)
 {
 
 }
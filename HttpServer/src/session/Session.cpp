@@ -7,12 +7,24 @@ namespace http
 namespace session
 {
 
+namespace
+{
+
+memory::MemoryAccount g_memoryAccount("session");
+
+// 哈希表每个节点除了键值之外的开销：next指针和缓存的哈希值
+const size_t kNodeOverhead = 2 * sizeof(void*);
+
+}
+
 Session::Session(const std::string& sessionId, 
             SessionManager* sessionManger, int maxAge):
     sessionId_(sessionId),
     sessionManager_(sessionManger),
-    maxAge_(maxAge_)
+    maxAge_(maxAge_),
+    memoryTracker_(g_memoryAccount, sizeof(Session))
 {
+    updateMemory();
     refresh();
 }
 
@@ -30,6 +42,7 @@ void Session::refresh()
 void Session::setValue(const std::string &key, const std::string &value)
 {
     data_[key] = value;
+    updateMemory();
     // 如果设置了manager，自动保存更改
     if(sessionManager_)
     {
@@ -46,11 +59,23 @@ std::string Session::getValue(const std::string &key) const
 void Session::remove(const std::string &key)
 {   
     data_.erase(key);
+    updateMemory();
 }
 
 void Session::clear()
 {
     data_.clear();
+    updateMemory();
+}
+
+void Session::updateMemory()
+{
+    size_t bytes = sizeof(Session) + memory::heapBytes(sessionId_) + data_.bucket_count() * sizeof(void*);
+    for(const auto& item: data_)
+    {
+        bytes += sizeof(item) + kNodeOverhead + memory::heapBytes(item.first) + memory::heapBytes(item.second);
+    }
+    memoryTracker_.setBytes(bytes);
 }
 
 }
@@ -59,6 +59,12 @@ std::shared_ptr<Session> SessionManager::getSession(const HttpRequest& req, Http
     
 }
 
+// 只查询不创建，供限流等需要确认sessionId真实性的地方使用
+bool SessionManager::hasSession(const std::string& sessionId)
+{
+    return storage_->load(sessionId) != nullptr;
+}
+
 // 销毁会话
 void SessionManager::destorySession(const std::string& sessionId)
 {
@@ -103,15 +109,15 @@ std::string SessionManager::getSessionIdFromCookie(const HttpRequest& req)
         Cookie: sessionId=abc123def456; username=john; theme=dark 
     */
     std::string sessionId;
-    std::string cookie = req.getHeader("Cookie");
+    std::string_view cookie = req.getHeader("Cookie");
     if(!cookie.empty())
     {
         size_t pos = cookie.find("sessionId=");
-        if(pos != std::string::npos)
+        if(pos != std::string_view::npos)
         {
             pos += 10;  // 跳过sessionId=这10个字符
             size_t end = cookie.find(";", pos);  // 从pos开始找
-            if(end != std::string::npos)
+            if(end != std::string_view::npos)
             {
                 sessionId = cookie.substr(pos, end-pos);
             }
@@ -1,5 +1,6 @@
 #include "../../include/ssl/SslConnection.h"
 #include "../../include/ssl/SslTypes.h"
+#include "../../include/diagnostics/Probes.h"
 
 #include <openssl/err.h>
 #include "mymuduo/Alogger.h"
@@ -8,6 +9,8 @@
 namespace ssl
 {
 
+static http::memory::MemoryAccount g_memoryAccount("ssl_connection");
+
 static BIO_METHOD* createCustomBioMethod()
 {
     BIO_METHOD* method = BIO_meth_new(BIO_TYPE_MEM, "custom");
@@ -24,8 +27,12 @@ SslConnection::SslConnection(const TcpConnectionPtr& conn, SslContext* ctx):
     state_(SSLState::HANDSHAKE),
     readBio_(nullptr),
     writeBio_(nullptr),
-    messageCallback_(nullptr)
+    messageCallback_(nullptr),
+    memoryTracker_(g_memoryAccount, sizeof(SslConnection))
 {
+    memoryTracker_.setBytes(sizeof(SslConnection) + readBuffer_.internalCapacity() +
+                            writeBuffer_.internalCapacity() + decryptedBuffer_.internalCapacity());
+
     // 创建 SSL 对象
     ssl_ = SSL_new(ctx_->getNativeHandle());
     /*
@@ -74,6 +81,7 @@ SslConnection::~SslConnection()
 void SslConnection::startHandshake()
 {
     SSL_set_accept_state(ssl_);
+    HTTP_PROBE1(ssl__handshake__start, this);
     handleHandshake();
 }
 
@@ -214,6 +222,7 @@ void SslConnection::handleHandshake()
     if(ret == 1)  // 握手成功
     {   // 从SSLState::HANDSHAKE 变成 SSLState::ESTABLISHED 
         state_ = SSLState::ESTABLISHED;
+        HTTP_PROBE2(ssl__handshake__end, this, 1);
         logger_->INFO("SSL handshake completed successfully");
         logger_->INFO(std::string("Using cipher: ") + SSL_get_cipher(ssl_));
         logger_->INFO(std::string("Protocol version: ") + SSL_get_version(ssl_));
@@ -239,6 +248,7 @@ void SslConnection::handleHandshake()
             unsigned long errCode = ERR_get_error();
             ERR_error_string_n(errCode, errBuf, sizeof(errBuf));
             logger_->ERROR(std::string("SSL handshake failed: ") + errBuf);
+            HTTP_PROBE2(ssl__handshake__end, this, 0);
             conn_->shutdown();  // 关闭连接
             break;
         }
@@ -1,5 +1,7 @@
 #include "../../../include/utils/db/DbConnectionPool.h"
 #include "../../../include/utils/db/DbException.h"
+#include "../../../include/metrics/Metrics.h"
+#include "../../../include/diagnostics/Probes.h"
 #include "mymuduo/Alogger.h"
 
 namespace http
@@ -43,8 +45,11 @@ DbConnectionPool::~DbConnectionPool()
 // 获取连接
 std::shared_ptr<DbConnection> DbConnectionPool::getConnection()
 {
+    static const int waitTimerId = metrics::MetricsRegistry::instance().timerId(
+        "db_pool_wait_seconds", "Time spent waiting for a pooled database connection");
     std::shared_ptr<DbConnection> conn;
     {
+        metrics::ScopedTimer waitTimer(waitTimerId);
         std::unique_lock<std::mutex> lock(mutex_);
         while(connections_.empty())
         {
@@ -69,8 +74,10 @@ std::shared_ptr<DbConnection> DbConnectionPool::getConnection()
             conn->reconnect();
         }
 
+        HTTP_PROBE1(db__borrow, conn.get());
         return std::shared_ptr<DbConnection>(conn.get(), 
             [this, conn](DbConnection*){
+                HTTP_PROBE1(db__return, conn.get());
                 std::lock_guard<std::mutex> lock(mutex_);
                 connections_.push(conn);
                 cv_.notify_one();
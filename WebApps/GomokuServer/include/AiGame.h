@@ -9,6 +9,8 @@
 #include <vector>
 #include <mutex>
 
+#include "../../../HttpServer/include/memory/MemoryAccounting.h"
+
 const int BOARD_SIZE = 15;
 
 const std::string EMPTY = "empty";
@@ -62,6 +64,7 @@ private:
     std::pair<int, int> lastMove_{-1, -1};  // 上一次落子位置
     std::vector<std::vector<std::string>> board_;
     mutable std::mutex mutex_;
+    http::memory::MemoryTracker memoryTracker_;  // 计入ai_game
 };
 
 #endif
\ No newline at end of file
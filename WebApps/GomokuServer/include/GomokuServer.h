@@ -34,6 +34,14 @@ public:
                  TcpServer::Option option = TcpServer::kNoReusePort);
     
     void setThreadNum(int numThreads);
+    // 部署在本机nginx之后时，让nginx通过Unix域socket转发
+    void addUnixListener(const std::string& path);
+    // nginx设置了X-Real-IP时开启，/aiBot/move等按IP的限流才对Unix域socket上的请求生效
+    void setTrustProxyHeaders(bool trust);
+    // 热升级，见HttpServer::enableHotUpgrade，要求构造时传入TcpServer::kReusePort
+    void enableHotUpgrade(const std::string& controlPath, bool takeover, int drainTimeoutSeconds);
+    // 管理接口(/admin/...)的口令，见HttpServer::setAdminToken
+    void setAdminToken(const std::string& token);
     void start();
 private:
     void initialize();
@@ -1,16 +1,32 @@
 #include "../include/AiGame.h"
+#include "../../../HttpServer/include/metrics/Metrics.h"
+#include "../../../HttpServer/include/diagnostics/Probes.h"
 
 #include <chrono>
 #include <thread>
 
+namespace
+{
+
+http::memory::MemoryAccount g_memoryAccount("ai_game");
+
+}
 
 AiGame::AiGame(int userId):
     gameOver_(false),
     userId_(userId),
     moveCount_(0),
     lastMove_(-1, -1),
-    board_(BOARD_SIZE, std::vector<std::string>(BOARD_SIZE, EMPTY))
+    board_(BOARD_SIZE, std::vector<std::string>(BOARD_SIZE, EMPTY)),
+    memoryTracker_(g_memoryAccount, sizeof(AiGame))
 {
+    // 棋盘的每一行是一块堆内存，格子里的字符串都很短，存放在string对象内部
+    size_t bytes = sizeof(AiGame) + board_.capacity() * sizeof(board_[0]);
+    for(const auto& row: board_)
+    {
+        bytes += row.capacity() * sizeof(row[0]);
+    }
+    memoryTracker_.setBytes(bytes);
     srand(time(0));  // 初始化随机种子
 }
 
@@ -86,9 +102,14 @@ bool AiGame::checkWin(int x, int y, const std::string& player)
 void AiGame::aiMove()
 {
     if(gameOver_ || isDraw()) { return; }
+    static const int timerId = http::metrics::MetricsRegistry::instance().timerId(
+        "gomoku_ai_move_seconds", "Time spent computing an AI move");
+    http::metrics::ScopedTimer timer(timerId);
+    HTTP_PROBE1(ai__move__start, userId_);
     std::this_thread::sleep_for(std::chrono::milliseconds(500));  // 添加500ms延时
     int x, y;
     std::tie(x, y) = getBestMove();
+    HTTP_PROBE3(ai__move__end, userId_, x, y);
     moveCount_++;
     board_[x][y] = AI_PLAYER;
     lastMove_ = {x, y};
@@ -1,7 +1,7 @@
 #include "../include/GomokuServer.h"
 
 GomokuServer::GomokuServer(int port, const std::string& name,
-                 TcpServer::Option option = TcpServer::kNoReusePort):
+                 TcpServer::Option option):
     httpServer_(port, name, true, option),
     maxOnline_(0)
 {
@@ -13,6 +13,26 @@ void GomokuServer::setThreadNum(int numThreads)
     httpServer_.setThreadNum(numThreads);
 }
 
+void GomokuServer::addUnixListener(const std::string& path)
+{
+    httpServer_.addUnixListener(path);
+}
+
+void GomokuServer::setTrustProxyHeaders(bool trust)
+{
+    httpServer_.setTrustProxyHeaders(trust);
+}
+
+void GomokuServer::enableHotUpgrade(const std::string& controlPath, bool takeover, int drainTimeoutSeconds)
+{
+    httpServer_.enableHotUpgrade(controlPath, takeover, drainTimeoutSeconds);
+}
+
+void GomokuServer::setAdminToken(const std::string& token)
+{
+    httpServer_.setAdminToken(token);
+}
+
 void GomokuServer::start()
 {
     httpServer_.start();
@@ -74,6 +94,10 @@ void GomokuServer::initializeRouter()
             getBackendData(req, resp);
         } 
     );
+    // 线上CPU剖析，只对本机开放：curl -X POST 'localhost:port/admin/profile/start?seconds=30'
+    httpServer_.enableProfiler();
+    // 各类对象的内存占用，同样只对本机开放：curl localhost:port/admin/memory
+    httpServer_.enableMemoryStats();
 }
 
 void GomokuServer::initializeMiddleWare()
@@ -82,6 +106,41 @@ void GomokuServer::initializeMiddleWare()
     auto corsMiddleware = std::make_shared<http::middleware::CorsMiddleware>();
     // 添加中间件
     httpServer_.addMiddleware(corsMiddleware);
+
+    // 每一步落子都要跑一次AI搜索，限制单个会话和单个IP的落子频率
+    http::middleware::RateLimitRule perSession;
+    perSession.path = "/aiBot/move";
+    perSession.key = http::middleware::RateLimitKey::kSession;
+    perSession.ratePerSecond = 5;
+    perSession.burst = 10;
+    http::middleware::RateLimitRule perIp = perSession;
+    perIp.key = http::middleware::RateLimitKey::kIp;
+    perIp.ratePerSecond = 20;
+    perIp.burst = 40;
+    http::middleware::RateLimitConfig rateLimitConfig;
+    rateLimitConfig.rules.push_back(perSession);
+    rateLimitConfig.rules.push_back(perIp);
+    auto rateLimitMiddleware = std::make_shared<http::middleware::RateLimitMiddleware>(rateLimitConfig);
+    // 只有服务端发出的会话才单独计数，否则每次换一个sessionId就能绕过单会话的限制
+    rateLimitMiddleware->setSessionValidator([this](const std::string& sessionId) {
+        http::session::SessionManager* manager = httpServer_.getSessionManager();
+        return manager != nullptr && manager->hasSession(sessionId);
+    });
+    httpServer_.addMiddleware(rateLimitMiddleware);
+
+    // 后台页面每个标签页都在轮询统计数据，每次都要查数据库，短时间缓存即可
+    http::middleware::CacheRule backendData;
+    backendData.path = "/backend_data";
+    backendData.ttlMs = 1000;
+    backendData.staleMs = 5000;
+    http::middleware::CacheConfig cacheConfig;
+    cacheConfig.rules.push_back(backendData);
+    httpServer_.enableResponseCache(cacheConfig);
+
+    // 缓存过期的瞬间各个线程上的请求会同时未命中，合并成一次查询
+    http::SingleFlightConfig flightConfig;
+    flightConfig.paths.push_back("/backend_data");
+    httpServer_.enableSingleFlight(flightConfig);
 }
 
 void GomokuServer::setSessionManager(std::unique_ptr<http::session::SessionManager> manager)
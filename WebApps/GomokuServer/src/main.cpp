@@ -1,13 +1,94 @@
-// #include "../include/GomokuServer.h"
-// #include <iostream>
-
-// int main(int argc, char* argv[]) {
-//     try {
-//         GomokuServer server;
-//         server.start();
-//         return 0;
-//     } catch (const sql:SQLException& e) {
-//         std::cerr << "Error: " << e.what() << std::endl;
-//         return 1;
-//     }
-// }
+#include "../include/GomokuServer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+/*
+    用法: simple_server [--key=value ...]
+        --port=80                 监听端口
+        --threads=4               I/O线程数
+        --unix=PATH               另外在Unix域socket上监听，供本机nginx转发
+        --trust-proxy=0           为1时采用nginx通过X-Real-IP/X-Forwarded-For转发的客户端地址
+        --admin-token=TOKEN       /admin/...接口要求的X-Admin-Token
+        --hot-upgrade=PATH        开启热升级，PATH是新旧进程交接监听socket用的控制socket
+        --takeover=0              为1时从正在运行的旧进程接管监听socket(需要--hot-upgrade)
+        --drain-timeout=30        旧进程交出监听socket后最多等待多少秒排空连接
+
+    热升级: 旧进程以--hot-upgrade=PATH运行，新版本以相同参数加上--takeover=1启动，
+    新进程接管监听socket后旧进程排空现有连接并退出
+*/
+namespace
+{
+
+std::map<std::string, std::string> parseArgs(int argc, char* argv[])
+{
+    std::map<std::string, std::string> args;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if(arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+        {
+            std::fprintf(stderr, "invalid argument: %s\n", argv[i]);
+            std::exit(1);
+        }
+        args[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+    }
+    return args;
+}
+
+std::string argOr(const std::map<std::string, std::string>& args, const std::string& key, const std::string& value)
+{
+    auto it = args.find(key);
+    return it == args.end() ? value : it->second;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::map<std::string, std::string> args = parseArgs(argc, argv);
+    int port = std::atoi(argOr(args, "port", "80").c_str());
+    int threads = std::atoi(argOr(args, "threads", "4").c_str());
+    std::string unixPath = argOr(args, "unix", "");
+    std::string adminToken = argOr(args, "admin-token", "");
+    std::string upgradePath = argOr(args, "hot-upgrade", "");
+    bool takeover = argOr(args, "takeover", "0") == "1";
+    int drainTimeout = std::atoi(argOr(args, "drain-timeout", "30").c_str());
+    if(takeover && upgradePath.empty())
+    {
+        std::fprintf(stderr, "--takeover=1 requires --hot-upgrade=PATH\n");
+        return 1;
+    }
+
+    try
+    {
+        // 热升级时新进程在接管之前就要bind同一个端口，新旧进程都必须带SO_REUSEPORT
+        GomokuServer server(port, "GomokuServer",
+                            upgradePath.empty() ? TcpServer::kNoReusePort : TcpServer::kReusePort);
+        server.setThreadNum(threads);
+        if(!unixPath.empty())
+        {
+            server.addUnixListener(unixPath);
+            server.setTrustProxyHeaders(argOr(args, "trust-proxy", "0") == "1");
+        }
+        if(!adminToken.empty())
+        {
+            server.setAdminToken(adminToken);
+        }
+        if(!upgradePath.empty())
+        {
+            server.enableHotUpgrade(upgradePath, takeover, drainTimeout);
+        }
+        server.start();
+        return 0;
+    }
+    catch(const sql::SQLException& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}